@@ -55,7 +55,8 @@ namespace UnrealBuildTool.Rules
 					"MediaAssets",
 					"OpenSSL",
 					"TimeManagement",
-					"RenderCore"
+					"RenderCore",
+					"AudioMixer"
 				});
 
 			PrivateDependencyModuleNames.AddRange(
@@ -65,7 +66,7 @@ namespace UnrealBuildTool.Rules
 					"MediaIOCore",
 					"Projects",
 					"SlateCore",
-					"AudioMixer",
+					"SignalProcessing",
 					"WebSockets",
 					"HTTP",
 					"Json",
@@ -8,10 +8,22 @@
 
 #include "Components/AudioComponent.h"
 
+namespace
+{
+	// About the 20000 bytes that used to be the fixed limit, for 48 kHz stereo 16 bits
+	constexpr int32 MaxQueuedAudioMs = 100;
+
+	// Longer pull periods deliver whole blocks, leave room for a few of them
+	constexpr int32 MinQueuedAudioBlocks = 3;
+}
+
 void UMillicastAudioInstance::UpdateAudioParameters(FMillicastAudioParameters Parameters) noexcept
 {
 	AudioParameters = MoveTemp(Parameters);
 
+	// USoundWaveProcedural only takes 16 bits PCM, float consumers should render through the audio mixer directly
+	AudioParameters.SetSampleFormat(EMillicastAudioSampleFormat::Int16);
+
 	if (SoundStreaming)
 	{
 		SoundStreaming->SetSampleRate(AudioParameters.SamplesPerSecond);
@@ -64,8 +76,11 @@ void UMillicastAudioInstance::QueueAudioData(const uint8* AudioData, int32 NumSa
 	{
 		// Potential Fix for clients that are out of sync, that get a buffer that is too large to work off
 		// Six figure buffer size has been observed in the wild. This is a very crude approach to the problem
+		const int32 BytesPerBlock = AudioParameters.GetNumberSamples() * AudioParameters.GetNumberBytesPerSample();
+		const int32 MaxQueuedAudioSize = FMath::Max(MaxQueuedAudioMs * BytesPerBlock / AudioParameters.TimePerFrameMs, MinQueuedAudioBlocks * BytesPerBlock);
+
 		const auto QueuedAudioSize = SoundStreaming->GetAvailableAudioByteCount();
-		if( QueuedAudioSize >= 20000 )
+		if( QueuedAudioSize >= MaxQueuedAudioSize )
 		{
 			SoundStreaming->ResetAudio();
 		}
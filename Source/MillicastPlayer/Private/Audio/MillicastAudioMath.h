@@ -0,0 +1,94 @@
+// Copyright Millicast 2023. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Runtime/Launch/Resources/Version.h"
+
+namespace Millicast::Player::AudioMath
+{
+#if ENGINE_MAJOR_VERSION < 5
+	// VectorRegister is always float before UE5, which only adds the explicit float names
+	using VectorRegister4Float = VectorRegister;
+
+	FORCEINLINE VectorRegister4Float MakeVectorRegisterFloat(float X, float Y, float Z, float W)
+	{
+		return MakeVectorRegister(X, Y, Z, W);
+	}
+
+	FORCEINLINE VectorRegister4Float VectorZeroFloat()
+	{
+		return VectorZero();
+	}
+#endif
+
+	/**
+	 * Converts interleaved int16 PCM to float PCM in [-1, 1].
+	 * Kept as a single branch free loop over restrict pointers so that the compiler emits SIMD code for it.
+	 */
+	inline void ConvertInt16ToFloat(const int16* RESTRICT InSamples, float* RESTRICT OutSamples, int32 NumSamples)
+	{
+		constexpr float Scale = 1.0f / 32768.0f;
+
+		for (int32 i = 0; i < NumSamples; ++i)
+		{
+			OutSamples[i] = static_cast<float>(InSamples[i]) * Scale;
+		}
+	}
+
+	/**
+	 * Accumulates interleaved stereo samples into Out, applying one gain per channel.
+	 * Processes two stereo frames per SIMD register.
+	 */
+	inline void MixInStereo(const float* RESTRICT InSamples, float* RESTRICT OutSamples, int32 NumFrames, float LeftGain, float RightGain)
+	{
+		const int32 NumSamples = NumFrames * 2;
+		const VectorRegister4Float Gains = MakeVectorRegisterFloat(LeftGain, RightGain, LeftGain, RightGain);
+
+		int32 i = 0;
+		for (; i + 4 <= NumSamples; i += 4)
+		{
+			const VectorRegister4Float Input = VectorLoad(InSamples + i);
+			const VectorRegister4Float Output = VectorLoad(OutSamples + i);
+			VectorStore(VectorMultiplyAdd(Input, Gains, Output), OutSamples + i);
+		}
+
+		for (; i < NumSamples; i += 2)
+		{
+			OutSamples[i] += InSamples[i] * LeftGain;
+			OutSamples[i + 1] += InSamples[i + 1] * RightGain;
+		}
+	}
+
+	/**
+	 * Sum of squares and absolute peak of a block of float samples, in a single SIMD pass.
+	 * RMS is sqrt(SumOfSquares / NumSamples).
+	 */
+	inline void ComputeLevels(const float* RESTRICT InSamples, int32 NumSamples, float& OutSumOfSquares, float& OutPeak)
+	{
+		VectorRegister4Float SumOfSquares = VectorZeroFloat();
+		VectorRegister4Float Peak = VectorZeroFloat();
+
+		int32 i = 0;
+		for (; i + 4 <= NumSamples; i += 4)
+		{
+			const VectorRegister4Float Input = VectorLoad(InSamples + i);
+			SumOfSquares = VectorMultiplyAdd(Input, Input, SumOfSquares);
+			Peak = VectorMax(Peak, VectorAbs(Input));
+		}
+
+		float Sums[4];
+		float Peaks[4];
+		VectorStore(SumOfSquares, Sums);
+		VectorStore(Peak, Peaks);
+
+		OutSumOfSquares = Sums[0] + Sums[1] + Sums[2] + Sums[3];
+		OutPeak = FMath::Max(FMath::Max(Peaks[0], Peaks[1]), FMath::Max(Peaks[2], Peaks[3]));
+
+		for (; i < NumSamples; ++i)
+		{
+			OutSumOfSquares += InSamples[i] * InSamples[i];
+			OutPeak = FMath::Max(OutPeak, FMath::Abs(InSamples[i]));
+		}
+	}
+}
@@ -0,0 +1,295 @@
+// Copyright Millicast 2023. All Rights Reserved.
+
+#include "Audio/MillicastAudioMixerComponent.h"
+
+#include "Audio/MillicastAudioMath.h"
+#include "Audio/MillicastAudioRingBuffer.h"
+#include "Containers/Queue.h"
+#include "IMillicastMediaTrack.h"
+#include "MillicastPlayerPrivate.h"
+
+namespace Millicast::Player
+{
+	// Half a second of stereo audio per input, MaxLatencyMs is what bounds the actual latency
+	constexpr int32 MixerInputCapacity = 48000;
+
+	/** Shared between a mixer input (WebRTC thread writes samples, game thread writes gains) and the render thread */
+	struct FAudioMixerInputState
+	{
+		explicit FAudioMixerInputState(int32 InMaxQueuedSamples)
+			: RingBuffer(MixerInputCapacity, InMaxQueuedSamples)
+		{
+		}
+
+		FAudioRingBuffer RingBuffer;
+		TAtomic<float> LeftGain{ 1.f };
+		TAtomic<float> RightGain{ 1.f };
+		TAtomic<bool> bDetached{ false };
+	};
+
+	/**
+	 * Render side of the mixer. New inputs go through a lock free queue, so the render callback
+	 * never waits on the game thread. Everything else is only touched by the render thread.
+	 */
+	struct FAudioMixerState
+	{
+		TQueue<TSharedPtr<FAudioMixerInputState, ESPMode::ThreadSafe>, EQueueMode::Mpsc> PendingInputs;
+		TArray<TSharedPtr<FAudioMixerInputState, ESPMode::ThreadSafe>> ActiveInputs;
+		TArray<float> Scratch;
+
+		void Render(float* OutAudio, int32 NumSamples)
+		{
+			TSharedPtr<FAudioMixerInputState, ESPMode::ThreadSafe> NewInput;
+			while (PendingInputs.Dequeue(NewInput))
+			{
+				ActiveInputs.Add(MoveTemp(NewInput));
+			}
+
+			ActiveInputs.RemoveAllSwap([](const auto& Input) { return Input->bDetached.Load(); });
+
+			FMemory::Memzero(OutAudio, NumSamples * sizeof(float));
+			Scratch.SetNumUninitialized(NumSamples, false);
+
+			for (const auto& Input : ActiveInputs)
+			{
+				if (Input->RingBuffer.Pop(Scratch.GetData(), NumSamples) == 0)
+				{
+					continue;
+				}
+
+				AudioMath::MixInStereo(Scratch.GetData(), OutAudio, NumSamples / 2, Input->LeftGain.Load(), Input->RightGain.Load());
+			}
+		}
+	};
+
+	class FMillicastMixerSoundGenerator : public ISoundGenerator
+	{
+	public:
+		explicit FMillicastMixerSoundGenerator(TSharedPtr<FAudioMixerState, ESPMode::ThreadSafe> InState)
+			: State(MoveTemp(InState))
+		{
+		}
+
+		int32 OnGenerateAudio(float* OutAudio, int32 NumSamples) override
+		{
+			State->Render(OutAudio, NumSamples);
+			return NumSamples;
+		}
+
+	private:
+		TSharedPtr<FAudioMixerState, ESPMode::ThreadSafe> State;
+	};
+}
+
+/** Mixer input */
+
+void UMillicastAudioMixerInput::Setup(UMillicastAudioMixerComponent* InMixer, UMillicastAudioTrack* InTrack, int32 InMaxLatencyMs)
+{
+	Mixer = InMixer;
+	Track = InTrack;
+	MaxLatencyMs = InMaxLatencyMs;
+
+	AudioParameters.SetSampleFormat(EMillicastAudioSampleFormat::Float32);
+	State = MakeShared<Millicast::Player::FAudioMixerInputState, ESPMode::ThreadSafe>(GetMaxQueuedSamples());
+
+	UpdateChannelGains();
+}
+
+void UMillicastAudioMixerInput::SetGain(float InGain)
+{
+	Gain = FMath::Max(InGain, 0.f);
+	UpdateChannelGains();
+}
+
+void UMillicastAudioMixerInput::SetPan(float InPan)
+{
+	Pan = FMath::Clamp(InPan, -1.f, 1.f);
+	UpdateChannelGains();
+}
+
+void UMillicastAudioMixerInput::UpdateChannelGains()
+{
+	if (!State)
+	{
+		return;
+	}
+
+	// Balance law: the sources are already stereo, so panning attenuates the opposite channel and keeps the center at unity
+	State->LeftGain = Gain * FMath::Min(1.f, 1.f - Pan);
+	State->RightGain = Gain * FMath::Min(1.f, 1.f + Pan);
+}
+
+void UMillicastAudioMixerInput::UpdateAudioParameters(FMillicastAudioParameters Parameters) noexcept
+{
+	AudioParameters = MoveTemp(Parameters);
+
+	// The mixer works on interleaved float stereo
+	AudioParameters.SetSampleFormat(EMillicastAudioSampleFormat::Float32);
+	AudioParameters.NumberOfChannels = 2;
+
+	if (State)
+	{
+		State->RingBuffer.SetMaxQueuedSamples(GetMaxQueuedSamples());
+	}
+}
+
+int32 UMillicastAudioMixerInput::GetMaxQueuedSamples() const
+{
+	// At least two blocks, or longer pull periods would always be trimmed
+	const int32 LatencyMs = FMath::Max(MaxLatencyMs, 2 * AudioParameters.TimePerFrameMs);
+	return LatencyMs * AudioParameters.SamplesPerSecond / 1000 * AudioParameters.NumberOfChannels;
+}
+
+void UMillicastAudioMixerInput::Initialize()
+{
+	UE_LOG(LogMillicastPlayer, Verbose, TEXT("%S"), __FUNCTION__);
+
+	// Added again after a Shutdown. The render thread may not have dropped the detached state yet, clearing its flag
+	// would mix it twice, so the input starts over with a new one
+	if (State && State->bDetached)
+	{
+		State = MakeShared<Millicast::Player::FAudioMixerInputState, ESPMode::ThreadSafe>(GetMaxQueuedSamples());
+		UpdateChannelGains();
+	}
+
+	if (auto* MixerPtr = Mixer.Get())
+	{
+		MixerPtr->RegisterInput(State);
+	}
+}
+
+void UMillicastAudioMixerInput::Shutdown()
+{
+	UE_LOG(LogMillicastPlayer, Verbose, TEXT("%S"), __FUNCTION__);
+
+	Detach();
+}
+
+void UMillicastAudioMixerInput::QueueAudioData(const uint8* AudioData, int32 NumSamples)
+{
+	State->RingBuffer.Push(reinterpret_cast<const float*>(AudioData), NumSamples * AudioParameters.NumberOfChannels);
+}
+
+void UMillicastAudioMixerInput::Detach()
+{
+	if (State)
+	{
+		State->bDetached = true;
+	}
+}
+
+/** Mixer component */
+
+UMillicastAudioMixerComponent::UMillicastAudioMixerComponent(const FObjectInitializer& ObjectInitializer)
+	: Super(ObjectInitializer)
+{
+	NumChannels = 2;
+
+	if (!HasAnyFlags(RF_ClassDefaultObject))
+	{
+		MixerState = MakeShared<Millicast::Player::FAudioMixerState, ESPMode::ThreadSafe>();
+	}
+}
+
+UMillicastAudioMixerInput* UMillicastAudioMixerComponent::AddTrack(UMillicastAudioTrack* AudioTrack, float Gain, float Pan)
+{
+	UE_LOG(LogMillicastPlayer, Verbose, TEXT("%S"), __FUNCTION__);
+
+	if (!AudioTrack)
+	{
+		UE_LOG(LogMillicastPlayer, Warning, TEXT("Could not add track to the audio mixer. Track was null"));
+		return nullptr;
+	}
+
+	for (auto* Input : Inputs)
+	{
+		if (Input->GetTrack() == AudioTrack)
+		{
+			Input->SetGain(Gain);
+			Input->SetPan(Pan);
+			return Input;
+		}
+	}
+
+	auto* Input = NewObject<UMillicastAudioMixerInput>(this);
+	Input->Setup(this, AudioTrack, MaxLatencyMs);
+	Input->SetGain(Gain);
+	Input->SetPan(Pan);
+	Inputs.Add(Input);
+
+	// Calls Initialize on the input, which registers it to the render thread
+	AudioTrack->AddConsumer(Input);
+
+	return Input;
+}
+
+void UMillicastAudioMixerComponent::RemoveTrack(UMillicastAudioTrack* AudioTrack)
+{
+	UE_LOG(LogMillicastPlayer, Verbose, TEXT("%S"), __FUNCTION__);
+
+	for (int32 i = Inputs.Num() - 1; i >= 0; --i)
+	{
+		auto* Input = Inputs[i];
+		if (Input->GetTrack() != AudioTrack)
+		{
+			continue;
+		}
+
+		if (AudioTrack)
+		{
+			AudioTrack->RemoveConsumer(Input);
+		}
+
+		Input->Detach();
+		Inputs.RemoveAtSwap(i);
+	}
+}
+
+void UMillicastAudioMixerComponent::RegisterInput(const TSharedPtr<Millicast::Player::FAudioMixerInputState, ESPMode::ThreadSafe>& InputState)
+{
+	if (!MixerState || !InputState)
+	{
+		return;
+	}
+
+	MixerState->PendingInputs.Enqueue(InputState);
+
+	if (!IsPlaying())
+	{
+		Start();
+	}
+}
+
+bool UMillicastAudioMixerComponent::Init(int32& SampleRate)
+{
+	SampleRate = FMillicastAudioParameters().SamplesPerSecond;
+	NumChannels = 2;
+
+	return true;
+}
+
+ISoundGeneratorPtr UMillicastAudioMixerComponent::CreateSoundGenerator(const FSoundGeneratorInitParams& InParams)
+{
+	if (InParams.NumChannels != NumChannels)
+	{
+		UE_LOG(LogMillicastPlayer, Warning, TEXT("Audio mixer created with %d channels, expected %d"), InParams.NumChannels, NumChannels);
+	}
+
+	return MakeShared<Millicast::Player::FMillicastMixerSoundGenerator, ESPMode::ThreadSafe>(MixerState);
+}
+
+void UMillicastAudioMixerComponent::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	for (auto* Input : Inputs)
+	{
+		if (auto* AudioTrack = Input->GetTrack())
+		{
+			AudioTrack->RemoveConsumer(Input);
+		}
+
+		Input->Detach();
+	}
+	Inputs.Empty();
+
+	Super::EndPlay(EndPlayReason);
+}
@@ -0,0 +1,46 @@
+// Copyright Millicast 2023. All Rights Reserved.
+
+#include "Audio/MillicastAudioRingBuffer.h"
+
+namespace Millicast::Player
+{
+	FAudioRingBuffer::FAudioRingBuffer(int32 InCapacity, int32 InMaxQueuedSamples)
+		: Buffer(InCapacity)
+		, MaxQueuedSamples(FMath::Min(InMaxQueuedSamples, InCapacity))
+	{
+	}
+
+	void FAudioRingBuffer::Push(const float* Samples, int32 NumSamples)
+	{
+		Buffer.Push(Samples, NumSamples);
+	}
+
+	int32 FAudioRingBuffer::Pop(float* OutSamples, int32 NumSamples)
+	{
+		// Drop what is above the latency budget before rendering, only the consumer may do this
+		const int32 Queued = Buffer.Num();
+		const int32 Excess = Queued - NumSamples - MaxQueuedSamples.Load();
+		if (Excess > 0)
+		{
+			Buffer.Pop(Excess);
+		}
+
+		const int32 Popped = Buffer.Pop(OutSamples, NumSamples);
+		if (Popped < NumSamples)
+		{
+			FMemory::Memzero(OutSamples + Popped, (NumSamples - Popped) * sizeof(float));
+		}
+
+		return Popped;
+	}
+
+	int32 FAudioRingBuffer::Num() const
+	{
+		return Buffer.Num();
+	}
+
+	void FAudioRingBuffer::SetMaxQueuedSamples(int32 InMaxQueuedSamples)
+	{
+		MaxQueuedSamples = InMaxQueuedSamples;
+	}
+}
@@ -0,0 +1,35 @@
+// Copyright Millicast 2023. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "DSP/Dsp.h"
+
+namespace Millicast::Player
+{
+	/**
+	 * Lock free single producer / single consumer queue of interleaved float samples.
+	 * WebRTC pushes decoded audio from its thread and the audio render callback pops it.
+	 * The consumer drops the oldest samples when more than MaxQueuedSamples are waiting, so output latency stays bounded.
+	 */
+	class FAudioRingBuffer
+	{
+	public:
+		FAudioRingBuffer(int32 InCapacity, int32 InMaxQueuedSamples);
+
+		/** Producer side. Samples that do not fit are dropped */
+		void Push(const float* Samples, int32 NumSamples);
+
+		/** Consumer side. Always writes NumSamples, padding with silence on underrun. Returns the number of real samples */
+		int32 Pop(float* OutSamples, int32 NumSamples);
+
+		/** Number of samples currently queued */
+		int32 Num() const;
+
+		void SetMaxQueuedSamples(int32 InMaxQueuedSamples);
+
+	private:
+		Audio::TCircularAudioBuffer<float> Buffer;
+		TAtomic<int32> MaxQueuedSamples;
+	};
+}
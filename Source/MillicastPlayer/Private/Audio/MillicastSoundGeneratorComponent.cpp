@@ -0,0 +1,100 @@
+// Copyright Millicast 2023. All Rights Reserved.
+
+#include "Audio/MillicastSoundGeneratorComponent.h"
+
+#include "Audio/MillicastAudioRingBuffer.h"
+#include "MillicastPlayerPrivate.h"
+
+namespace Millicast::Player
+{
+	// Half a second of stereo audio, MaxLatencyMs is what bounds the actual latency
+	constexpr int32 RingBufferCapacity = 48000;
+
+	/**
+	 * Runs on the audio render thread and pulls whatever WebRTC has decoded since the last callback
+	 */
+	class FMillicastSoundGenerator : public ISoundGenerator
+	{
+	public:
+		explicit FMillicastSoundGenerator(TSharedPtr<FAudioRingBuffer, ESPMode::ThreadSafe> InRingBuffer)
+			: RingBuffer(MoveTemp(InRingBuffer))
+		{
+		}
+
+		int32 OnGenerateAudio(float* OutAudio, int32 NumSamples) override
+		{
+			RingBuffer->Pop(OutAudio, NumSamples);
+			return NumSamples;
+		}
+
+	private:
+		TSharedPtr<FAudioRingBuffer, ESPMode::ThreadSafe> RingBuffer;
+	};
+}
+
+UMillicastSoundGeneratorComponent::UMillicastSoundGeneratorComponent(const FObjectInitializer& ObjectInitializer)
+	: Super(ObjectInitializer)
+{
+	AudioParameters.SetSampleFormat(EMillicastAudioSampleFormat::Float32);
+	NumChannels = AudioParameters.NumberOfChannels;
+
+	if (!HasAnyFlags(RF_ClassDefaultObject))
+	{
+		RingBuffer = MakeShared<Millicast::Player::FAudioRingBuffer, ESPMode::ThreadSafe>(
+			Millicast::Player::RingBufferCapacity, GetMaxQueuedSamples());
+	}
+}
+
+void UMillicastSoundGeneratorComponent::UpdateAudioParameters(FMillicastAudioParameters Parameters) noexcept
+{
+	AudioParameters = MoveTemp(Parameters);
+
+	// The render callback works on interleaved float stereo at the WebRTC sample rate
+	AudioParameters.SetSampleFormat(EMillicastAudioSampleFormat::Float32);
+	AudioParameters.NumberOfChannels = NumChannels;
+}
+
+void UMillicastSoundGeneratorComponent::Initialize()
+{
+	UE_LOG(LogMillicastPlayer, Verbose, TEXT("%S"), __FUNCTION__);
+
+	RingBuffer->SetMaxQueuedSamples(GetMaxQueuedSamples());
+	Start();
+}
+
+void UMillicastSoundGeneratorComponent::Shutdown()
+{
+	UE_LOG(LogMillicastPlayer, Verbose, TEXT("%S"), __FUNCTION__);
+
+	Stop();
+}
+
+void UMillicastSoundGeneratorComponent::QueueAudioData(const uint8* AudioData, int32 NumSamples)
+{
+	RingBuffer->Push(reinterpret_cast<const float*>(AudioData), NumSamples * AudioParameters.NumberOfChannels);
+}
+
+bool UMillicastSoundGeneratorComponent::Init(int32& SampleRate)
+{
+	SampleRate = AudioParameters.SamplesPerSecond;
+	NumChannels = AudioParameters.NumberOfChannels;
+
+	return true;
+}
+
+ISoundGeneratorPtr UMillicastSoundGeneratorComponent::CreateSoundGenerator(const FSoundGeneratorInitParams& InParams)
+{
+	if (InParams.NumChannels != AudioParameters.NumberOfChannels)
+	{
+		UE_LOG(LogMillicastPlayer, Warning, TEXT("Sound generator created with %d channels, expected %d"), InParams.NumChannels, AudioParameters.NumberOfChannels);
+	}
+
+	return MakeShared<Millicast::Player::FMillicastSoundGenerator, ESPMode::ThreadSafe>(RingBuffer);
+}
+
+int32 UMillicastSoundGeneratorComponent::GetMaxQueuedSamples() const
+{
+	// At least two blocks, or longer pull periods would always be trimmed
+	const int32 LatencyMs = FMath::Max(MaxLatencyMs, 2 * AudioParameters.TimePerFrameMs);
+	return LatencyMs * AudioParameters.SamplesPerSecond / 1000 * AudioParameters.NumberOfChannels;
+}
@@ -10,10 +10,73 @@
 #include "Serialization/JsonSerializer.h"
 #include "Serialization/JsonWriter.h"
 
+#include "Misc/Base64.h"
+
+#include "MillicastUtil.h"
 #include "Util.h"
 
 #include "MillicastPlayerPrivate.h"
 
+namespace
+{
+	// Used when the token has no readable expiration
+	constexpr double DefaultSignalingDataLifetimeSeconds = 60.0;
+
+	// Do not hand out a token that could expire while the WebSocket is connecting
+	constexpr double SignalingDataExpirationMarginSeconds = 5.0;
+
+	struct FCachedSignalingData
+	{
+		FMillicastSignalingData SignalingData;
+		FDateTime ExpirationTime;
+	};
+
+	// Director responses per media source, shared by all the director components. Only accessed from the game thread
+	TMap<FString, FCachedSignalingData> SignalingDataCache;
+
+	/** Read the exp claim of the JWT payload */
+	bool GetJwtExpirationTime(const FString& Jwt, FDateTime& OutExpirationTime)
+	{
+		TArray<FString> Parts;
+		if (Jwt.ParseIntoArray(Parts, TEXT(".")) < 2)
+		{
+			return false;
+		}
+
+		// The payload is base64url encoded without padding
+		FString Payload = Parts[1].Replace(TEXT("-"), TEXT("+")).Replace(TEXT("_"), TEXT("/"));
+		while (Payload.Len() % 4 != 0)
+		{
+			Payload.AppendChar(TEXT('='));
+		}
+
+		TArray<uint8> PayloadBytes;
+		if (!FBase64::Decode(Payload, PayloadBytes))
+		{
+			return false;
+		}
+
+		PayloadBytes.Add(0);
+		const FString PayloadString = UTF8_TO_TCHAR(reinterpret_cast<const ANSICHAR*>(PayloadBytes.GetData()));
+
+		TSharedPtr<FJsonObject> PayloadJson;
+		auto JsonReader = TJsonReaderFactory<>::Create(PayloadString);
+		if (!FJsonSerializer::Deserialize(JsonReader, PayloadJson))
+		{
+			return false;
+		}
+
+		double Expiration = 0.0;
+		if (!PayloadJson->TryGetNumberField(TEXT("exp"), Expiration))
+		{
+			return false;
+		}
+
+		OutExpirationTime = FDateTime::FromUnixTimestamp(static_cast<int64>(Expiration));
+		return true;
+	}
+}
+
 UMillicastDirectorComponent::UMillicastDirectorComponent(const FObjectInitializer& Initializer)
 	: Super(Initializer)
 {
@@ -151,6 +214,15 @@ void UMillicastDirectorComponent::ParseDirectorResponse(FHttpResponsePtr Respons
 
 		ParseIceServers(IceServersField, SignalingData);
 
+		FCachedSignalingData CachedData;
+		CachedData.SignalingData = SignalingData;
+		if (!GetJwtExpirationTime(SignalingData.Jwt, CachedData.ExpirationTime))
+		{
+			UE_LOG(LogMillicastPlayer, Verbose, TEXT("Could not read the token expiration, caching the signaling data for %.0f seconds"), DefaultSignalingDataLifetimeSeconds);
+			CachedData.ExpirationTime = FDateTime::UtcNow() + FTimespan::FromSeconds(DefaultSignalingDataLifetimeSeconds);
+		}
+		SignalingDataCache.Emplace(GetCacheKey(), MoveTemp(CachedData));
+
 		OnAuthenticated.Broadcast(this, SignalingData);
 	}
 }
@@ -174,6 +246,67 @@ void UMillicastDirectorComponent::RetryAuthenticateWithDelay()
 	OnAuthenticationRetry.Broadcast(TimeUntilNextRetryInSeconds);
 }
 
+FString UMillicastDirectorComponent::GetCacheKey() const
+{
+	// The token is part of the key, a different subscribe token gives a different JWT
+	return FString::Printf(TEXT("%s|%s|%s|%s"), *MillicastMediaSource->GetUrl(), *MillicastMediaSource->AccountId,
+		*MillicastMediaSource->StreamName, *MillicastMediaSource->SubscribeToken);
+}
+
+bool UMillicastDirectorComponent::TryAuthenticateFromCache()
+{
+	if (!IsValid(MillicastMediaSource))
+	{
+		return false;
+	}
+
+	const FString CacheKey = GetCacheKey();
+	const auto* CachedData = SignalingDataCache.Find(CacheKey);
+	if (!CachedData)
+	{
+		return false;
+	}
+
+	if (CachedData->ExpirationTime - FTimespan::FromSeconds(SignalingDataExpirationMarginSeconds) <= FDateTime::UtcNow())
+	{
+		UE_LOG(LogMillicastPlayer, Log, TEXT("Cached signaling data expired"));
+		SignalingDataCache.Remove(CacheKey);
+		return false;
+	}
+
+	UE_LOG(LogMillicastPlayer, Log, TEXT("Authenticating with cached signaling data, valid for %.0f more seconds"),
+		(CachedData->ExpirationTime - FDateTime::UtcNow()).GetTotalSeconds());
+
+	// A pending retry would call the director anyway
+	ChangeTimeUntilNextRetryInSeconds(0.0f);
+
+	LastRequestStartCycles = 0;
+	LastRequestEndCycles = 0;
+
+	// Broadcast on the next tick, the caller may be in the middle of tearing down its previous connection
+	const FMillicastSignalingData SignalingData = CachedData->SignalingData;
+	TWeakObjectPtr<UMillicastDirectorComponent> WeakThis(this);
+
+#if MILLICAST_HAS_CXX20
+	AsyncGameThreadTaskWithCapture(WeakThis, [=, this]()
+#else
+	AsyncGameThreadTaskWithCapture(WeakThis, [=]()
+#endif
+	{
+		OnAuthenticated.Broadcast(this, SignalingData);
+	});
+
+	return true;
+}
+
+void UMillicastDirectorComponent::InvalidateCachedSignalingData()
+{
+	if (IsValid(MillicastMediaSource))
+	{
+		SignalingDataCache.Remove(GetCacheKey());
+	}
+}
+
 /**
 	Begin receiving audio, video.
 */
@@ -222,6 +355,8 @@ bool UMillicastDirectorComponent::Authenticate()
 #endif
 	{
 		check(IsInGameThread());
+
+		LastRequestEndCycles = FPlatformTime::Cycles64();
 		
 		if(!Response)
 		{
@@ -237,6 +372,8 @@ bool UMillicastDirectorComponent::Authenticate()
 			// Authentication failure, do not retry
 			if(Response->GetResponseCode() == 401)
 			{
+				InvalidateCachedSignalingData();
+
 				const FString& ErrorMsg = Response->GetContentAsString();
 				OnAuthenticationFailure.Broadcast(Response->GetResponseCode(), ErrorMsg);
 				return;
@@ -250,6 +387,15 @@ bool UMillicastDirectorComponent::Authenticate()
 		ParseDirectorResponse(Response);
 	});
 
-	return PostHttpRequest->ProcessRequest();
+	LastRequestStartCycles = FPlatformTime::Cycles64();
+	LastRequestEndCycles = 0;
+
+	if (!PostHttpRequest->ProcessRequest())
+	{
+		return false;
+	}
+
+	OnRequestStarted.Broadcast(this);
+	return true;
 }
 
@@ -0,0 +1,317 @@
+// Copyright Millicast 2023. All Rights Reserved.
+
+#include "Components/MillicastLayerControllerComponent.h"
+
+#include "Components/PrimitiveComponent.h"
+#include "Engine/World.h"
+#include "GameFramework/PlayerController.h"
+#include "Misc/App.h"
+
+#include "MillicastLayerSelection.h"
+#include "MillicastPlayerPrivate.h"
+
+namespace
+{
+	constexpr float UpdateIntervalSeconds = 0.25f;
+
+	// Weight of the last frame time, about one second of frames with the update interval
+	constexpr float FrameTimeSmoothing = 0.25f;
+
+	// A component not rendered for this long is considered off screen
+	constexpr float RecentlyRenderedSeconds = 0.2f;
+}
+
+UMillicastLayerControllerComponent::UMillicastLayerControllerComponent(const FObjectInitializer& ObjectInitializer)
+	: Super(ObjectInitializer)
+{
+	PrimaryComponentTick.bCanEverTick = true;
+	PrimaryComponentTick.TickInterval = UpdateIntervalSeconds;
+}
+
+void UMillicastLayerControllerComponent::SetSubscriber(UMillicastSubscriberComponent* InSubscriber)
+{
+	if (InSubscriber == Subscriber)
+	{
+		return;
+	}
+
+	ReleaseLayer();
+
+	Subscriber = InSubscriber;
+	CoveringLayerIndex = INDEX_NONE;
+	StepsDown = 0;
+	DecodeTimePerFrameMs = 0.f;
+	LastVideoDecodeTimeSampleTime = 0.0;
+}
+
+void UMillicastLayerControllerComponent::SetBudgets(float InFrameTimeBudgetMs, float InDecodeTimeBudgetMs)
+{
+	FrameTimeBudgetMs = FMath::Max(InFrameTimeBudgetMs, 0.f);
+	DecodeTimeBudgetMs = FMath::Max(InDecodeTimeBudgetMs, 0.f);
+}
+
+void UMillicastLayerControllerComponent::SetControlEnabled(bool bEnabled)
+{
+	bControlEnabled = bEnabled;
+
+	if (!bControlEnabled)
+	{
+		ReleaseLayer();
+	}
+}
+
+void UMillicastLayerControllerComponent::BeginPlay()
+{
+	Super::BeginPlay();
+
+	if (!Subscriber && GetOwner())
+	{
+		Subscriber = GetOwner()->FindComponentByClass<UMillicastSubscriberComponent>();
+	}
+}
+
+void UMillicastLayerControllerComponent::TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction)
+{
+	using namespace Millicast::Player;
+
+	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
+
+	if (!Subscriber)
+	{
+		return;
+	}
+
+	ProjectedSize = ComputeProjectedSize();
+	Subscriber->SetScreenSizeHint(static_cast<float>(ProjectedSize.X) * ProjectedSize.Y);
+
+	// The subscription manager selects the layer in the other tiers. The override is cleared from the subscriber too, so
+	// going back to Full gives the choice back to the server rather than to the last layer selected here
+	const auto* Layers = Subscriber->GetMainVideoLayers();
+	if (!bControlEnabled || !Layers || Subscriber->GetSubscriptionTier() != EMillicastSubscriptionTier::Full)
+	{
+		ReleaseLayer();
+		return;
+	}
+
+	auto SpatialLayers = GetSpatialLayers(*Layers);
+	if (SpatialLayers.Num() == 0)
+	{
+		return;
+	}
+
+	// Steps are taken between the layers the subscriber can receive, the cheapest one always remains
+	const int32 MaxBitrate = Subscriber->GetEffectiveMaxReceiveBitrate() * 1000;
+	for (int32 i = SpatialLayers.Num() - 1; i > 0 && MaxBitrate > 0; --i)
+	{
+		if (SpatialLayers[i].Bitrate > MaxBitrate)
+		{
+			SpatialLayers.RemoveAt(i);
+		}
+	}
+
+	UpdateDecodeTime();
+	UpdateStepsDown(DeltaTime);
+	UpdateCoveringLayer(SpatialLayers, DeltaTime);
+
+	StepsDown = FMath::Min(StepsDown, CoveringLayerIndex);
+	SelectLayer(SpatialLayers[CoveringLayerIndex - StepsDown]);
+}
+
+FIntPoint UMillicastLayerControllerComponent::ComputeProjectedSize() const
+{
+	if (!DisplayComponent || !DisplayComponent->IsVisible() || !DisplayComponent->WasRecentlyRendered(RecentlyRenderedSeconds))
+	{
+		return FIntPoint::ZeroValue;
+	}
+
+	auto* PlayerController = GetWorld() ? GetWorld()->GetFirstPlayerController() : nullptr;
+	if (!PlayerController)
+	{
+		return FIntPoint::ZeroValue;
+	}
+
+	int32 ViewportWidth = 0;
+	int32 ViewportHeight = 0;
+	PlayerController->GetViewportSize(ViewportWidth, ViewportHeight);
+
+	const FVector2D ViewportSize(ViewportWidth, ViewportHeight);
+
+	// The bounds are axis aligned, which overestimates the size of a rotated display: it errs on the side of sharpness
+	FVector Vertices[8];
+	DisplayComponent->Bounds.GetBox().GetVertices(Vertices);
+
+	FVector2D Min(ViewportSize);
+	FVector2D Max(FVector2D::ZeroVector);
+
+	for (const auto& Vertex : Vertices)
+	{
+		FVector2D ScreenLocation;
+		if (!PlayerController->ProjectWorldLocationToScreen(Vertex, ScreenLocation))
+		{
+			// Behind the camera, the display is so close that it spans the viewport
+			Min = FVector2D::ZeroVector;
+			Max = ViewportSize;
+			break;
+		}
+
+		Min = FVector2D::Min(Min, ScreenLocation);
+		Max = FVector2D::Max(Max, ScreenLocation);
+	}
+
+	Min = FVector2D::Max(Min, FVector2D::ZeroVector);
+	Max = FVector2D::Min(Max, ViewportSize);
+
+	const FVector2D Size = FVector2D::Max(Max - Min, FVector2D::ZeroVector);
+	return FIntPoint(FMath::CeilToInt(Size.X), FMath::CeilToInt(Size.Y));
+}
+
+void UMillicastLayerControllerComponent::UpdateDecodeTime()
+{
+	// Only refreshed by the stats collector with UE 5.1 and above, the decode time budget does nothing otherwise
+	const auto Stats = Subscriber->GetStats();
+	if (Stats.VideoDecodeTime == LastVideoDecodeTime)
+	{
+		return;
+	}
+
+	const double Now = FPlatformTime::Seconds();
+	const double Elapsed = Now - LastVideoDecodeTimeSampleTime;
+	const float DecodedFrames = Stats.FramesPerSecond * Elapsed;
+
+	if (LastVideoDecodeTimeSampleTime > 0.0 && DecodedFrames > 0.f && Stats.VideoDecodeTime > LastVideoDecodeTime)
+	{
+		DecodeTimePerFrameMs = (Stats.VideoDecodeTime - LastVideoDecodeTime) * 1000.f / DecodedFrames;
+	}
+
+	LastVideoDecodeTime = Stats.VideoDecodeTime;
+	LastVideoDecodeTimeSampleTime = Now;
+}
+
+TOptional<bool> UMillicastLayerControllerComponent::IsOverBudget()
+{
+	const float FrameTimeMs = FApp::GetDeltaTime() * 1000.f;
+	SmoothedFrameTimeMs = SmoothedFrameTimeMs > 0.f ? FMath::Lerp(SmoothedFrameTimeMs, FrameTimeMs, FrameTimeSmoothing) : FrameTimeMs;
+
+	bool bOverBudget = false;
+	bool bUnderBudget = true;
+
+	auto Check = [&](float TimeMs, float BudgetMs)
+	{
+		if (BudgetMs > 0.f)
+		{
+			bOverBudget |= TimeMs > BudgetMs;
+			bUnderBudget &= TimeMs < BudgetMs * StepUpRatio;
+		}
+	};
+
+	Check(SmoothedFrameTimeMs, FrameTimeBudgetMs);
+	Check(DecodeTimePerFrameMs, DecodeTimeBudgetMs);
+
+	if (bOverBudget)
+	{
+		return true;
+	}
+
+	if (bUnderBudget)
+	{
+		return false;
+	}
+
+	// Between the step up threshold and the budget, stay on the current layer
+	return {};
+}
+
+void UMillicastLayerControllerComponent::UpdateStepsDown(float DeltaTime)
+{
+	const TOptional<bool> bOverBudget = IsOverBudget();
+
+	OverBudgetTime = bOverBudget.Get(false) ? OverBudgetTime + DeltaTime : 0.f;
+	UnderBudgetTime = !bOverBudget.Get(true) ? UnderBudgetTime + DeltaTime : 0.f;
+
+	if (OverBudgetTime >= StepDownDelaySeconds)
+	{
+		++StepsDown;
+		OverBudgetTime = 0.f;
+
+		UE_LOG(LogMillicastPlayer, Log, TEXT("Over budget: frame time %.1f ms, decode time %.1f ms. Stepping down"), SmoothedFrameTimeMs, DecodeTimePerFrameMs);
+	}
+	else if (UnderBudgetTime >= StepUpDelaySeconds && StepsDown > 0)
+	{
+		--StepsDown;
+		UnderBudgetTime = 0.f;
+	}
+}
+
+void UMillicastLayerControllerComponent::UpdateCoveringLayer(const TArray<FMillicastLayerData>& SpatialLayers, float DeltaTime)
+{
+	// The largest layer when none covers the projected size or when the resolutions are unknown, the smallest one when off screen
+	const FIntPoint RequiredSize(FMath::CeilToInt(ProjectedSize.X * ScreenSizeScale), FMath::CeilToInt(ProjectedSize.Y * ScreenSizeScale));
+
+	int32 Index = SpatialLayers.Num() - 1;
+	if (ProjectedSize == FIntPoint::ZeroValue)
+	{
+		Index = 0;
+	}
+	else
+	{
+		for (int32 i = 0; i < SpatialLayers.Num(); ++i)
+		{
+			if (SpatialLayers[i].Width >= RequiredSize.X && SpatialLayers[i].Height >= RequiredSize.Y)
+			{
+				Index = i;
+				break;
+			}
+		}
+	}
+
+	// The layers may have changed since the last update
+	if (!SpatialLayers.IsValidIndex(CoveringLayerIndex))
+	{
+		CoveringLayerIndex = Index;
+	}
+
+	if (Index == CoveringLayerIndex)
+	{
+		PendingCoveringLayerIndex = INDEX_NONE;
+		return;
+	}
+
+	if (Index != PendingCoveringLayerIndex)
+	{
+		PendingCoveringLayerIndex = Index;
+		PendingCoveringLayerTime = 0.f;
+	}
+
+	PendingCoveringLayerTime += DeltaTime;
+	if (PendingCoveringLayerTime >= ScreenSizeDelaySeconds)
+	{
+		CoveringLayerIndex = Index;
+		PendingCoveringLayerIndex = INDEX_NONE;
+	}
+}
+
+void UMillicastLayerControllerComponent::SelectLayer(const FMillicastLayerData& Layer)
+{
+	if (SelectedLayer.IsSet() && Millicast::Player::IsSameLayer(SelectedLayer.GetValue(), Layer))
+	{
+		return;
+	}
+
+	UE_LOG(LogMillicastPlayer, Log, TEXT("Selecting layer %s/%d/%d (%dx%d) for %dx%d on screen, %d steps down"),
+		*Layer.EncodingId, Layer.SpatialLayerId, Layer.TemporalLayerId, Layer.Width, Layer.Height, ProjectedSize.X, ProjectedSize.Y, StepsDown);
+
+	SelectedLayer = Layer;
+	Subscriber->Select(Layer);
+
+	OnLayerChanged.Broadcast(Layer);
+}
+
+void UMillicastLayerControllerComponent::ReleaseLayer()
+{
+	if (SelectedLayer.IsSet() && Subscriber)
+	{
+		Subscriber->AutoSelect();
+	}
+
+	SelectedLayer.Reset();
+}
@@ -0,0 +1,131 @@
+// Copyright Millicast 2023. All Rights Reserved.
+
+#include "MillicastLayerSelection.h"
+
+namespace Millicast::Player
+{
+
+bool IsCheaperLayer(const FMillicastLayerData& A, const FMillicastLayerData& B)
+{
+	if (GetLayerPixels(A) != GetLayerPixels(B))
+	{
+		return GetLayerPixels(A) < GetLayerPixels(B);
+	}
+
+	if (A.Bitrate != B.Bitrate)
+	{
+		return A.Bitrate < B.Bitrate;
+	}
+
+	if (A.SpatialLayerId != B.SpatialLayerId)
+	{
+		return A.SpatialLayerId < B.SpatialLayerId;
+	}
+
+	return A.TemporalLayerId < B.TemporalLayerId;
+}
+
+const FMillicastLayerData* FindLowestLayer(const TArray<FMillicastLayerData>& Layers, bool bLowestFrameRate)
+{
+	const FMillicastLayerData* Lowest = nullptr;
+	for (const auto& Layer : Layers)
+	{
+		if (!Lowest || IsCheaperLayer(Layer, *Lowest))
+		{
+			Lowest = &Layer;
+		}
+	}
+
+	if (!Lowest || bLowestFrameRate)
+	{
+		return Lowest;
+	}
+
+	// Temporal layers share the resolution of their spatial layer, keep the full frame rate of the cheapest one
+	const FMillicastLayerData* Result = Lowest;
+	for (const auto& Layer : Layers)
+	{
+		if (Layer.EncodingId == Lowest->EncodingId && Layer.SpatialLayerId == Lowest->SpatialLayerId && Layer.TemporalLayerId > Result->TemporalLayerId)
+		{
+			Result = &Layer;
+		}
+	}
+
+	return Result;
+}
+
+const FMillicastLayerData* FindHighestLayer(const TArray<FMillicastLayerData>& Layers)
+{
+	const FMillicastLayerData* Highest = nullptr;
+	for (const auto& Layer : Layers)
+	{
+		if (!Highest || IsCheaperLayer(*Highest, Layer))
+		{
+			Highest = &Layer;
+		}
+	}
+
+	return Highest;
+}
+
+TOptional<FMillicastLayerData> FitLayerToBitrate(const TArray<FMillicastLayerData>& Layers, const TOptional<FMillicastLayerData>& Requested, int32 MaxBitrate)
+{
+	auto Fits = [MaxBitrate](const FMillicastLayerData& Layer) { return Layer.Bitrate <= MaxBitrate; };
+
+	if (Requested.IsSet())
+	{
+		// The requested layer may come from an older layers event, with another bitrate
+		const auto* Current = Layers.FindByPredicate([&Requested](const FMillicastLayerData& Layer) { return IsSameLayer(Layer, Requested.GetValue()); });
+		if (Fits(Current ? *Current : Requested.GetValue()))
+		{
+			return Requested;
+		}
+	}
+	else if (Layers.FindByPredicate([&Fits](const FMillicastLayerData& Layer) { return !Fits(Layer); }) == nullptr)
+	{
+		return {};
+	}
+
+	const FMillicastLayerData* Result = nullptr;
+	for (const auto& Layer : Layers)
+	{
+		const bool bBelowRequested = !Requested.IsSet() || !IsCheaperLayer(Requested.GetValue(), Layer);
+		if (Layer.Bitrate > 0 && Fits(Layer) && bBelowRequested && (!Result || IsCheaperLayer(*Result, Layer)))
+		{
+			Result = &Layer;
+		}
+	}
+
+	if (!Result)
+	{
+		Result = FindLowestLayer(Layers, true);
+	}
+
+	return Result ? *Result : TOptional<FMillicastLayerData>();
+}
+
+TArray<FMillicastLayerData> GetSpatialLayers(const TArray<FMillicastLayerData>& Layers)
+{
+	TArray<FMillicastLayerData> Result;
+	for (const auto& Layer : Layers)
+	{
+		auto* Existing = Result.FindByPredicate([&Layer](const FMillicastLayerData& Other)
+		{
+			return Other.EncodingId == Layer.EncodingId && Other.SpatialLayerId == Layer.SpatialLayerId;
+		});
+
+		if (!Existing)
+		{
+			Result.Add(Layer);
+		}
+		else if (Layer.TemporalLayerId > Existing->TemporalLayerId)
+		{
+			*Existing = Layer;
+		}
+	}
+
+	Result.Sort(&IsCheaperLayer);
+	return Result;
+}
+
+}
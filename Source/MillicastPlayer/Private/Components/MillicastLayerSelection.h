@@ -0,0 +1,41 @@
+// Copyright Millicast 2023. All Rights Reserved.
+
+#pragma once
+
+#include "Components/MillicastSubscriberComponent.h"
+
+namespace Millicast::Player
+{
+	/** Decoded pixels per frame of the layer, 0 when the server does not report its resolution */
+	inline int64 GetLayerPixels(const FMillicastLayerData& Layer)
+	{
+		return static_cast<int64>(Layer.Width) * Layer.Height;
+	}
+
+	inline bool IsSameLayer(const FMillicastLayerData& A, const FMillicastLayerData& B)
+	{
+		return A.EncodingId == B.EncodingId && A.SpatialLayerId == B.SpatialLayerId && A.TemporalLayerId == B.TemporalLayerId;
+	}
+
+	/**
+	 * Order layers from the cheapest to decode to the most expensive: resolution, then bitrate, then layer ids.
+	 * Returns true if A is cheaper than B
+	 */
+	bool IsCheaperLayer(const FMillicastLayerData& A, const FMillicastLayerData& B);
+
+	/** Cheapest spatial layer. With bLowestFrameRate its lowest temporal layer, otherwise its highest one */
+	const FMillicastLayerData* FindLowestLayer(const TArray<FMillicastLayerData>& Layers, bool bLowestFrameRate);
+
+	/** Most expensive layer */
+	const FMillicastLayerData* FindHighestLayer(const TArray<FMillicastLayerData>& Layers);
+
+	/**
+	 * Layer to select to receive at most MaxBitrate bps: the requested one if it fits, otherwise the most expensive layer
+	 * under it that fits, or the cheapest layer if none does. Layers that do not report their bitrate are assumed to fit.
+	 * Unset when nothing is requested and the server choice fits whatever it is
+	 */
+	TOptional<FMillicastLayerData> FitLayerToBitrate(const TArray<FMillicastLayerData>& Layers, const TOptional<FMillicastLayerData>& Requested, int32 MaxBitrate);
+
+	/** One layer per spatial layer, at its highest temporal layer, from the cheapest to the most expensive */
+	TArray<FMillicastLayerData> GetSpatialLayers(const TArray<FMillicastLayerData>& Layers);
+}
@@ -14,10 +14,14 @@
 #include "Engine/GameInstance.h"
 #include "Engine/World.h"
 #include "Runtime/Launch/Resources/Version.h"
-#include "Serialization/JsonReader.h"
 #include "Serialization/JsonSerializer.h"
 #include "Serialization/JsonWriter.h"
+#include "Signaling/MillicastSignalingMessages.h"
+#include "Signaling/MillicastSignalingTransactions.h"
 #include "Subsystems/MillicastAudioSubsystem.h"
+#include "Subsystems/MillicastConnectionPoolSubsystem.h"
+#include "Subsystems/MillicastSubscriptionManagerSubsystem.h"
+#include "MillicastLayerSelection.h"
 #include "WebRTC/PeerConnection.h"
 #include "WebRTC/PlayerStatsData.h"
 #include "WebRTC/MillicastMediaTracks.h"
@@ -25,24 +29,64 @@
 
 #include "WebRTC/PlayerStatsCollector.h"
 
+namespace
+{
+	// Ultra low latency preset
+	constexpr double UltraLowLatencyMaximumDelayMs = 50.0;
+	constexpr int UltraLowLatencyAudioJitterBufferMaxPackets = 10;
+
+	// A migration that has not switched over by then is aborted, the current connection is kept
+	constexpr double MigrationTimeoutSeconds = 15.0;
+
+	// Whether the connection is still the one an asynchronous step was started for, a new one may reuse the address of a closed one
+	bool IsSamePeerConnection(const Millicast::Player::FWebRTCPeerConnection* PeerConnection, uint64 Id)
+	{
+		return PeerConnection && PeerConnection->GetId() == Id;
+	}
+}
+
 UMillicastSubscriberComponent::UMillicastSubscriberComponent(const FObjectInitializer& ObjectInitializer)
 	: Super(ObjectInitializer)
 {
 	PeerConnectionConfig = Millicast::Player::FWebRTCPeerConnection::GetDefaultConfig();
+	ConnectionTimer = MakeShared<FMillicastConnectionTimer, ESPMode::ThreadSafe>();
+	SignalingTransactions = MakeShared<Millicast::Player::FSignalingTransactions>();
+
+	// Only ticks while commands wait for their answer, to time them out
+	PrimaryComponentTick.bCanEverTick = true;
+	PrimaryComponentTick.bStartWithTickEnabled = false;
+
+	// Messages received from the websocket signaling, parsed on a background task and handled on the game thread
+	TWeakObjectPtr<UMillicastSubscriberComponent> WeakThis(this);
+	SignalingQueue = MakeShared<Millicast::Player::FSignalingMessageQueue, ESPMode::ThreadSafe>([WeakThis](const Millicast::Player::FSignalingMessage& Message)
+	{
+		if (auto* This = WeakThis.Get())
+		{
+			Visit([This](const auto& TypedMessage) { This->HandleSignalingMessage(TypedMessage); }, Message);
+		}
+	});
+
+	// Until the switch only the answer and the errors of the new server matter, it reports the same events as the current one
+	MigrationSignalingQueue = MakeShared<Millicast::Player::FSignalingMessageQueue, ESPMode::ThreadSafe>([WeakThis](const Millicast::Player::FSignalingMessage& Message)
+	{
+		using namespace Millicast::Player;
 
-	// Json Message received from websocket
-	MessageParser.Emplace("response", [this](TSharedPtr<FJsonObject> Msg) { ParseResponse(Msg); });
-	MessageParser.Emplace("event", [this](TSharedPtr<FJsonObject> Msg) { ParseEvent(Msg); });
-	MessageParser.Emplace("error", [this](TSharedPtr<FJsonObject> Msg) { ParseError(Msg); });
+		auto* This = WeakThis.Get();
+		if (!This)
+		{
+			return;
+		}
 
-	// Event received from websocket signaling
-	EventBroadcaster.Emplace("active", [this](TSharedPtr<FJsonObject> Msg) { ParseActiveEvent(Msg); });
-	EventBroadcaster.Emplace("inactive", [this](TSharedPtr<FJsonObject> Msg) { ParseInactiveEvent(Msg); });
-	EventBroadcaster.Emplace("stopped", [this](TSharedPtr<FJsonObject> Msg) { ParseStoppedEvent(Msg); });
-	EventBroadcaster.Emplace("vad", [this](TSharedPtr<FJsonObject> Msg) { ParseVadEvent(Msg); });
-	EventBroadcaster.Emplace("layers", [this](TSharedPtr<FJsonObject> Msg) { ParseLayersEvent(Msg); });
-	EventBroadcaster.Emplace("viewercount", [this](TSharedPtr<FJsonObject> Msg) { ParseViewerCountEvent(Msg); });
-	EventBroadcaster.Emplace("migrate", [this](TSharedPtr<FJsonObject> Msg) { ParseMigrateEvent(Msg); });
+		if (const auto* Error = Message.TryGet<FSignalingError>())
+		{
+			This->HandleSignalingMessage(*Error);
+			This->AbortMigration(TEXT("Error from the new server"));
+		}
+		else if (const auto* Response = Message.TryGet<FSignalingResponse>())
+		{
+			This->HandleSignalingMessage(*Response);
+		}
+	});
 }
 
 void UMillicastSubscriberComponent::BeginPlay()
@@ -50,6 +94,23 @@ void UMillicastSubscriberComponent::BeginPlay()
 	Super::BeginPlay();
 
 	UE_LOG(LogMillicastPlayer, Verbose, TEXT("%S"), __FUNCTION__);
+
+	// Have a connection ready by the time Subscribe is called
+	if (bUseConnectionPool)
+	{
+		if (auto* Pool = GetWorld()->GetGameInstance()->GetSubsystem<UMillicastConnectionPoolSubsystem>())
+		{
+			Pool->Prewarm(FMath::Max(Pool->GetPoolSize(), 1));
+		}
+	}
+
+	if (auto* GameInstance = GetWorld()->GetGameInstance())
+	{
+		if (auto* Manager = GameInstance->GetSubsystem<UMillicastSubscriptionManagerSubsystem>())
+		{
+			Manager->Register(this);
+		}
+	}
 }
 
 void UMillicastSubscriberComponent::EndPlay(EEndPlayReason::Type Reason)
@@ -58,6 +119,32 @@ void UMillicastSubscriberComponent::EndPlay(EEndPlayReason::Type Reason)
 
 	UE_LOG(LogMillicastPlayer, Verbose, TEXT("%S"), __FUNCTION__);
 	Unsubscribe();
+
+	if (auto* GameInstance = GetWorld()->GetGameInstance())
+	{
+		if (auto* Manager = GameInstance->GetSubsystem<UMillicastSubscriptionManagerSubsystem>())
+		{
+			Manager->Unregister(this);
+		}
+	}
+}
+
+void UMillicastSubscriberComponent::TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction)
+{
+	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
+
+	SignalingTransactions->Expire(CommandTimeoutSeconds);
+
+	// The director may never answer, or nothing may call Subscribe with its answer
+	if (bMigrating && FPlatformTime::Seconds() - MigrationStartTime > MigrationTimeoutSeconds)
+	{
+		AbortMigration(TEXT("Migration timed out"));
+	}
+
+	if (!SignalingTransactions->HasPending() && !bMigrating)
+	{
+		SetComponentTickEnabled(false);
+	}
 }
 
 /**
@@ -87,6 +174,11 @@ void UMillicastSubscriberComponent::RegisterVideoConsumer(TScriptInterface<IMill
 	VideoConsumers.AddUnique(Consumer);
 }
 
+void UMillicastSubscriberComponent::RegisterAudioConsumer(TScriptInterface<IMillicastExternalAudioConsumer> Consumer)
+{
+	AudioConsumers.AddUnique(Consumer);
+}
+
 void UMillicastSubscriberComponent::SetMediaSource(UMillicastMediaSource* InMediaSource)
 {
 	UE_LOG(LogMillicastPlayer, VeryVerbose, TEXT("%S"), __FUNCTION__);
@@ -107,6 +199,12 @@ void UMillicastSubscriberComponent::SetMediaSource(UMillicastMediaSource* InMedi
 bool UMillicastSubscriberComponent::Subscribe(UMillicastDirectorComponent* DirectorComponent, const FMillicastSignalingData& InSignalingData)
 {
 	UE_LOG(LogMillicastPlayer, Verbose, TEXT("%S"), __FUNCTION__);
+
+	// Signaling data requested by the migrate event, subscribe to the new server next to the current one
+	if (bMigrating && IsConnectionActive())
+	{
+		return StartMigration(InSignalingData);
+	}
 	
 	if (IsConnectionActive())
 	{
@@ -120,15 +218,74 @@ bool UMillicastSubscriberComponent::Subscribe(UMillicastDirectorComponent* Direc
 		return false;
 	}
 
-	CachedDirectorComponent = DirectorComponent;
+	SetDirectorComponent(DirectorComponent);
 	State = EMillicastSubscriberState::Connecting;
 	bShouldReconnect = true;
 
+	// The servers of the previous subscription may no longer be valid
+	PeerConnectionConfig.servers.clear();
 	for (auto& s : InSignalingData.IceServers)
 	{
 		UE_LOG(LogMillicastPlayer, Verbose, TEXT("Adding ice server %s"), *InSignalingData.WsUrl);
 		PeerConnectionConfig.servers.push_back(s);
 	}
+	UpdateLatencyConfig();
+
+	// The connections the pool creates from now on gather with these servers, and are taken without an ice restart
+	if (bUseConnectionPool)
+	{
+		if (auto* Pool = GetWorld()->GetGameInstance()->GetSubsystem<UMillicastConnectionPoolSubsystem>())
+		{
+			Pool->SetIceServers(InSignalingData.IceServers);
+		}
+	}
+
+	bWebSocketConnected = false;
+	bViewSent = false;
+	SubscribeStartTime = FPlatformTime::Seconds();
+
+	// The offer does not depend on the director response, it is created while the WebSocket connects if PrepareConnection was not called yet
+	PrepareConnection();
+
+	if (!PeerConnection)
+	{
+		State = EMillicastSubscriberState::Disconnected;
+		bShouldReconnect = false;
+		return false;
+	}
+
+	if (IsValid(DirectorComponent))
+	{
+		ConnectionTimer->MarkAt(EMillicastConnectionStage::DirectorRequestStart, DirectorComponent->GetLastRequestStartCycles());
+		ConnectionTimer->MarkAt(EMillicastConnectionStage::DirectorRequestEnd, DirectorComponent->GetLastRequestEndCycles());
+	}
+	ConnectionTimer->Mark(EMillicastConnectionStage::Subscribe);
+
+	{
+		FScopeLock Lock(&CriticalPcSection);
+		if (PeerConnection)
+		{
+			// A pooled or prepared connection gathers with the servers it was created with, new servers only apply to the
+			// next gathering session
+			const bool bIceServersChanged = (*PeerConnection)->GetConfiguration().servers != PeerConnectionConfig.servers;
+			(*PeerConnection)->SetConfiguration(PeerConnectionConfig);
+
+			if (bIceServersChanged)
+			{
+				UE_LOG(LogMillicastPlayer, Log, TEXT("Ice servers changed, restarting ice on the prepared peerconnection"));
+
+				// An offer in flight must complete first, it owns the session description observers
+				if (bLocalDescriptionReady)
+				{
+					PrepareIceRestart(false);
+				}
+				else
+				{
+					bIceRestartPending = true;
+				}
+			}
+		}
+	}
 
 	return StartWebSocketConnection(InSignalingData.WsUrl, InSignalingData.Jwt);
 }
@@ -139,6 +296,8 @@ bool UMillicastSubscriberComponent::Subscribe(UMillicastDirectorComponent* Direc
 void UMillicastSubscriberComponent::Unsubscribe()
 {
 	bShouldReconnect = false;
+
+	AbortMigration(TEXT("Unsubscribed"));
 	
 	if (WS)
 	{
@@ -147,15 +306,25 @@ void UMillicastSubscriberComponent::Unsubscribe()
 		WS = nullptr;
 	}
 
-	if (!IsConnectionActive())
-	{
-		return;
-	}
+	SignalingQueue->Flush();
+	SignalingTransactions->CancelAll();
+
 	State = EMillicastSubscriberState::Disconnected;
 
 	UE_LOG(LogMillicastPlayer, Verbose, TEXT("%S"), __FUNCTION__);
+
+	// Also releases a connection prepared without subscribing
+	ClosePeerConnection();
+}
+
+void UMillicastSubscriberComponent::ClosePeerConnection()
+{
 	FScopeLock Lock(&CriticalPcSection);
 
+	bLocalDescriptionReady = false;
+	bIceRestartPending = false;
+	bViewSent = false;
+
 	if (PeerConnection)
 	{
 		UE_LOG(LogMillicastPlayer, Verbose, TEXT("Clearing audio tracks"));
@@ -174,6 +343,9 @@ void UMillicastSubscriberComponent::Unsubscribe()
 		}
 
 		VideoTracks.Empty();
+		ResetTransceiverPool();
+		LayersByMid.Empty();
+		SelectedLayer.Reset();
 
 		UE_LOG(LogMillicastPlayer, Verbose, TEXT("Destroying peerconnection"));
 		delete PeerConnection;
@@ -186,23 +358,72 @@ void UMillicastSubscriberComponent::EnableFrameTransformer(bool Enable)
 	bUseFrameTransformer = Enable;
 }
 
-void UMillicastSubscriberComponent::Select(const FMillicastLayerData& Layer)
+void UMillicastSubscriberComponent::SetLatencyMode(EMillicastLatencyMode InLatencyMode, int32 InMinimumJitterBufferDelayMs, int32 InMaximumPlayoutDelayMs)
 {
-	UE_LOG(LogMillicastPlayer, VeryVerbose, TEXT("%S"), __FUNCTION__);
+	LatencyMode = InLatencyMode;
+	MinimumJitterBufferDelayMs = FMath::Max(InMinimumJitterBufferDelayMs, 0);
+	MaximumPlayoutDelayMs = FMath::Max(InMaximumPlayoutDelayMs, 0);
 
-	auto DataJson = MakeShared<FJsonObject>();
+	UpdateLatencyConfig();
 
-	auto data = MakeShared<FJsonObject>();
-	data->SetStringField("encodingId", Layer.EncodingId);
-	data->SetNumberField("spatialLayerId", Layer.SpatialLayerId);
-	data->SetNumberField("temporalLayerId", Layer.TemporalLayerId);
+	FScopeLock Lock(&CriticalPcSection);
+	if (PeerConnection)
+	{
+		ApplyLatencySettings(PeerConnection);
+	}
+}
 
-	DataJson->SetObjectField("layer", data);
+void UMillicastSubscriberComponent::SetPreferredVideoCodecs(const TArray<FString>& Codecs)
+{
+	PreferredVideoCodecs = Codecs;
+}
 
-	SendCommand("select", DataJson);
+void UMillicastSubscriberComponent::UpdateLatencyConfig()
+{
+	const bool bUltraLowLatency = LatencyMode == EMillicastLatencyMode::UltraLowLatency;
+	const auto DefaultConfig = Millicast::Player::FWebRTCPeerConnection::GetDefaultConfig();
+
+	// Speed up playback to drain the audio buffer after a burst instead of keeping the added delay
+	PeerConnectionConfig.audio_jitter_buffer_fast_accelerate = bUltraLowLatency || DefaultConfig.audio_jitter_buffer_fast_accelerate;
+	PeerConnectionConfig.audio_jitter_buffer_max_packets = bUltraLowLatency ? UltraLowLatencyAudioJitterBufferMaxPackets : DefaultConfig.audio_jitter_buffer_max_packets;
+}
+
+void UMillicastSubscriberComponent::ApplyLatencySettings(Millicast::Player::FWebRTCPeerConnection* TargetPeerConnection) const
+{
+	Millicast::Player::FLatencySettings Settings;
+
+	switch (LatencyMode)
+	{
+	case EMillicastLatencyMode::LowLatency:
+		Settings.MinimumJitterBufferDelayMs = MinimumJitterBufferDelayMs;
+		Settings.MaximumDelayMs = FMath::Max(MaximumPlayoutDelayMs, MinimumJitterBufferDelayMs);
+		Settings.bPlayoutDelayExtension = true;
+		break;
+	case EMillicastLatencyMode::UltraLowLatency:
+		Settings.MinimumJitterBufferDelayMs = 0.0;
+		Settings.MaximumDelayMs = UltraLowLatencyMaximumDelayMs;
+		Settings.bPlayoutDelayExtension = true;
+		break;
+	default:
+		break;
+	}
+
+	TargetPeerConnection->SetLatencySettings(Settings);
+}
+
+void UMillicastSubscriberComponent::Select(const FMillicastLayerData& Layer)
+{
+	RequestedLayer = Layer;
+	ApplySubscriptionTier();
 }
 
 void UMillicastSubscriberComponent::AutoSelect()
+{
+	RequestedLayer.Reset();
+	ApplySubscriptionTier();
+}
+
+void UMillicastSubscriberComponent::SendSelectCommand(const FMillicastLayerData* Layer)
 {
 	UE_LOG(LogMillicastPlayer, VeryVerbose, TEXT("%S"), __FUNCTION__);
 
@@ -210,11 +431,175 @@ void UMillicastSubscriberComponent::AutoSelect()
 	auto data = MakeShared<FJsonObject>();
 
 	// send empty object for auto layer selection
+	if (Layer)
+	{
+		data->SetStringField("encodingId", Layer->EncodingId);
+		data->SetNumberField("spatialLayerId", Layer->SpatialLayerId);
+		data->SetNumberField("temporalLayerId", Layer->TemporalLayerId);
+	}
+
 	DataJson->SetObjectField("layer", data);
 
 	SendCommand("select", DataJson);
 }
 
+void UMillicastSubscriberComponent::SetMaxReceiveBitrate(int32 Kbps)
+{
+	MaxReceiveBitrateKbps = FMath::Max(Kbps, 0);
+
+	{
+		FScopeLock Lock(&CriticalPcSection);
+		if (PeerConnection)
+		{
+			ApplyReceiveBitrateCap(PeerConnection);
+		}
+		if (MigrationPeerConnection)
+		{
+			ApplyReceiveBitrateCap(MigrationPeerConnection);
+		}
+	}
+
+	ApplySubscriptionTier();
+}
+
+void UMillicastSubscriberComponent::SetAllocatedReceiveBitrate(int32 Kbps)
+{
+	Kbps = FMath::Max(Kbps, 0);
+	if (Kbps == AllocatedReceiveBitrateKbps)
+	{
+		return;
+	}
+
+	AllocatedReceiveBitrateKbps = Kbps;
+	ApplySubscriptionTier();
+}
+
+int32 UMillicastSubscriberComponent::GetEffectiveMaxReceiveBitrate() const
+{
+	if (MaxReceiveBitrateKbps > 0 && AllocatedReceiveBitrateKbps > 0)
+	{
+		return FMath::Min(MaxReceiveBitrateKbps, AllocatedReceiveBitrateKbps);
+	}
+
+	return FMath::Max(MaxReceiveBitrateKbps, AllocatedReceiveBitrateKbps);
+}
+
+void UMillicastSubscriberComponent::ApplyReceiveBitrateCap(Millicast::Player::FWebRTCPeerConnection* TargetPeerConnection) const
+{
+	// Only the cap of this subscriber, the allocated share changes too often to be negotiated
+	const int32 Kbps = MaxReceiveBitrateKbps;
+	TargetPeerConnection->EditLocalDescription([Kbps](Millicast::Player::FSdpEditor& Editor)
+	{
+		Editor.SetBandwidth(cricket::MediaType::MEDIA_TYPE_VIDEO, Kbps);
+	});
+}
+
+void UMillicastSubscriberComponent::SetSubscriptionTier(EMillicastSubscriptionTier Tier)
+{
+	if (Tier == SubscriptionTier)
+	{
+		return;
+	}
+
+	UE_LOG(LogMillicastPlayer, Log, TEXT("Subscription tier changed to %s"), *UEnum::GetValueAsString(Tier));
+
+	SubscriptionTier = Tier;
+	ApplySubscriptionTier();
+
+	OnSubscriptionTierChanged.Broadcast(Tier);
+}
+
+void UMillicastSubscriberComponent::ApplySubscriptionTier()
+{
+	using namespace Millicast::Player;
+
+	const bool bPaused = SubscriptionTier == EMillicastSubscriptionTier::Paused;
+	for (auto* Track : VideoTracks)
+	{
+		if (Track->IsEnabled() == bPaused)
+		{
+			Track->SetEnabled(!bPaused);
+		}
+	}
+
+	const auto* Layers = GetMainVideoLayers();
+
+	TOptional<FMillicastLayerData> Layer;
+	if (SubscriptionTier == EMillicastSubscriptionTier::Full)
+	{
+		Layer = RequestedLayer;
+
+		const int32 MaxBitrateKbps = GetEffectiveMaxReceiveBitrate();
+		if (Layers && MaxBitrateKbps > 0)
+		{
+			Layer = FitLayerToBitrate(*Layers, Layer, MaxBitrateKbps * 1000);
+		}
+	}
+	else if (const auto* Lowest = Layers ? FindLowestLayer(*Layers, bPaused) : nullptr)
+	{
+		Layer = *Lowest;
+	}
+	else
+	{
+		// Known once the first layers event is received, which applies the tier again
+		return;
+	}
+
+	if (!Layer.IsSet())
+	{
+		// Give the choice of the layer back to the server
+		if (SelectedLayer.IsSet())
+		{
+			SelectedLayer.Reset();
+			SendSelectCommand(nullptr);
+		}
+		return;
+	}
+
+	if (SelectedLayer.IsSet() && IsSameLayer(SelectedLayer.GetValue(), Layer.GetValue()))
+	{
+		return;
+	}
+
+	SelectedLayer = Layer;
+	SendSelectCommand(&Layer.GetValue());
+}
+
+TArray<FMillicastLayerData> UMillicastSubscriberComponent::GetLayers(const FString& Mid) const
+{
+	const auto* Layers = Mid.IsEmpty() ? GetMainVideoLayers() : LayersByMid.Find(Mid);
+	return Layers ? *Layers : TArray<FMillicastLayerData>();
+}
+
+const TArray<FMillicastLayerData>* UMillicastSubscriberComponent::GetMainVideoLayers() const
+{
+	if (VideoTracks.Num() > 0)
+	{
+		return LayersByMid.Find(VideoTracks[0]->GetMid());
+	}
+
+	// The layers event may come before the track is created
+	if (LayersByMid.Num() == 1)
+	{
+		for (const auto& Entry : LayersByMid)
+		{
+			return &Entry.Value;
+		}
+	}
+
+	return nullptr;
+}
+
+FMillicastConnectionTimings UMillicastSubscriberComponent::GetConnectionTimings() const
+{
+	return ConnectionTimer->GetTimings();
+}
+
+float UMillicastSubscriberComponent::GetSignalingLatency(const FString& CommandName) const
+{
+	return SignalingTransactions->GetLastRoundTripMs(CommandName);
+}
+
 FPlayerStatsData UMillicastSubscriberComponent::GetStats() const
 {
 #if ENGINE_MAJOR_VERSION >= 5 && ENGINE_MINOR_VERSION > 0
@@ -230,6 +615,21 @@ FPlayerStatsData UMillicastSubscriberComponent::GetStats() const
 #endif
 }
 
+TArray<FPlayerStatsData> UMillicastSubscriberComponent::GetStatsHistory() const
+{
+#if ENGINE_MAJOR_VERSION >= 5 && ENGINE_MINOR_VERSION > 0
+	const auto* StatsCollector = GetStatsCollector();
+	if(!StatsCollector)
+	{
+		return {};
+	}
+
+	return StatsCollector->GetHistory();
+#else
+	return {};
+#endif
+}
+
 #if ENGINE_MAJOR_VERSION >= 5 && ENGINE_MINOR_VERSION > 0
 Millicast::Player::FPlayerStatsCollector* UMillicastSubscriberComponent::GetStatsCollector() const
 {
@@ -252,6 +652,46 @@ void UMillicastSubscriberComponent::Project(const FString& SourceId, const TArra
 {
 	UE_LOG(LogMillicastPlayer, VeryVerbose, TEXT("%S"), __FUNCTION__);
 
+	TArray<FMillicastProjectionData> Projections;
+	TArray<FString> MissingKinds;
+
+	for (const auto& Data : ProjectionData)
+	{
+		FMillicastProjectionData Projection = Data;
+
+		if (Projection.Mid.IsEmpty())
+		{
+			const int32 Index = IdleMids.IndexOfByPredicate([this, &Projection](const FString& Mid) { return RemoteTrackMedia.FindRef(Mid) == Projection.Media; });
+			if (Index == INDEX_NONE)
+			{
+				// Sent once the transceiver added for it has its track
+				PendingProjections.Emplace(SourceId, Projection);
+				MissingKinds.Add(Projection.Media);
+				continue;
+			}
+
+			Projection.Mid = IdleMids[Index];
+		}
+
+		IdleMids.Remove(Projection.Mid);
+		ProjectedMids.Add(Projection.Mid);
+		Projections.Add(MoveTemp(Projection));
+	}
+
+	if (Projections.Num() > 0)
+	{
+		SendProjectCommand(SourceId, Projections);
+	}
+
+	if (MissingKinds.Num() > 0)
+	{
+		UE_LOG(LogMillicastPlayer, Log, TEXT("No idle transceiver for %d projected tracks, adding them"), MissingKinds.Num());
+		AddRemoteTracks(MissingKinds);
+	}
+}
+
+void UMillicastSubscriberComponent::SendProjectCommand(const FString& SourceId, const TArray<FMillicastProjectionData>& ProjectionData)
+{
 	auto DataJson = MakeShared<FJsonObject>();
 	TArray<TSharedPtr<FJsonValue>> ProjectionJson;
 
@@ -270,18 +710,71 @@ void UMillicastSubscriberComponent::Project(const FString& SourceId, const TArra
 	DataJson->SetArrayField("mapping", ProjectionJson);
 
 	SendCommand("project", DataJson);
+
+	OnProjected.Broadcast(SourceId, ProjectionData);
 }
 
-void UMillicastSubscriberComponent::Unproject(const TArray<FString>& Mids)
+int32 UMillicastSubscriberComponent::GetNumIdleRemoteTracks(const FString& Kind) const
 {
-	UE_LOG(LogMillicastPlayer, VeryVerbose, TEXT("%S"), __FUNCTION__);
-
-	auto DataJson = MakeShared<FJsonObject>();
-	TArray<TSharedPtr<FJsonValue>> MidsJson;
-
-	for (auto& m : Mids)
+	int32 NumIdle = 0;
+	for (const FString& Mid : IdleMids)
 	{
-		MidsJson.Emplace(MakeShared<FJsonValueString>(m));
+		NumIdle += RemoteTrackMedia.FindRef(Mid) == Kind ? 1 : 0;
+	}
+
+	return NumIdle;
+}
+
+void UMillicastSubscriberComponent::OnRemoteTrackCreated(const FString& Mid, const FString& Media, bool bMainTrack)
+{
+	RemoteTrackMedia.Add(Mid, Media);
+
+	// The main tracks receive the stream that was subscribed to
+	if (bMainTrack)
+	{
+		return;
+	}
+
+	const int32 Index = PendingProjections.IndexOfByPredicate([&Media](const TPair<FString, FMillicastProjectionData>& Pending) { return Pending.Value.Media == Media; });
+	if (Index == INDEX_NONE)
+	{
+		IdleMids.AddUnique(Mid);
+		return;
+	}
+
+	auto Pending = PendingProjections[Index];
+	PendingProjections.RemoveAt(Index);
+
+	Pending.Value.Mid = Mid;
+	ProjectedMids.Add(Mid);
+	SendProjectCommand(Pending.Key, { Pending.Value });
+}
+
+void UMillicastSubscriberComponent::ResetTransceiverPool()
+{
+	RemoteTrackMedia.Empty();
+	ProjectedMids.Empty();
+	IdleMids.Empty();
+	PendingProjections.Empty();
+}
+
+void UMillicastSubscriberComponent::Unproject(const TArray<FString>& Mids)
+{
+	UE_LOG(LogMillicastPlayer, VeryVerbose, TEXT("%S"), __FUNCTION__);
+
+	auto DataJson = MakeShared<FJsonObject>();
+	TArray<TSharedPtr<FJsonValue>> MidsJson;
+
+	for (auto& m : Mids)
+	{
+		MidsJson.Emplace(MakeShared<FJsonValueString>(m));
+
+		// The transceiver stays in the connection, idle until the next projection
+		ProjectedMids.Remove(m);
+		if (RemoteTrackMedia.Contains(m))
+		{
+			IdleMids.AddUnique(m);
+		}
 	}
 
 	DataJson->SetArrayField("mediaIds", MidsJson);
@@ -291,171 +784,296 @@ void UMillicastSubscriberComponent::Unproject(const TArray<FString>& Mids)
 
 void UMillicastSubscriberComponent::AddRemoteTrack(const FString& Kind)
 {
-	UE_LOG(LogMillicastPlayer, VeryVerbose, TEXT("%S"), __FUNCTION__);
-
-	webrtc::RtpTransceiverInit Init;
-	Init.direction = webrtc::RtpTransceiverDirection::kRecvOnly;
+	AddRemoteTracks({ Kind });
+}
 
-	const auto MediaType = (Kind == "audio") ? cricket::MediaType::MEDIA_TYPE_AUDIO : cricket::MediaType::MEDIA_TYPE_VIDEO;
+void UMillicastSubscriberComponent::AddRemoteTracks(const TArray<FString>& Kinds)
+{
+	UE_LOG(LogMillicastPlayer, VeryVerbose, TEXT("%S"), __FUNCTION__);
 
-	const auto Result = (*PeerConnection)->AddTransceiver(MediaType, Init);
-	if (Result.ok())
+	FScopeLock Lock(&CriticalPcSection);
+	if (!PeerConnection)
 	{
-		UE_LOG(LogMillicastPlayer, Log, TEXT("Successfully added transceiver for remote track"));
+		UE_LOG(LogMillicastPlayer, Warning, TEXT("Can not add remote tracks without a peerconnection"));
+		return;
 	}
-	else
+
+	TArray<cricket::MediaType> MediaTypes;
+	MediaTypes.Reserve(Kinds.Num());
+	for (const FString& Kind : Kinds)
 	{
-		UE_LOG(LogMillicastPlayer, Error, TEXT("Failed to add transceiver for remote track"));
+		MediaTypes.Add((Kind == "audio") ? cricket::MediaType::MEDIA_TYPE_AUDIO : cricket::MediaType::MEDIA_TYPE_VIDEO);
 	}
+
+	const int32 NumAdded = PeerConnection->AddRemoteTransceivers(MediaTypes);
+	UE_LOG(LogMillicastPlayer, Log, TEXT("Added %d transceivers for remote tracks"), NumAdded);
 }
 
 bool UMillicastSubscriberComponent::StartWebSocketConnection(const FString& Url, const FString& Jwt)
 {
 	UE_LOG(LogMillicastPlayer, Verbose, TEXT("%S"), __FUNCTION__);
 
+	// Messages of the previous WebSocket that are still being parsed belong to the previous session, and so do its commands
+	SignalingQueue->Flush();
+	SignalingTransactions->CancelAll();
+
+	WS = CreateWebSocket(Url, Jwt);
+	BindWebSocketCallbacks();
+
+	WS->Connect();
+	return true;
+}
+
+TSharedPtr<IWebSocket> UMillicastSubscriberComponent::CreateWebSocket(const FString& Url, const FString& Jwt)
+{
 	if (!FModuleManager::Get().IsModuleLoaded("WebSockets"))
 	{
 		UE_LOG(LogMillicastPlayer, VeryVerbose, TEXT("Load WebSocket module"));
 		FModuleManager::Get().LoadModule("WebSockets");
 	}
 
-	WS = FWebSocketsModule::Get().CreateWebSocket(Url + "?token=" + Jwt);
+	return FWebSocketsModule::Get().CreateWebSocket(Url + "?token=" + Jwt);
+}
 
+void UMillicastSubscriberComponent::BindWebSocketCallbacks()
+{
 	// TODO [RW] do we need better multi-threaded handling for these?
 	OnConnectedHandle = WS->OnConnected().AddWeakLambda(this, [this]() { OnConnected(); });
 	OnConnectionErrorHandle = WS->OnConnectionError().AddWeakLambda(this, [this](const FString& Error) { OnConnectionError(Error); });
 	OnClosedHandle = WS->OnClosed().AddWeakLambda(this, [this](int32 StatusCode, const FString& Reason, bool bWasClean) { OnClosed(StatusCode, Reason, bWasClean); });
 	OnMessageHandle = WS->OnMessage().AddWeakLambda(this, [this](const FString& Msg) { OnMessage(Msg); });
+}
 
-	WS->Connect();
-	return true;
+void UMillicastSubscriberComponent::UnbindWebSocketCallbacks(const TSharedPtr<IWebSocket>& Socket)
+{
+	Socket->OnConnected().RemoveAll(this);
+	Socket->OnConnectionError().RemoveAll(this);
+	Socket->OnClosed().RemoveAll(this);
+	Socket->OnMessage().RemoveAll(this);
+
+	if (Socket == WS)
+	{
+		SignalingQueue->Flush();
+	}
+	if (Socket == MigrationWS)
+	{
+		MigrationSignalingQueue->Flush();
+	}
 }
 
-bool UMillicastSubscriberComponent::SubscribeToMillicast()
+void UMillicastSubscriberComponent::PrepareConnection()
 {
 	using namespace Millicast::Player;
 	UE_LOG(LogMillicastPlayer, Verbose, TEXT("%S"), __FUNCTION__);
 
-	PeerConnection = FWebRTCPeerConnection::Create(FWebRTCPeerConnection::GetDefaultConfig());
+	FScopeLock Lock(&CriticalPcSection);
 
-	auto* CreateSessionDescriptionObserver = PeerConnection->GetCreateDescriptionObserver();
-	auto* LocalDescriptionObserver = PeerConnection->GetLocalDescriptionObserver();
-	auto* RemoteDescriptionObserver = PeerConnection->GetRemoteDescriptionObserver();
+	if (PeerConnection)
+	{
+		return;
+	}
 
-	TWeakObjectPtr<UMillicastSubscriberComponent> WeakThis(this);
-	
-#if MILLICAST_HAS_CXX20
-	CreateSessionDescriptionObserver->SetOnSuccessCallback([=, this](const std::string& type, const std::string& sdp)
-#else
-	CreateSessionDescriptionObserver->SetOnSuccessCallback([=](const std::string& type, const std::string& sdp)
-#endif
+	PrepareStartTime = FPlatformTime::Seconds();
+	bLocalDescriptionReady = false;
+
+	// A new connection attempt starts here
+	ConnectionTimer->Reset();
+
+	// A pooled connection already has its transceivers and local description, only the view command is left
+	if (TakePooledPeerConnection())
 	{
-		UE_LOG(LogMillicastPlayer, Log, TEXT("pc.createOffer() | sucess\nsdp : %s"), *FString(sdp.c_str()));
-#if MILLICAST_HAS_CXX20
-		AsyncGameThreadTaskWithCapture(WeakThis, [=, this]()
-#else
-		AsyncGameThreadTaskWithCapture(WeakThis, [=]()
-#endif
-		{
-				// Search for this expression and add the stereo flag to enable stereo
-				const std::string s = "minptime=10;useinbandfec=1";
-				std::string sdp_non_const = sdp;
-				std::ostringstream oss;
-				oss << s << "; stereo=1";
+		BindPeerConnectionCallbacks();
+		OnLocalDescriptionReady();
+		return;
+	}
 
-				auto pos = sdp.find(s);
-				if (pos != std::string::npos)
-				{
-					sdp_non_const.replace(sdp.find(s), s.size(), oss.str());
-				}
+	UpdateLatencyConfig();
+	PeerConnection = FWebRTCPeerConnection::Create(PeerConnectionConfig, static_cast<int32>(AudioPullPeriod));
+	if (!PeerConnection)
+	{
+		UE_LOG(LogMillicastPlayer, Error, TEXT("Could not create peerconnection"));
+		return;
+	}
 
-				{
-					FScopeLock Lock(&CriticalPcSection);
-					if (PeerConnection)
-					{
-						PeerConnection->SetLocalDescription(sdp_non_const, type);
-					}
-				}
-		});
-	});
+	BindPeerConnectionCallbacks();
+
+	// Codec preferences are set on the transceivers, so they must exist before the offer
+	PeerConnection->VideoCodecPreferences = PreferredVideoCodecs;
+	PeerConnection->AddRecvOnlyTransceivers();
+
+	PeerConnection->OaOptions.offer_to_receive_video = true;
+	PeerConnection->OaOptions.offer_to_receive_audio = true;
+
+	TWeakObjectPtr<UMillicastSubscriberComponent> WeakThis(this);
+	const uint64 PreparedId = PeerConnection->GetId();
+	auto Timer = ConnectionTimer;
 
 #if MILLICAST_HAS_CXX20
-	CreateSessionDescriptionObserver->SetOnFailureCallback([=, this](const std::string& err)
+	PeerConnection->CreateLocalOffer([=, this]()
 #else
-	CreateSessionDescriptionObserver->SetOnFailureCallback([=](const std::string& err)
+	PeerConnection->CreateLocalOffer([=]()
 #endif
 	{
-		UE_LOG(LogMillicastPlayer, Error, TEXT("pc.createOffer() | Error: %s"), *FString(err.c_str()));
+		Timer->Mark(EMillicastConnectionStage::LocalDescriptionSet);
+
 #if MILLICAST_HAS_CXX20
 		AsyncGameThreadTaskWithCapture(WeakThis, [=, this]()
 #else
 		AsyncGameThreadTaskWithCapture(WeakThis, [=]()
 #endif
 		{
-			OnSubscribedFailure.Broadcast(FString{ err.c_str() });
+			// The connection may have been closed and replaced while the offer was created
+			if (IsSamePeerConnection(PeerConnection, PreparedId))
+			{
+				OnLocalDescriptionReady();
+			}
 		});
-	});
-
+	},
 #if MILLICAST_HAS_CXX20
-	LocalDescriptionObserver->SetOnSuccessCallback([=, this]()
+	[=, this](const std::string& err)
 #else
-	LocalDescriptionObserver->SetOnSuccessCallback([=]()
+	[=](const std::string& err)
 #endif
 	{
-		UE_LOG(LogMillicastPlayer, Log, TEXT("pc.setLocalDescription() | sucess"));
-
 #if MILLICAST_HAS_CXX20
 		AsyncGameThreadTaskWithCapture(WeakThis, [=, this]()
 #else
 		AsyncGameThreadTaskWithCapture(WeakThis, [=]()
 #endif
 		{
-			FScopeLock Lock(&CriticalPcSection);
-			if (!PeerConnection)
+			if (!IsSamePeerConnection(PeerConnection, PreparedId))
 			{
 				return;
 			}
 
-			std::string sdp;
-			(*PeerConnection)->local_description()->ToString(&sdp);
-
-			// Add events we want to receive from millicast
-			TArray<TSharedPtr<FJsonValue>> eventsJson;
-			TArray<FString> EvKeys;
-			EventBroadcaster.GetKeys(EvKeys);
-
-			for (auto& ev : EvKeys)
-			{
-				eventsJson.Add(MakeShared<FJsonValueString>(ev));
-			}
+			UE_LOG(LogMillicastPlayer, Error, TEXT("Create local offer failed : %s"), *FString(err.c_str()));
 
-			// Fill Signaling data
-			auto DataJson = MakeShared<FJsonObject>();
-			DataJson->SetStringField("streamId", MillicastMediaSource->StreamName);
-			DataJson->SetStringField("sdp", ToString(sdp));
-			DataJson->SetArrayField("events", eventsJson);
+			// The view can not be sent without a local description, drop the connection and the socket waiting for it
+			Unsubscribe();
 
-			SendCommand("view", DataJson);
+			OnSubscribedFailure.Broadcast(FString{ err.c_str() });
 		});
+	},
+	[Timer]()
+	{
+		Timer->Mark(EMillicastConnectionStage::OfferCreated);
 	});
+}
 
-#if MILLICAST_HAS_CXX20
-	LocalDescriptionObserver->SetOnFailureCallback([=, this](const std::string& err)
-#else
-	LocalDescriptionObserver->SetOnFailureCallback([=](const std::string& err)
-#endif
+void UMillicastSubscriberComponent::SetDirectorComponent(UMillicastDirectorComponent* DirectorComponent)
+{
+	if (CachedDirectorComponent == DirectorComponent)
 	{
-		UE_LOG(LogMillicastPlayer, Error, TEXT("Set local description failed : %s"), *FString(err.c_str()));
+		return;
+	}
 
-#if MILLICAST_HAS_CXX20
-		AsyncGameThreadTaskWithCapture(WeakThis, [=, this]()
-#else
-		AsyncGameThreadTaskWithCapture(WeakThis, [=]()
-#endif
-		{
-			OnSubscribedFailure.Broadcast(FString{ err.c_str() });
-		});
-	});
+	if (IsValid(CachedDirectorComponent))
+	{
+		CachedDirectorComponent->OnRequestStarted.RemoveAll(this);
+	}
+
+	CachedDirectorComponent = DirectorComponent;
+
+	if (IsValid(CachedDirectorComponent))
+	{
+		CachedDirectorComponent->OnRequestStarted.AddUObject(this, &UMillicastSubscriberComponent::OnDirectorRequestStarted);
+	}
+}
+
+void UMillicastSubscriberComponent::OnDirectorRequestStarted(UMillicastDirectorComponent* DirectorComponent)
+{
+	// The migration creates its own peerconnection once the new server is known
+	if (bMigrating)
+	{
+		return;
+	}
+
+	// Does nothing if the current connection is still in use or has already been prepared
+	PrepareConnection();
+}
+
+void UMillicastSubscriberComponent::OnLocalDescriptionReady()
+{
+	// Offered with ice servers that have changed since, gather again before sending it
+	if (bIceRestartPending)
+	{
+		bIceRestartPending = false;
+		PrepareIceRestart(false);
+		return;
+	}
+
+	LocalDescriptionReadyTime = FPlatformTime::Seconds();
+	bLocalDescriptionReady = true;
+
+	// Pooled connections were negotiated beforehand, they are ready as soon as they are taken
+	ConnectionTimer->Mark(EMillicastConnectionStage::LocalDescriptionSet);
+
+	UE_LOG(LogMillicastPlayer, Log, TEXT("Local description ready in %.1f ms"), (LocalDescriptionReadyTime - PrepareStartTime) * 1000.0);
+
+	TrySendView();
+}
+
+void UMillicastSubscriberComponent::TrySendView()
+{
+	if (bViewSent || !bWebSocketConnected || !bLocalDescriptionReady)
+	{
+		return;
+	}
+
+	bViewSent = true;
+	ConnectionTimer->Mark(EMillicastConnectionStage::ViewSent);
+
+	// Done serially, the offer would only have started once the WebSocket was connected.
+	// Whatever part of it completed before that point is time saved by preparing it early.
+	const double OfferMs = (LocalDescriptionReadyTime - PrepareStartTime) * 1000.0;
+	const double WaitedMs = FMath::Max(0.0, LocalDescriptionReadyTime - WebSocketConnectedTime) * 1000.0;
+	const double SignalingMs = (WebSocketConnectedTime - SubscribeStartTime) * 1000.0;
+
+	UE_LOG(LogMillicastPlayer, Log, TEXT("Sending view: offer took %.1f ms, WebSocket connect %.1f ms, waited %.1f ms for the offer, saved %.1f ms"),
+		OfferMs, SignalingMs, WaitedMs, OfferMs - WaitedMs);
+
+	SendViewCommand(PeerConnection, WS);
+}
+
+bool UMillicastSubscriberComponent::TakePooledPeerConnection()
+{
+	if (!bUseConnectionPool)
+	{
+		return false;
+	}
+
+	// Pooled connections are created with the default settings
+	if (AudioPullPeriod != EMillicastAudioPullPeriod::Period10Ms || PreferredVideoCodecs.Num() != 0 || LatencyMode != EMillicastLatencyMode::Default
+		|| MaxReceiveBitrateKbps > 0)
+	{
+		return false;
+	}
+
+	auto* Pool = GetWorld()->GetGameInstance()->GetSubsystem<UMillicastConnectionPoolSubsystem>();
+	if (!Pool)
+	{
+		return false;
+	}
+
+	auto* PooledPeerConnection = Pool->Acquire();
+	if (!PooledPeerConnection)
+	{
+		UE_LOG(LogMillicastPlayer, Log, TEXT("No pooled peerconnection ready, creating a new one"));
+		return false;
+	}
+
+	UE_LOG(LogMillicastPlayer, Log, TEXT("Using a pooled peerconnection"));
+
+	PeerConnection = PooledPeerConnection;
+
+	return true;
+}
+
+void UMillicastSubscriberComponent::BindRemoteDescriptionCallbacks()
+{
+	auto* RemoteDescriptionObserver = PeerConnection->GetRemoteDescriptionObserver();
+
+	TWeakObjectPtr<UMillicastSubscriberComponent> WeakThis(this);
 
 #if MILLICAST_HAS_CXX20
 	RemoteDescriptionObserver->SetOnSuccessCallback([=, this]()
@@ -493,9 +1111,20 @@ bool UMillicastSubscriberComponent::SubscribeToMillicast()
 			OnSubscribedFailure.Broadcast(FString{ err.c_str() });
 		});
 	});
+}
 
-	PeerConnection->OaOptions.offer_to_receive_video = true;
-	PeerConnection->OaOptions.offer_to_receive_audio = true;
+void UMillicastSubscriberComponent::BindPeerConnectionCallbacks()
+{
+	using namespace Millicast::Player;
+
+	BindRemoteDescriptionCallbacks();
+
+	TWeakObjectPtr<UMillicastSubscriberComponent> WeakThis(this);
+	auto Timer = ConnectionTimer;
+
+	// Audio readiness is tracked by the audio device module of this connection. Taken here, the PeerConnection member
+	// may be closed or replaced by the time the tracks arrive on the signaling thread
+	const rtc::scoped_refptr<FAudioDeviceModule> AudioDeviceModule = PeerConnection->GetAudioDeviceModule();
 
 	using RtcTrack = rtc::scoped_refptr<webrtc::MediaStreamTrackInterface>;
 
@@ -513,18 +1142,7 @@ bool UMillicastSubscriberComponent::SubscribeToMillicast()
 		AsyncGameThreadTaskWithCapture(WeakThis, [=]()
 #endif
 		{
-			UE_LOG(LogMillicastPlayer, Verbose, TEXT("Create video track object"));
-			auto VideoTrack = NewObject<UMillicastVideoTrackImpl>();
-			VideoTrack->Initialize(Mid.c_str(), Track);
-
-			// Registers all VideoConsumers with the track
-			for(const auto& VideoConsumer : VideoConsumers)
-			{
-				VideoTrack->AddConsumer(VideoConsumer);
-			}
-			
-			OnVideoTrack.Broadcast(VideoTrack);
-			VideoTracks.Add(VideoTrack);
+			CreateVideoTrack(Mid.c_str(), Track);
 		});
 	};
 
@@ -542,20 +1160,7 @@ bool UMillicastSubscriberComponent::SubscribeToMillicast()
 		AsyncGameThreadTaskWithCapture(WeakThis, [=]()
 #endif
 		{
-			UE_LOG(LogMillicastPlayer, Verbose, TEXT("Create audio track object"));
-			auto* AudioTrack = NewObject<UMillicastAudioTrackImpl>();
-			AudioTrack->Initialize(mid.c_str(), Track);
-
-			// Registers all AudioComponents with the track
-			auto* Subsystem = GetWorld()->GetGameInstance()->GetSubsystem<UMillicastAudioSubsystem>();
-			for(auto* AudioComponent : AudioComponents)
-			{
-				Subsystem->Register(AudioComponent);
-				AudioTrack->AddConsumer(Subsystem->GetInstance(AudioComponent));
-			}
-			
-			OnAudioTrack.Broadcast(AudioTrack);
-			AudioTracks.Add(AudioTrack); // keep reference to delete it later
+			CreateAudioTrack(mid.c_str(), Track, AudioDeviceModule);
 		});
 	};
 
@@ -575,101 +1180,446 @@ bool UMillicastSubscriberComponent::SubscribeToMillicast()
 		});
 	};
 
+#if MILLICAST_HAS_CXX20
+	PeerConnection->OnIceConnectionStateChanged = [=, this](webrtc::PeerConnectionInterface::IceConnectionState IceState)
+#else
+	PeerConnection->OnIceConnectionStateChanged = [=](webrtc::PeerConnectionInterface::IceConnectionState IceState)
+#endif
+	{
+		if (IceState == webrtc::PeerConnectionInterface::kIceConnectionConnected)
+		{
+			Timer->Mark(EMillicastConnectionStage::IceConnected);
+		}
+
+#if MILLICAST_HAS_CXX20
+		AsyncGameThreadTaskWithCapture(WeakThis, [=, this]()
+#else
+		AsyncGameThreadTaskWithCapture(WeakThis, [=]()
+#endif
+		{
+			OnIceConnectionStateChanged(IceState);
+		});
+	};
+
+	PeerConnection->OnFirstRtpPacket = [Timer](cricket::MediaType)
+	{
+		Timer->Mark(EMillicastConnectionStage::FirstRtpPacket);
+	};
+
 	PeerConnection->EnableFrameTransformer(bUseFrameTransformer);
-	PeerConnection->CreateOffer();
+
+	// Before the offer, for the playout delay extension
+	ApplyLatencySettings(PeerConnection);
+	ApplyReceiveBitrateCap(PeerConnection);
 
 #if ENGINE_MAJOR_VERSION >= 5 && ENGINE_MINOR_VERSION > 0
 	PeerConnection->EnableStats(true);
 #endif
-
-	return true;
 }
 
-/* WebSocket Callback
-*****************************************************************************/
-
-void UMillicastSubscriberComponent::OnConnected()
+void UMillicastSubscriberComponent::CreateVideoTrack(const FString& Mid, rtc::scoped_refptr<webrtc::MediaStreamTrackInterface> Track)
 {
-	UE_LOG(LogMillicastPlayer, Log, TEXT("Millicast WebSocket Connected"));
-	SubscribeToMillicast();
-}
+	UE_LOG(LogMillicastPlayer, Verbose, TEXT("Create video track object"));
+	auto VideoTrack = NewObject<UMillicastVideoTrackImpl>();
+	VideoTrack->Initialize(Mid, Track);
+	VideoTrack->SetConnectionTimer(ConnectionTimer);
 
-void UMillicastSubscriberComponent::OnConnectionError(const FString& Error)
-{
-	State = EMillicastSubscriberState::Disconnected;
+	// Registers all VideoConsumers with the track
+	for(const auto& VideoConsumer : VideoConsumers)
+	{
+		VideoTrack->AddConsumer(VideoConsumer);
+	}
+	
+	OnVideoTrack.Broadcast(VideoTrack);
+	VideoTracks.Add(VideoTrack);
 
-	UE_LOG(LogMillicastPlayer, Log, TEXT("Millicast WebSocket Connection error : %s"), *Error);
+	OnRemoteTrackCreated(Mid, TEXT("video"), VideoTracks.Num() == 1);
 
-	OnDisconnectedInternal(Error);
+	if (SubscriptionTier == EMillicastSubscriptionTier::Paused)
+	{
+		VideoTrack->SetEnabled(false);
+	}
 }
 
-void UMillicastSubscriberComponent::OnClosed(int32 StatusCode,
-	const FString& Reason,
-	bool bWasClean)
+void UMillicastSubscriberComponent::CreateAudioTrack(const FString& Mid, rtc::scoped_refptr<webrtc::MediaStreamTrackInterface> Track,
+	rtc::scoped_refptr<Millicast::Player::FAudioDeviceModule> AudioDeviceModule)
 {
-	State = EMillicastSubscriberState::Disconnected;
+	UE_LOG(LogMillicastPlayer, Verbose, TEXT("Create audio track object"));
+	auto* AudioTrack = NewObject<UMillicastAudioTrackImpl>();
+	AudioTrack->Initialize(Mid, Track, AudioDeviceModule);
 
-	UE_LOG(LogMillicastPlayer, Log, TEXT("Millicast WebSocket Closed"));
+	// Registers all AudioComponents with the track
+	auto* Subsystem = GetWorld()->GetGameInstance()->GetSubsystem<UMillicastAudioSubsystem>();
+	for(auto* AudioComponent : AudioComponents)
+	{
+		Subsystem->Register(AudioComponent);
+		AudioTrack->AddConsumer(Subsystem->GetInstance(AudioComponent));
+	}
 
-	OnDisconnectedInternal(Reason);
+	for(const auto& AudioConsumer : AudioConsumers)
+	{
+		AudioTrack->AddConsumer(AudioConsumer);
+	}
+	
+	OnAudioTrack.Broadcast(AudioTrack);
+	AudioTracks.Add(AudioTrack); // keep reference to delete it later
+
+	OnRemoteTrackCreated(Mid, TEXT("audio"), AudioTracks.Num() == 1);
 }
 
-void UMillicastSubscriberComponent::OnDisconnectedInternal(const FString& Reason)
+void UMillicastSubscriberComponent::OnIceConnectionStateChanged(webrtc::PeerConnectionInterface::IceConnectionState IceState)
 {
-	OnDisconnected.Broadcast(Reason, bShouldReconnect);
+	if (IceState != webrtc::PeerConnectionInterface::kIceConnectionFailed)
+	{
+		return;
+	}
 
-	if( !bShouldReconnect )
+	UE_LOG(LogMillicastPlayer, Warning, TEXT("Ice connection failed"));
+
+	if (!bUseIceRestartRecovery || !bShouldReconnect || !WS || State.Load() != EMillicastSubscriberState::Connected)
 	{
 		return;
 	}
 
-	if( !IsValid(CachedDirectorComponent) )
+	// The new ICE credentials come with the answer to a view command, which needs a new signaling session.
+	// Closing the WebSocket goes through OnDisconnectedInternal, which restarts ICE on the current peerconnection
+	UE_LOG(LogMillicastPlayer, Log, TEXT("Media path lost, closing the WebSocket to restart ice"));
+	WS->Close();
+}
+
+bool UMillicastSubscriberComponent::CanRestartIce() const
+{
+	return PeerConnection && (*PeerConnection)->remote_description() != nullptr;
+}
+
+void UMillicastSubscriberComponent::PrepareIceRestart(bool bResetTimer)
+{
+	UE_LOG(LogMillicastPlayer, Verbose, TEXT("%S"), __FUNCTION__);
+
+	FScopeLock Lock(&CriticalPcSection);
+
+	PrepareStartTime = FPlatformTime::Seconds();
+	bLocalDescriptionReady = false;
+	bViewSent = false;
+
+	// Timings of the recovery
+	if (bResetTimer)
+	{
+		ConnectionTimer->Reset();
+	}
+
+	// The observers were handed over to WebRTC by the previous negotiation
+	PeerConnection->ResetObservers();
+	BindRemoteDescriptionCallbacks();
+
+	PeerConnection->OaOptions.ice_restart = true;
+
+	TWeakObjectPtr<UMillicastSubscriberComponent> WeakThis(this);
+	const uint64 PreparedId = PeerConnection->GetId();
+	auto Timer = ConnectionTimer;
+
+#if MILLICAST_HAS_CXX20
+	PeerConnection->CreateLocalOffer([=, this]()
+#else
+	PeerConnection->CreateLocalOffer([=]()
+#endif
+	{
+		Timer->Mark(EMillicastConnectionStage::LocalDescriptionSet);
+
+#if MILLICAST_HAS_CXX20
+		AsyncGameThreadTaskWithCapture(WeakThis, [=, this]()
+#else
+		AsyncGameThreadTaskWithCapture(WeakThis, [=]()
+#endif
+		{
+			if (IsSamePeerConnection(PeerConnection, PreparedId))
+			{
+				PeerConnection->OaOptions.ice_restart = false;
+				OnLocalDescriptionReady();
+			}
+		});
+	},
+#if MILLICAST_HAS_CXX20
+	[=, this](const std::string& err)
+#else
+	[=](const std::string& err)
+#endif
+	{
+#if MILLICAST_HAS_CXX20
+		AsyncGameThreadTaskWithCapture(WeakThis, [=, this]()
+#else
+		AsyncGameThreadTaskWithCapture(WeakThis, [=]()
+#endif
+		{
+			if (!IsSamePeerConnection(PeerConnection, PreparedId))
+			{
+				return;
+			}
+
+			// Fall back to a new peerconnection, the tracks are recreated when subscribing
+			UE_LOG(LogMillicastPlayer, Warning, TEXT("Ice restart offer failed, creating a new peerconnection : %s"), *FString(err.c_str()));
+			ClosePeerConnection();
+			PrepareConnection();
+		});
+	},
+	[Timer]()
+	{
+		Timer->Mark(EMillicastConnectionStage::OfferCreated);
+	});
+}
+
+void UMillicastSubscriberComponent::SendViewCommand(Millicast::Player::FWebRTCPeerConnection* TargetPeerConnection, const TSharedPtr<IWebSocket>& Socket)
+{
+	UE_LOG(LogMillicastPlayer, Verbose, TEXT("%S"), __FUNCTION__);
+
+	FScopeLock Lock(&CriticalPcSection);
+	if (!TargetPeerConnection)
 	{
-		UE_LOG(LogMillicastPlayer, Error, TEXT("UMillicastSubscriberComponent disconnected without valid cached director component"));
 		return;
 	}
 
-	// Need to grab a new JWT so that the connection will succeed. Simply reconnecting the WS will not always work
-	CachedDirectorComponent->RetryAuthenticateWithDelay();
+	std::string sdp;
+	(*TargetPeerConnection)->local_description()->ToString(&sdp);
+
+	// Add events we want to receive from millicast
+	TArray<TSharedPtr<FJsonValue>> eventsJson;
+	for (const FString& ev : Millicast::Player::GetSignalingEventNames())
+	{
+		eventsJson.Add(MakeShared<FJsonValueString>(ev));
+	}
+
+	// Fill Signaling data
+	auto DataJson = MakeShared<FJsonObject>();
+	DataJson->SetStringField("streamId", MillicastMediaSource->StreamName);
+	DataJson->SetStringField("sdp", Millicast::Player::ToString(sdp));
+	DataJson->SetArrayField("events", eventsJson);
+
+	TWeakObjectPtr<UMillicastSubscriberComponent> WeakThis(this);
+	const uint64 TargetId = TargetPeerConnection->GetId();
+
+	SendCommand("view", DataJson, Socket, [WeakThis, TargetId](EMillicastCommandStatus Status, const Millicast::Player::FSignalingResponse* Response)
+	{
+		if (!WeakThis.IsValid())
+		{
+			return;
+		}
+
+		if (Response)
+		{
+			WeakThis->OnViewResponse(TargetId, *Response);
+		}
+		// Cancelled means the WebSocket was closed, which already went through OnClosed
+		else if (Status == EMillicastCommandStatus::Failed || Status == EMillicastCommandStatus::TimedOut)
+		{
+			WeakThis->OnViewFailed(TargetId, Status);
+		}
+	});
 }
 
-void UMillicastSubscriberComponent::OnMessage(const FString& Msg)
+void UMillicastSubscriberComponent::OnViewFailed(uint64 PeerConnectionId, EMillicastCommandStatus Status)
 {
+	const FString Reason = Status == EMillicastCommandStatus::TimedOut ? TEXT("The view command timed out") : TEXT("The view command was rejected");
+
 	FScopeLock Lock(&CriticalPcSection);
 
-	UE_LOG(LogMillicastPlayer, Log, TEXT("Millicast WebSocket new Message : %s"), *Msg);
+	if (IsSamePeerConnection(MigrationPeerConnection, PeerConnectionId))
+	{
+		AbortMigration(Reason);
+		return;
+	}
+
+	if (!IsSamePeerConnection(PeerConnection, PeerConnectionId))
+	{
+		return;
+	}
 
-	TSharedPtr<FJsonObject> ResponseJson;
-	auto Reader = TJsonReaderFactory<>::Create(Msg);
+	UE_LOG(LogMillicastPlayer, Error, TEXT("%s"), *Reason);
 
-	if (!FJsonSerializer::Deserialize(Reader, ResponseJson))
+	// The server may be stalled, closing the WebSocket goes through OnDisconnectedInternal, which reconnects
+	if (Status == EMillicastCommandStatus::TimedOut && bShouldReconnect && WS)
 	{
-		UE_LOG(LogMillicastPlayer, Error, TEXT("[UMillicastSubscriberComponent::OnMessage] Failed to deserialize"));
+		WS->Close();
 		return;
 	}
 
-	FString Type;
-	if (!ResponseJson->TryGetStringField("type", Type))
+	// Sending the same view again would be rejected again
+	Unsubscribe();
+
+	OnSubscribedFailure.Broadcast(Reason);
+}
+
+void UMillicastSubscriberComponent::OnViewResponse(uint64 PeerConnectionId, const Millicast::Player::FSignalingResponse& Response)
+{
+	UE_LOG(LogMillicastPlayer, Log, TEXT("Server Id : %s"), *Response.ServerId);
+	UE_LOG(LogMillicastPlayer, Log, TEXT("Cluster Id : %s"), *Response.ClusterId);
+
+	FScopeLock Lock(&CriticalPcSection);
+
+	// The peerconnection may have been replaced while the command was in flight
+	Millicast::Player::FWebRTCPeerConnection* TargetPeerConnection = nullptr;
+	if (IsSamePeerConnection(PeerConnection, PeerConnectionId))
+	{
+		TargetPeerConnection = PeerConnection;
+	}
+	else if (IsSamePeerConnection(MigrationPeerConnection, PeerConnectionId))
+	{
+		TargetPeerConnection = MigrationPeerConnection;
+	}
+
+	if (!TargetPeerConnection)
 	{
-		UE_LOG(LogMillicastPlayer, Error, TEXT("[UMillicastSubscriberComponent::OnMessage] Missing type field"));
+		UE_LOG(LogMillicastPlayer, Warning, TEXT("Ignoring the answer to the view command of a closed peerconnection"));
 		return;
 	}
 
-	auto* func = MessageParser.Find(Type);
-	if (!func)
+	if (Response.Sdp.IsEmpty())
 	{
-		UE_LOG(LogMillicastPlayer, Warning, TEXT("WebSocket response type not handled (yet?) %s"), *Type);
+		UE_LOG(LogMillicastPlayer, Error, TEXT("The answer to the view command has no sdp"));
 		return;
 	}
 
-	(*func)(ResponseJson);
+	if (TargetPeerConnection == PeerConnection)
+	{
+		ConnectionTimer->Mark(EMillicastConnectionStage::AnswerReceived);
+	}
+
+	TargetPeerConnection->SetRemoteDescription(Millicast::Player::to_string(Response.Sdp));
+	TargetPeerConnection->ServerId = Response.ServerId;
+	TargetPeerConnection->ClusterId = Response.ClusterId;
 }
 
-void UMillicastSubscriberComponent::SendCommand(const FString& Name, TSharedPtr<FJsonObject> Data)
+/* WebSocket Callback
+*****************************************************************************/
+
+void UMillicastSubscriberComponent::OnConnected()
 {
+	UE_LOG(LogMillicastPlayer, Log, TEXT("Millicast WebSocket Connected"));
+
+	WebSocketConnectedTime = FPlatformTime::Seconds();
+	ConnectionTimer->Mark(EMillicastConnectionStage::WebSocketConnected);
+	bWebSocketConnected = true;
+
+	TrySendView();
+}
+
+void UMillicastSubscriberComponent::OnConnectionError(const FString& Error)
+{
+	State = EMillicastSubscriberState::Disconnected;
+
+	UE_LOG(LogMillicastPlayer, Log, TEXT("Millicast WebSocket Connection error : %s"), *Error);
+
+	OnDisconnectedInternal(Error);
+}
+
+void UMillicastSubscriberComponent::OnClosed(int32 StatusCode,
+	const FString& Reason,
+	bool bWasClean)
+{
+	State = EMillicastSubscriberState::Disconnected;
+
+	UE_LOG(LogMillicastPlayer, Log, TEXT("Millicast WebSocket Closed"));
+
+	OnDisconnectedInternal(Reason);
+}
+
+void UMillicastSubscriberComponent::OnDisconnectedInternal(const FString& Reason)
+{
+	// The old server may close its connection before the new one sent a frame, switch right away if it can play
+	if (bMigrating)
+	{
+		if (bMigrationAnswerApplied)
+		{
+			CompleteMigration();
+			return;
+		}
+
+		AbortMigration(Reason);
+	}
+
+	OnDisconnected.Broadcast(Reason, bShouldReconnect);
+
+	if( !bShouldReconnect )
+	{
+		return;
+	}
+
+	if( !IsValid(CachedDirectorComponent) )
+	{
+		UE_LOG(LogMillicastPlayer, Error, TEXT("UMillicastSubscriberComponent disconnected without valid cached director component"));
+		return;
+	}
+
+	// The previous connection is dead once the WebSocket is closed, prepare the next offer during the retry delay,
+	// or the ice restart offer if the connection is kept. The migrate event keeps the current connection until the
+	// new subscription replaces it
+	if (State.Load() == EMillicastSubscriberState::Disconnected)
+	{
+		// A WebSocket that never connected means the cached token was rejected or its server is gone
+		const bool bWasConnected = bWebSocketConnected;
+		bWebSocketConnected = false;
+
+		if (bUseIceRestartRecovery && CanRestartIce())
+		{
+			UE_LOG(LogMillicastPlayer, Log, TEXT("Keeping the peerconnection, recovering with an ice restart"));
+			PrepareIceRestart();
+		}
+		else
+		{
+			ClosePeerConnection();
+			PrepareConnection();
+		}
+
+		// The token of the last subscription is usually still valid, reconnect right away with it
+		if (bWasConnected && CachedDirectorComponent->TryAuthenticateFromCache())
+		{
+			return;
+		}
+
+		if (!bWasConnected)
+		{
+			CachedDirectorComponent->InvalidateCachedSignalingData();
+		}
+	}
+
+	// Need to grab a new JWT so that the connection will succeed. Simply reconnecting the WS will not always work
+	CachedDirectorComponent->RetryAuthenticateWithDelay();
+}
+
+void UMillicastSubscriberComponent::OnMessage(const FString& Msg)
+{
+	// Logged by the parser, at a lower verbosity for the frequent events
+	SignalingQueue->Push(Msg);
+}
+
+void UMillicastSubscriberComponent::SendCommand(const FString& Name, TSharedPtr<FJsonObject> Data, TSharedPtr<IWebSocket> Socket,
+	TFunction<void(EMillicastCommandStatus, const Millicast::Player::FSignalingResponse*)> OnComplete)
+{
+	if (!Socket)
+	{
+		Socket = WS;
+	}
+
+	if (!Socket)
+	{
+		UE_LOG(LogMillicastPlayer, Warning, TEXT("Can not send command %s without a WebSocket"), *Name);
+		return;
+	}
+
+	const int32 TransId = SignalingTransactions->Add(Name, [this, Name, OnComplete = MoveTemp(OnComplete)](EMillicastCommandStatus Status, double RoundTripMs, const Millicast::Player::FSignalingResponse* Response)
+	{
+		UE_LOG(LogMillicastPlayer, Log, TEXT("Command %s %s after %.1f ms"), *Name, *UEnum::GetValueAsString(Status), RoundTripMs);
+
+		if (OnComplete)
+		{
+			OnComplete(Status, Response);
+		}
+
+		OnCommandCompleted.Broadcast(Name, Status, RoundTripMs);
+	});
+
 	auto Payload = MakeShared<FJsonObject>();
 	Payload->SetStringField("type", "cmd");
-	Payload->SetNumberField("transId", std::rand());
+	Payload->SetNumberField("transId", TransId);
 	Payload->SetStringField("name", *Name);
 	Payload->SetObjectField("data", Data);
 
@@ -679,142 +1629,544 @@ void UMillicastSubscriberComponent::SendCommand(const FString& Name, TSharedPtr<
 
 	UE_LOG(LogMillicastPlayer, Log, TEXT("Send command : %s \n Data : %s"), *Name, *StringStream);
 
-	if (WS)
+	Socket->Send(StringStream);
+
+	SetComponentTickEnabled(true);
+}
+
+void UMillicastSubscriberComponent::HandleSignalingMessage(const Millicast::Player::FSignalingResponse& Response)
+{
+	if (!SignalingTransactions->Complete(Response.TransId, EMillicastCommandStatus::Succeeded, &Response))
 	{
-		WS->Send(StringStream);
+		UE_LOG(LogMillicastPlayer, Warning, TEXT("Response to an unknown or timed out command, transId %d"), Response.TransId);
 	}
 }
 
-void UMillicastSubscriberComponent::ParseResponse(TSharedPtr<FJsonObject> JsonMsg)
+void UMillicastSubscriberComponent::HandleSignalingMessage(const Millicast::Player::FSignalingError& Error)
 {
-	const TSharedPtr<FJsonObject>* DataJson;
-	if (!JsonMsg->TryGetObjectField("data", DataJson))
+	UE_LOG(LogMillicastPlayer, Error, TEXT("WebSocket error : %s"), *Error.Message);
+
+	if (Error.TransId != 0)
 	{
-		return;
+		SignalingTransactions->Complete(Error.TransId, EMillicastCommandStatus::Failed);
 	}
+}
 
-	FString Sdp = (*DataJson)->GetStringField("sdp");
-	FString ServerId = (*DataJson)->GetStringField("subscriberId");
-	FString ClusterId = (*DataJson)->GetStringField("clusterId");
+void UMillicastSubscriberComponent::HandleSignalingMessage(const Millicast::Player::FSignalingActiveEvent& Event)
+{
+	OnActive.Broadcast(Event.StreamId, Event.Tracks, Event.SourceId);
+}
 
-	UE_LOG(LogMillicastPlayer, Log, TEXT("Server Id : %s"), *ServerId);
-	UE_LOG(LogMillicastPlayer, Log, TEXT("Cluster Id : %s"), *ClusterId);
+void UMillicastSubscriberComponent::HandleSignalingMessage(const Millicast::Player::FSignalingInactiveEvent& Event)
+{
+	OnInactive.Broadcast(Event.StreamId, Event.SourceId);
+}
 
-	PeerConnection->SetRemoteDescription(Millicast::Player::to_string(Sdp));
-	PeerConnection->ServerId = MoveTemp(ServerId);
-	PeerConnection->ClusterId = MoveTemp(ClusterId);
+void UMillicastSubscriberComponent::HandleSignalingMessage(const Millicast::Player::FSignalingStoppedEvent&)
+{
+	OnStopped.Broadcast();
 }
 
-void UMillicastSubscriberComponent::ParseError(TSharedPtr<FJsonObject> JsonMsg)
+void UMillicastSubscriberComponent::HandleSignalingMessage(const Millicast::Player::FSignalingVadEvent& Event)
 {
-	FString errorMessage;
-	auto dataJson = JsonMsg->TryGetStringField("data", errorMessage);
+	OnVad.Broadcast(Event.Mid, Event.SourceId);
+}
 
-	UE_LOG(LogMillicastPlayer, Error, TEXT("WebSocket error : %s"), *errorMessage);
+void UMillicastSubscriberComponent::HandleSignalingMessage(const Millicast::Player::FSignalingLayersEvent& Event)
+{
+	const TArray<FMillicastLayerData> InactiveLayers;
+	for (const auto& Media : Event.Medias)
+	{
+		LayersByMid.Add(Media.Key, Media.Value);
+		OnLayers.Broadcast(Media.Key, Media.Value, InactiveLayers);
+	}
+
+	// The layers available to the reduced tiers or under the bitrate cap may have changed
+	ApplySubscriptionTier();
 }
 
-void UMillicastSubscriberComponent::ParseEvent(TSharedPtr<FJsonObject> JsonMsg)
+void UMillicastSubscriberComponent::HandleSignalingMessage(const Millicast::Player::FSignalingViewerCountEvent& Event)
 {
-	FString eventName;
-	JsonMsg->TryGetStringField("name", eventName);
+	OnViewerCount.Broadcast(Event.Count);
+}
+
+void UMillicastSubscriberComponent::HandleSignalingMessage(const Millicast::Player::FSignalingMigrateEvent&)
+{
+	if (bMigrating)
+	{
+		return;
+	}
+
+	if (!IsValid(CachedDirectorComponent))
+	{
+		bShouldReconnect = true;
+		OnDisconnectedInternal("Received migrate event");
+		return;
+	}
 
-	UE_LOG(LogMillicastPlayer, Log, TEXT("Received event : %s"), *eventName);
+	UE_LOG(LogMillicastPlayer, Log, TEXT("Received migrate event, connecting to the new server before leaving the current one"));
 
-	EventBroadcaster[eventName](JsonMsg);
+	bMigrating = true;
+	MigrationStartTime = FPlatformTime::Seconds();
+	SetComponentTickEnabled(true);
+
+	// The cached signaling data points to the server we are asked to leave.
+	// The director response goes through OnAuthenticated to Subscribe, which starts the migration
+	CachedDirectorComponent->OnAuthenticationFailure.AddUniqueDynamic(this, &UMillicastSubscriberComponent::OnMigrationAuthenticationFailure);
+	CachedDirectorComponent->InvalidateCachedSignalingData();
+	if (!CachedDirectorComponent->Authenticate())
+	{
+		AbortMigration(TEXT("Could not request the signaling data of the new server"));
+	}
 }
 
-void UMillicastSubscriberComponent::ParseActiveEvent(TSharedPtr<FJsonObject> JsonMsg)
+void UMillicastSubscriberComponent::OnMigrationAuthenticationFailure(int32 Code, const FString& Msg)
 {
-	auto DataJson = JsonMsg->GetObjectField("data");
+	AbortMigration(FString::Printf(TEXT("Director request failed with code %d : %s"), Code, *Msg));
+}
 
-	FString StreamId = DataJson->GetStringField("streamId");
-	FString SourceId;
-	TArray<FMillicastTrackInfo> Tracks;
-	const TArray<TSharedPtr<FJsonValue>>* TracksJson;
+void UMillicastSubscriberComponent::UnbindMigrationAuthentication()
+{
+	if (IsValid(CachedDirectorComponent))
+	{
+		CachedDirectorComponent->OnAuthenticationFailure.RemoveDynamic(this, &UMillicastSubscriberComponent::OnMigrationAuthenticationFailure);
+	}
+}
 
-	DataJson->TryGetStringField("sourceId", SourceId);
+/* Migration
+*****************************************************************************/
 
-	if (DataJson->TryGetArrayField("tracks", TracksJson))
+namespace
+{
+	// The socket may be the one whose callback we are in, keep it alive until that callback returned
+	void ReleaseWebSocketLater(TSharedPtr<IWebSocket> Socket)
 	{
-		for (auto& t : *TracksJson)
-		{
-			FMillicastTrackInfo TrackInfo;
-			TrackInfo.Media = t->AsObject()->GetStringField("media");
-			TrackInfo.TrackId = t->AsObject()->GetStringField("trackId");
+		AsyncGameThreadTaskUnguarded([Socket]() {});
+	}
+}
+
+namespace Millicast::Player
+{
+	/** Calls back once, on the first decoded frame of the track it is attached to */
+	class FFirstFrameSink : public rtc::VideoSinkInterface<webrtc::VideoFrame>
+	{
+	public:
+		explicit FFirstFrameSink(TFunction<void()> InCallback)
+			: Callback(MoveTemp(InCallback))
+		{}
 
-			Tracks.Emplace(MoveTemp(TrackInfo));
+		void OnFrame(const webrtc::VideoFrame&) override
+		{
+			if (!bReceived.Exchange(true))
+			{
+				Callback();
+			}
 		}
+
+		bool HasReceived() const { return bReceived; }
+
+	private:
+		TFunction<void()> Callback;
+		TAtomic<bool> bReceived{ false };
+	};
+}
+
+bool UMillicastSubscriberComponent::StartMigration(const FMillicastSignalingData& SignalingData)
+{
+	using namespace Millicast::Player;
+	UE_LOG(LogMillicastPlayer, Verbose, TEXT("%S"), __FUNCTION__);
+
+	FScopeLock Lock(&CriticalPcSection);
+
+	if (MigrationPeerConnection)
+	{
+		return false;
+	}
+
+	PeerConnectionConfig.servers.clear();
+	for (auto& s : SignalingData.IceServers)
+	{
+		PeerConnectionConfig.servers.push_back(s);
 	}
 
-	OnActive.Broadcast(StreamId, Tracks, SourceId);
+	UpdateLatencyConfig();
+
+	MigrationPeerConnection = FWebRTCPeerConnection::Create(PeerConnectionConfig, static_cast<int32>(AudioPullPeriod));
+	if (!MigrationPeerConnection)
+	{
+		AbortMigration(TEXT("Could not create peerconnection"));
+		return false;
+	}
+
+	MigrationPeerConnection->VideoCodecPreferences = PreferredVideoCodecs;
+	MigrationPeerConnection->AddRecvOnlyTransceivers();
+	MigrationPeerConnection->OaOptions.offer_to_receive_video = true;
+	MigrationPeerConnection->OaOptions.offer_to_receive_audio = true;
+
+	// Must be set before the tracks are received
+	MigrationPeerConnection->EnableFrameTransformer(bUseFrameTransformer);
+	ApplyLatencySettings(MigrationPeerConnection);
+	ApplyReceiveBitrateCap(MigrationPeerConnection);
+
+	BindMigrationCallbacks();
+
+	TWeakObjectPtr<UMillicastSubscriberComponent> WeakThis(this);
+	const uint64 PreparedId = MigrationPeerConnection->GetId();
+
+#if MILLICAST_HAS_CXX20
+	MigrationPeerConnection->CreateLocalOffer([=, this]()
+#else
+	MigrationPeerConnection->CreateLocalOffer([=]()
+#endif
+	{
+#if MILLICAST_HAS_CXX20
+		AsyncGameThreadTaskWithCapture(WeakThis, [=, this]()
+#else
+		AsyncGameThreadTaskWithCapture(WeakThis, [=]()
+#endif
+		{
+			if (IsSamePeerConnection(MigrationPeerConnection, PreparedId))
+			{
+				bMigrationLocalDescriptionReady = true;
+				TrySendMigrationView();
+			}
+		});
+	},
+#if MILLICAST_HAS_CXX20
+	[=, this](const std::string& err)
+#else
+	[=](const std::string& err)
+#endif
+	{
+#if MILLICAST_HAS_CXX20
+		AsyncGameThreadTaskWithCapture(WeakThis, [=, this]()
+#else
+		AsyncGameThreadTaskWithCapture(WeakThis, [=]()
+#endif
+		{
+			if (IsSamePeerConnection(MigrationPeerConnection, PreparedId))
+			{
+				AbortMigration(FString{ err.c_str() });
+			}
+		});
+	});
+
+	MigrationWS = CreateWebSocket(SignalingData.WsUrl, SignalingData.Jwt);
+	MigrationWS->OnConnected().AddWeakLambda(this, [this]()
+	{
+		bMigrationWebSocketConnected = true;
+		TrySendMigrationView();
+	});
+	MigrationWS->OnConnectionError().AddWeakLambda(this, [this](const FString& Error) { AbortMigration(Error); });
+	MigrationWS->OnClosed().AddWeakLambda(this, [this](int32, const FString& Reason, bool) { AbortMigration(Reason); });
+	MigrationWS->OnMessage().AddWeakLambda(this, [this](const FString& Msg) { OnMigrationMessage(Msg); });
+
+	MigrationWS->Connect();
+	return true;
 }
 
-void UMillicastSubscriberComponent::ParseInactiveEvent(TSharedPtr<FJsonObject> JsonMsg)
+void UMillicastSubscriberComponent::BindMigrationCallbacks()
 {
-	auto DataJson = JsonMsg->GetObjectField("data");
+	using namespace Millicast::Player;
+
+	TWeakObjectPtr<UMillicastSubscriberComponent> WeakThis(this);
+	const uint64 PreparedId = MigrationPeerConnection->GetId();
+
+	auto* RemoteDescriptionObserver = MigrationPeerConnection->GetRemoteDescriptionObserver();
+
+#if MILLICAST_HAS_CXX20
+	RemoteDescriptionObserver->SetOnSuccessCallback([=, this]()
+#else
+	RemoteDescriptionObserver->SetOnSuccessCallback([=]()
+#endif
+	{
+#if MILLICAST_HAS_CXX20
+		AsyncGameThreadTaskWithCapture(WeakThis, [=, this]()
+#else
+		AsyncGameThreadTaskWithCapture(WeakThis, [=]()
+#endif
+		{
+			if (!IsSamePeerConnection(MigrationPeerConnection, PreparedId))
+			{
+				return;
+			}
 
-	FString StreamId = DataJson->GetStringField("streamId");
-	FString SourceId;
-	DataJson->TryGetStringField("sourceId", SourceId);
+			bMigrationAnswerApplied = true;
 
-	OnInactive.Broadcast(StreamId, SourceId);
+			// The tracks were received while applying the answer. Without video there is no frame to wait for, and the
+			// first frame may have been decoded before this task ran
+			if (MigrationVideoTracks.Num() == 0 || (MigrationFrameSink && MigrationFrameSink->HasReceived()))
+			{
+				CompleteMigration();
+			}
+		});
+	});
+
+#if MILLICAST_HAS_CXX20
+	RemoteDescriptionObserver->SetOnFailureCallback([=, this](const std::string& err)
+#else
+	RemoteDescriptionObserver->SetOnFailureCallback([=](const std::string& err)
+#endif
+	{
+#if MILLICAST_HAS_CXX20
+		AsyncGameThreadTaskWithCapture(WeakThis, [=, this]()
+#else
+		AsyncGameThreadTaskWithCapture(WeakThis, [=]()
+#endif
+		{
+			if (IsSamePeerConnection(MigrationPeerConnection, PreparedId))
+			{
+				AbortMigration(FString{ err.c_str() });
+			}
+		});
+	});
+
+	using RtcTrack = rtc::scoped_refptr<webrtc::MediaStreamTrackInterface>;
+
+#if MILLICAST_HAS_CXX20
+	MigrationPeerConnection->OnVideoTrack = [=, this](const std::string& Mid, RtcTrack Track)
+#else
+	MigrationPeerConnection->OnVideoTrack = [=](const std::string& Mid, RtcTrack Track)
+#endif
+	{
+#if MILLICAST_HAS_CXX20
+		AsyncGameThreadTaskWithCapture(WeakThis, [=, this]()
+#else
+		AsyncGameThreadTaskWithCapture(WeakThis, [=]()
+#endif
+		{
+			if (!IsSamePeerConnection(MigrationPeerConnection, PreparedId))
+			{
+				return;
+			}
+
+			MigrationVideoTracks.Emplace(FString(Mid.c_str()), Track);
+
+			// Switch on the first decoded frame, which follows a key frame, so the consumers never see a broken picture
+			if (!MigrationFrameSink)
+			{
+				MigrationFrameSink = MakeShared<FFirstFrameSink, ESPMode::ThreadSafe>([WeakThis, PreparedId]()
+				{
+					AsyncGameThreadTaskWithCapture(WeakThis, [WeakThis, PreparedId]()
+					{
+						// The migration may have been aborted, or replaced by a new one, while the task was queued
+						if (IsSamePeerConnection(WeakThis->MigrationPeerConnection, PreparedId))
+						{
+							WeakThis->CompleteMigration();
+						}
+					});
+				});
+
+				static_cast<webrtc::VideoTrackInterface*>(Track.get())->AddOrUpdateSink(MigrationFrameSink.Get(), rtc::VideoSinkWants{});
+			}
+		});
+	};
+
+#if MILLICAST_HAS_CXX20
+	MigrationPeerConnection->OnAudioTrack = [=, this](const std::string& Mid, RtcTrack Track)
+#else
+	MigrationPeerConnection->OnAudioTrack = [=](const std::string& Mid, RtcTrack Track)
+#endif
+	{
+#if MILLICAST_HAS_CXX20
+		AsyncGameThreadTaskWithCapture(WeakThis, [=, this]()
+#else
+		AsyncGameThreadTaskWithCapture(WeakThis, [=]()
+#endif
+		{
+			if (IsSamePeerConnection(MigrationPeerConnection, PreparedId))
+			{
+				MigrationAudioTracks.Emplace(FString(Mid.c_str()), Track);
+			}
+		});
+	};
 }
 
-void UMillicastSubscriberComponent::ParseStoppedEvent(TSharedPtr<FJsonObject>)
+void UMillicastSubscriberComponent::TrySendMigrationView()
 {
-	OnStopped.Broadcast();
+	if (bMigrationViewSent || !bMigrationWebSocketConnected || !bMigrationLocalDescriptionReady)
+	{
+		return;
+	}
+
+	bMigrationViewSent = true;
+	SendViewCommand(MigrationPeerConnection, MigrationWS);
 }
 
-void UMillicastSubscriberComponent::ParseVadEvent(TSharedPtr<FJsonObject> JsonMsg)
+void UMillicastSubscriberComponent::OnMigrationMessage(const FString& Msg)
 {
-	auto DataJson = JsonMsg->GetObjectField("data");
+	MigrationSignalingQueue->Push(Msg);
+}
 
-	FString Mid = DataJson->GetStringField("mediaId");
-	FString SourceId;
-	DataJson->TryGetStringField("sourceId", SourceId);
+void UMillicastSubscriberComponent::DetachMigrationFrameSink()
+{
+	if (MigrationFrameSink && MigrationVideoTracks.Num() > 0)
+	{
+		static_cast<webrtc::VideoTrackInterface*>(MigrationVideoTracks[0].Value.get())->RemoveSink(MigrationFrameSink.Get());
+	}
 
-	OnVad.Broadcast(Mid, SourceId);
+	MigrationFrameSink = nullptr;
 }
 
-void UMillicastSubscriberComponent::ParseLayersEvent(TSharedPtr<FJsonObject> JsonMsg)
+void UMillicastSubscriberComponent::CompleteMigration()
 {
-	auto DataJson = JsonMsg->GetObjectField("data");
-	auto MediaJson = DataJson->GetObjectField("medias");
+	// Playing the new connection needs its answer, a frame decoded before the answer is applied waits for it
+	if (!bMigrating || !MigrationPeerConnection || !bMigrationAnswerApplied)
+	{
+		return;
+	}
+
+	FScopeLock Lock(&CriticalPcSection);
 
-	for (auto& it : MediaJson->Values)
+	DetachMigrationFrameSink();
+
+	// Hand the new WebRTC tracks over to the track objects with the same mid, their consumers and textures are kept
+	TArray<UMillicastVideoTrack*> NewVideoTracks;
+	for (const auto& Pair : MigrationVideoTracks)
 	{
-		TArray<FMillicastLayerData> ActiveLayers;
-		TArray<FMillicastLayerData> InactiveLayers;
+		auto* Existing = VideoTracks.FindByPredicate([&Pair](UMillicastVideoTrack* Track) { return Track->GetMid() == Pair.Key; });
+		if (Existing)
+		{
+			static_cast<UMillicastVideoTrackImpl*>(*Existing)->ReplaceTrack(Pair.Value);
+			NewVideoTracks.Add(*Existing);
+			continue;
+		}
 
-		const TArray<TSharedPtr<FJsonValue>>* layers;
-		if (it.Value->AsObject()->TryGetArrayField("layers", layers))
+		CreateVideoTrack(Pair.Key, Pair.Value);
+		NewVideoTracks.Add(VideoTracks.Last());
+	}
+
+	const auto AudioDeviceModule = MigrationPeerConnection->GetAudioDeviceModule();
+
+	TArray<UMillicastAudioTrack*> NewAudioTracks;
+	for (const auto& Pair : MigrationAudioTracks)
+	{
+		auto* Existing = AudioTracks.FindByPredicate([&Pair](UMillicastAudioTrack* Track) { return Track->GetMid() == Pair.Key; });
+		if (Existing)
 		{
-			for (auto& l : *layers)
-			{
-				FMillicastLayerData data;
-				data.EncodingId = l->AsObject()->GetStringField("encodingId");
-				data.TemporalLayerId = l->AsObject()->GetIntegerField("temporalLayerId");
-				data.SpatialLayerId = l->AsObject()->GetIntegerField("spatialLayerId");
+			static_cast<UMillicastAudioTrackImpl*>(*Existing)->ReplaceTrack(Pair.Value, AudioDeviceModule);
+			NewAudioTracks.Add(*Existing);
+			continue;
+		}
 
-				ActiveLayers.Push(MoveTemp(data));
-			}
+		CreateAudioTrack(Pair.Key, Pair.Value, AudioDeviceModule);
+		NewAudioTracks.Add(AudioTracks.Last());
+	}
+
+	// Tracks the new server did not negotiate
+	for (auto* Track : VideoTracks)
+	{
+		if (!NewVideoTracks.Contains(Track))
+		{
+			static_cast<UMillicastVideoTrackImpl*>(Track)->Terminate();
+		}
+	}
+
+	for (auto* Track : AudioTracks)
+	{
+		if (!NewAudioTracks.Contains(Track))
+		{
+			static_cast<UMillicastAudioTrackImpl*>(Track)->Terminate();
 		}
+	}
+
+	VideoTracks = MoveTemp(NewVideoTracks);
+	AudioTracks = MoveTemp(NewAudioTracks);
 
-		OnLayers.Broadcast(it.Key, ActiveLayers, InactiveLayers);
+	// Projections are not carried over to the new server, only the main tracks are left
+	ResetTransceiverPool();
+	LayersByMid.Empty();
+	SelectedLayer.Reset();
+	for (auto* Track : VideoTracks)
+	{
+		RemoteTrackMedia.Add(Track->GetMid(), TEXT("video"));
+	}
+	for (auto* Track : AudioTracks)
+	{
+		RemoteTrackMedia.Add(Track->GetMid(), TEXT("audio"));
 	}
+
+	// Break the old connection, without going through the reconnection logic
+	if (WS)
+	{
+		UnbindWebSocketCallbacks(WS);
+		WS->Close();
+		ReleaseWebSocketLater(MoveTemp(WS));
+	}
+
+	delete PeerConnection;
+
+	WS = MigrationWS;
+	UnbindWebSocketCallbacks(WS);
+	BindWebSocketCallbacks();
+
+	PeerConnection = MigrationPeerConnection;
+
+	// The observers were consumed by the negotiation
+	PeerConnection->ResetObservers();
+	BindPeerConnectionCallbacks();
+
+	MigrationWS = nullptr;
+	MigrationPeerConnection = nullptr;
+	MigrationVideoTracks.Empty();
+	MigrationAudioTracks.Empty();
+
+	LastMigrationDurationMs = (FPlatformTime::Seconds() - MigrationStartTime) * 1000.0;
+	UE_LOG(LogMillicastPlayer, Log, TEXT("Migration done in %.1f ms"), LastMigrationDurationMs);
+
+	bMigrating = false;
+	UnbindMigrationAuthentication();
+	bMigrationWebSocketConnected = false;
+	bMigrationLocalDescriptionReady = false;
+	bMigrationViewSent = false;
+	bMigrationAnswerApplied = false;
+
+	bWebSocketConnected = true;
+	bLocalDescriptionReady = true;
+	bViewSent = true;
+	State = EMillicastSubscriberState::Connected;
 }
 
-void UMillicastSubscriberComponent::ParseViewerCountEvent(TSharedPtr<FJsonObject> JsonMsg)
+void UMillicastSubscriberComponent::AbortMigration(const FString& Reason)
 {
-	auto DataJson = JsonMsg->GetObjectField("data");
+	if (!bMigrating)
+	{
+		return;
+	}
 
-	int Count = DataJson->GetIntegerField("viewercount");
+	UE_LOG(LogMillicastPlayer, Warning, TEXT("Migration aborted, keeping the current connection : %s"), *Reason);
+
+	FScopeLock Lock(&CriticalPcSection);
 
-	OnViewerCount.Broadcast(Count);
+	DetachMigrationFrameSink();
+	MigrationVideoTracks.Empty();
+	MigrationAudioTracks.Empty();
+
+	if (MigrationWS)
+	{
+		UnbindWebSocketCallbacks(MigrationWS);
+		MigrationWS->Close();
+		ReleaseWebSocketLater(MoveTemp(MigrationWS));
+	}
+
+	delete MigrationPeerConnection;
+	MigrationPeerConnection = nullptr;
+
+	bMigrating = false;
+	UnbindMigrationAuthentication();
+	bMigrationWebSocketConnected = false;
+	bMigrationLocalDescriptionReady = false;
+	bMigrationViewSent = false;
+	bMigrationAnswerApplied = false;
 }
 
-void UMillicastSubscriberComponent::ParseMigrateEvent(TSharedPtr<FJsonObject> JsonMsg)
+float UMillicastSubscriberComponent::GetLastMigrationGapMs() const
 {
-	bShouldReconnect = true;
-	OnDisconnectedInternal("Received migrate event");
+	float GapMs = -1.f;
+	for (auto* Track : VideoTracks)
+	{
+		GapMs = FMath::Max(GapMs, static_cast<UMillicastVideoTrackImpl*>(Track)->GetLastSwitchGapMs());
+	}
+
+	return GapMs;
 }
\ No newline at end of file
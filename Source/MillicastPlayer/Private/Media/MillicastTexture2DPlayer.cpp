@@ -61,10 +61,21 @@ void UMillicastTexture2DPlayer::OnFrame(TArray<uint8>& VideoData, int Width, int
 		// Set the Pixel data of the webrtc Frame to the SourceTexture
 		RHIUpdateTexture2D(SourceTexture, 0, Region, Width * 4, VideoData.GetData());
 
+		if (ConnectionTimer)
+		{
+			ConnectionTimer->Mark(EMillicastConnectionStage::FirstTextureUpload);
+		}
+
 		VideoTexture->UpdateTextureReference(RHICmdList, (FTexture2DRHIRef&)SourceTexture);
 	});
 }
 
+void UMillicastTexture2DPlayer::SetConnectionTimer(TSharedPtr<FMillicastConnectionTimer, ESPMode::ThreadSafe> InConnectionTimer)
+{
+	FScopeLock Lock(&RenderSyncContext);
+	ConnectionTimer = MoveTemp(InConnectionTimer);
+}
+
 FIntPoint UMillicastTexture2DPlayer::GetCurrentResolution()
 {
 	return CachedResolution;
@@ -0,0 +1,128 @@
+// Copyright Millicast 2023. All Rights Reserved.
+
+#include "MillicastConnectionTimings.h"
+
+#include "MillicastPlayerPrivate.h"
+#include "ProfilingDebugging/CsvProfiler.h"
+#include "ProfilingDebugging/MiscTrace.h"
+
+CSV_DEFINE_CATEGORY(Millicast_Connection, false);
+
+namespace
+{
+	const ANSICHAR* const StageNames[] =
+	{
+		"DirectorRequestStart",
+		"DirectorRequestEnd",
+		"Subscribe",
+		"WebSocketConnected",
+		"OfferCreated",
+		"LocalDescriptionSet",
+		"ViewSent",
+		"AnswerReceived",
+		"IceConnected",
+		"FirstRtpPacket",
+		"FirstDecodedFrame",
+		"FirstConsumerFrame",
+		"FirstTextureUpload",
+	};
+
+	static_assert(UE_ARRAY_COUNT(StageNames) == static_cast<int32>(EMillicastConnectionStage::Count), "Missing connection stage name");
+}
+
+FMillicastConnectionTimer::FMillicastConnectionTimer()
+{
+	Reset();
+}
+
+void FMillicastConnectionTimer::Reset()
+{
+	for (auto& Cycles : StageCycles)
+	{
+		Cycles = 0;
+	}
+}
+
+void FMillicastConnectionTimer::Mark(EMillicastConnectionStage Stage)
+{
+	MarkAt(Stage, FPlatformTime::Cycles64());
+}
+
+void FMillicastConnectionTimer::MarkAt(EMillicastConnectionStage Stage, uint64 Cycles)
+{
+	if (Cycles == 0)
+	{
+		return;
+	}
+
+	// Only the first time a stage is reached counts
+	uint64 Expected = 0;
+	if (!StageCycles[static_cast<int32>(Stage)].CompareExchange(Expected, Cycles))
+	{
+		return;
+	}
+
+	const ANSICHAR* StageName = StageNames[static_cast<int32>(Stage)];
+	const float StageMs = GetStageMs(Stage, GetOriginCycles());
+
+	UE_LOG(LogMillicastPlayer, Log, TEXT("Connection stage %S reached at %.1f ms"), StageName, StageMs);
+
+	TRACE_BOOKMARK(TEXT("Millicast %s"), ANSI_TO_TCHAR(StageName));
+
+#if CSV_PROFILER
+	FCsvProfiler::RecordCustomStat(StageName, CSV_CATEGORY_INDEX(Millicast_Connection), StageMs, ECsvCustomStatOp::Set);
+#endif
+}
+
+bool FMillicastConnectionTimer::HasReached(EMillicastConnectionStage Stage) const
+{
+	return StageCycles[static_cast<int32>(Stage)].Load() != 0;
+}
+
+uint64 FMillicastConnectionTimer::GetOriginCycles() const
+{
+	uint64 Origin = 0;
+	for (const auto& Cycles : StageCycles)
+	{
+		const uint64 Value = Cycles.Load();
+		if (Value != 0 && (Origin == 0 || Value < Origin))
+		{
+			Origin = Value;
+		}
+	}
+
+	return Origin;
+}
+
+float FMillicastConnectionTimer::GetStageMs(EMillicastConnectionStage Stage, uint64 OriginCycles) const
+{
+	const uint64 Cycles = StageCycles[static_cast<int32>(Stage)].Load();
+	if (Cycles == 0)
+	{
+		return -1.f;
+	}
+
+	return FPlatformTime::ToMilliseconds64(Cycles - OriginCycles);
+}
+
+FMillicastConnectionTimings FMillicastConnectionTimer::GetTimings() const
+{
+	const uint64 Origin = GetOriginCycles();
+
+	FMillicastConnectionTimings Timings;
+	Timings.DirectorRequestStart = GetStageMs(EMillicastConnectionStage::DirectorRequestStart, Origin);
+	Timings.DirectorRequestEnd = GetStageMs(EMillicastConnectionStage::DirectorRequestEnd, Origin);
+	Timings.Subscribe = GetStageMs(EMillicastConnectionStage::Subscribe, Origin);
+	Timings.WebSocketConnected = GetStageMs(EMillicastConnectionStage::WebSocketConnected, Origin);
+	Timings.OfferCreated = GetStageMs(EMillicastConnectionStage::OfferCreated, Origin);
+	Timings.LocalDescriptionSet = GetStageMs(EMillicastConnectionStage::LocalDescriptionSet, Origin);
+	Timings.ViewSent = GetStageMs(EMillicastConnectionStage::ViewSent, Origin);
+	Timings.AnswerReceived = GetStageMs(EMillicastConnectionStage::AnswerReceived, Origin);
+	Timings.IceConnected = GetStageMs(EMillicastConnectionStage::IceConnected, Origin);
+	Timings.FirstRtpPacket = GetStageMs(EMillicastConnectionStage::FirstRtpPacket, Origin);
+	Timings.FirstDecodedFrame = GetStageMs(EMillicastConnectionStage::FirstDecodedFrame, Origin);
+	Timings.FirstConsumerFrame = GetStageMs(EMillicastConnectionStage::FirstConsumerFrame, Origin);
+	Timings.FirstTextureUpload = GetStageMs(EMillicastConnectionStage::FirstTextureUpload, Origin);
+
+	return Timings;
+}
@@ -0,0 +1,438 @@
+// Copyright Millicast 2023. All Rights Reserved.
+
+#include "MillicastSignalingFastPath.h"
+
+namespace
+{
+	using namespace Millicast::Player;
+
+	template<typename TInteger>
+	bool ParseInteger(FStringView Text, TInteger& OutValue)
+	{
+		const TCHAR* It = Text.GetData();
+		const TCHAR* TextEnd = It + Text.Len();
+		const bool bNegative = It < TextEnd && *It == '-';
+		It += bNegative ? 1 : 0;
+
+		if (It == TextEnd)
+		{
+			return false;
+		}
+
+		// Negative values are accumulated as negative, the minimum has no positive counterpart
+		TInteger Result = 0;
+		for (; It < TextEnd; ++It)
+		{
+			if (!FChar::IsDigit(*It))
+			{
+				return false;
+			}
+
+			// Checked before the multiplication, which must not overflow
+			const TInteger Digit = *It - '0';
+			if (bNegative ? Result < (TNumericLimits<TInteger>::Min() + Digit) / 10 : Result > (TNumericLimits<TInteger>::Max() - Digit) / 10)
+			{
+				return false;
+			}
+
+			Result = Result * 10 + (bNegative ? -Digit : Digit);
+		}
+
+		OutValue = Result;
+		return true;
+	}
+
+	/** Pull reader over the message text. Tokens are views into the text, strings with escapes are left to the Json module */
+	class FJsonPullReader
+	{
+	public:
+		enum class EToken : uint8
+		{
+			ObjectStart,
+			ObjectEnd,
+			ArrayStart,
+			ArrayEnd,
+			String,
+			Number,
+			Literal,
+			End,
+			Error
+		};
+
+		explicit FJsonPullReader(const FString& Text)
+			: Current(*Text)
+			, End(*Text + Text.Len())
+		{
+		}
+
+		EToken Next()
+		{
+			// Separators carry no information for the shapes we read, keys and values alternate in objects
+			while (Current < End && (FChar::IsWhitespace(*Current) || *Current == ':' || *Current == ','))
+			{
+				++Current;
+			}
+
+			if (Current == End)
+			{
+				return EToken::End;
+			}
+
+			switch (*Current++)
+			{
+			case '{': return EToken::ObjectStart;
+			case '}': return EToken::ObjectEnd;
+			case '[': return EToken::ArrayStart;
+			case ']': return EToken::ArrayEnd;
+			case '"': return ReadString();
+			default: --Current; return ReadScalar();
+			}
+		}
+
+		FStringView GetValue() const { return Value; }
+
+		/** Value of the last number token, if it is an integer */
+		bool GetInteger(int32& OutValue) const
+		{
+			return ParseInteger(Value, OutValue);
+		}
+
+		/** Skip the value starting with this token, with its nested objects and arrays */
+		bool SkipValue(EToken Token)
+		{
+			int32 Depth = 0;
+			for (;;)
+			{
+				switch (Token)
+				{
+				case EToken::ObjectStart:
+				case EToken::ArrayStart:
+					++Depth;
+					break;
+				case EToken::ObjectEnd:
+				case EToken::ArrayEnd:
+					--Depth;
+					break;
+				case EToken::End:
+				case EToken::Error:
+					return false;
+				default:
+					break;
+				}
+
+				if (Depth <= 0)
+				{
+					return Depth == 0;
+				}
+
+				Token = Next();
+			}
+		}
+
+	private:
+		EToken ReadString()
+		{
+			const TCHAR* Start = Current;
+			while (Current < End && *Current != '"')
+			{
+				if (*Current == '\\')
+				{
+					return EToken::Error;
+				}
+
+				++Current;
+			}
+
+			if (Current == End)
+			{
+				return EToken::Error;
+			}
+
+			Value = FStringView(Start, static_cast<int32>(Current - Start));
+			++Current;
+			return EToken::String;
+		}
+
+		EToken ReadScalar()
+		{
+			const TCHAR* Start = Current;
+			while (Current < End && (FChar::IsAlnum(*Current) || *Current == '-' || *Current == '+' || *Current == '.'))
+			{
+				++Current;
+			}
+
+			Value = FStringView(Start, static_cast<int32>(Current - Start));
+			if (Value.Len() == 0)
+			{
+				return EToken::Error;
+			}
+
+			return (FChar::IsDigit(Value[0]) || Value[0] == '-') ? EToken::Number : EToken::Literal;
+		}
+
+		const TCHAR* Current;
+		const TCHAR* End;
+		FStringView Value;
+	};
+
+	using EToken = FJsonPullReader::EToken;
+
+	template<int32 N>
+	bool IsKey(FStringView Key, const TCHAR (&Name)[N])
+	{
+		return Key.Len() == N - 1 && FCString::Strncmp(Key.GetData(), Name, N - 1) == 0;
+	}
+
+	void AssignString(FString& Out, FStringView Value, int32& NumAllocations)
+	{
+		if (Value.Len() > 0)
+		{
+			Out = FString(Value.Len(), Value.GetData());
+			++NumAllocations;
+		}
+	}
+
+	template<typename TElement>
+	TElement& AddCounted(TArray<TElement>& Array, int32& NumAllocations)
+	{
+		const int32 PreviousMax = Array.Max();
+		TElement& Element = Array.AddDefaulted_GetRef();
+		NumAllocations += Array.Max() != PreviousMax ? 1 : 0;
+		return Element;
+	}
+
+	/** Call ReadField for each key of the object whose start token has just been read, until the end token */
+	template<typename TReadField>
+	bool ReadObject(FJsonPullReader& Reader, TReadField&& ReadField)
+	{
+		for (;;)
+		{
+			EToken Token = Reader.Next();
+			if (Token == EToken::ObjectEnd)
+			{
+				return true;
+			}
+
+			if (Token != EToken::String)
+			{
+				return false;
+			}
+
+			const FStringView Key = Reader.GetValue();
+			if (!ReadField(Key, Reader.Next()))
+			{
+				return false;
+			}
+		}
+	}
+
+	bool ReadVad(FJsonPullReader& Reader, FSignalingVadEvent& Event, int32& NumAllocations)
+	{
+		return ReadObject(Reader, [&](FStringView Key, EToken Token)
+		{
+			if (IsKey(Key, TEXT("mediaId")) && Token == EToken::String)
+			{
+				AssignString(Event.Mid, Reader.GetValue(), NumAllocations);
+				return true;
+			}
+
+			if (IsKey(Key, TEXT("sourceId")) && Token == EToken::String)
+			{
+				AssignString(Event.SourceId, Reader.GetValue(), NumAllocations);
+				return true;
+			}
+
+			return Reader.SkipValue(Token);
+		});
+	}
+
+	bool ReadViewerCount(FJsonPullReader& Reader, FSignalingViewerCountEvent& Event)
+	{
+		return ReadObject(Reader, [&](FStringView Key, EToken Token)
+		{
+			if (IsKey(Key, TEXT("viewercount")))
+			{
+				return Token == EToken::Number && Reader.GetInteger(Event.Count);
+			}
+
+			return Reader.SkipValue(Token);
+		});
+	}
+
+	bool ReadLayer(FJsonPullReader& Reader, FMillicastLayerData& Layer, int32& NumAllocations)
+	{
+		return ReadObject(Reader, [&](FStringView Key, EToken Token)
+		{
+			if (IsKey(Key, TEXT("encodingId")) && Token == EToken::String)
+			{
+				AssignString(Layer.EncodingId, Reader.GetValue(), NumAllocations);
+				return true;
+			}
+
+			if (IsKey(Key, TEXT("spatialLayerId")))
+			{
+				return Token == EToken::Number && Reader.GetInteger(Layer.SpatialLayerId);
+			}
+
+			if (IsKey(Key, TEXT("temporalLayerId")))
+			{
+				return Token == EToken::Number && Reader.GetInteger(Layer.TemporalLayerId);
+			}
+
+			if (IsKey(Key, TEXT("width")))
+			{
+				return Token == EToken::Number && Reader.GetInteger(Layer.Width);
+			}
+
+			if (IsKey(Key, TEXT("height")))
+			{
+				return Token == EToken::Number && Reader.GetInteger(Layer.Height);
+			}
+
+			if (IsKey(Key, TEXT("bitrate")))
+			{
+				return Token == EToken::Number && Reader.GetInteger(Layer.Bitrate);
+			}
+
+			return Reader.SkipValue(Token);
+		});
+	}
+
+	bool ReadLayers(FJsonPullReader& Reader, TArray<FMillicastLayerData>& Layers, int32& NumAllocations)
+	{
+		for (;;)
+		{
+			const EToken Token = Reader.Next();
+			if (Token == EToken::ArrayEnd)
+			{
+				return true;
+			}
+
+			if (Token != EToken::ObjectStart || !ReadLayer(Reader, AddCounted(Layers, NumAllocations), NumAllocations))
+			{
+				return false;
+			}
+		}
+	}
+
+	bool ReadLayersEvent(FJsonPullReader& Reader, FSignalingLayersEvent& Event, int32& NumAllocations)
+	{
+		return ReadObject(Reader, [&](FStringView Key, EToken Token)
+		{
+			if (!IsKey(Key, TEXT("medias")))
+			{
+				return Reader.SkipValue(Token);
+			}
+
+			return Token == EToken::ObjectStart && ReadObject(Reader, [&](FStringView Mid, EToken MediaToken)
+			{
+				if (MediaToken != EToken::ObjectStart)
+				{
+					return false;
+				}
+
+				auto& Media = AddCounted(Event.Medias, NumAllocations);
+				AssignString(Media.Key, Mid, NumAllocations);
+
+				return ReadObject(Reader, [&](FStringView MediaKey, EToken LayersToken)
+				{
+					if (IsKey(MediaKey, TEXT("layers")))
+					{
+						return LayersToken == EToken::ArrayStart && ReadLayers(Reader, Media.Value, NumAllocations);
+					}
+
+					return Reader.SkipValue(LayersToken);
+				});
+			});
+		});
+	}
+
+	enum class EFrequentEvent : uint8
+	{
+		None,
+		Vad,
+		Layers,
+		ViewerCount
+	};
+
+	EFrequentEvent GetFrequentEvent(FStringView Name)
+	{
+		if (IsKey(Name, TEXT("vad"))) return EFrequentEvent::Vad;
+		if (IsKey(Name, TEXT("layers"))) return EFrequentEvent::Layers;
+		if (IsKey(Name, TEXT("viewercount"))) return EFrequentEvent::ViewerCount;
+		return EFrequentEvent::None;
+	}
+
+	/** The event is built in place in the message */
+	bool ReadData(FJsonPullReader& Reader, EFrequentEvent Event, FSignalingMessage& OutMessage, int32& NumAllocations)
+	{
+		switch (Event)
+		{
+		case EFrequentEvent::Vad:
+			OutMessage.Emplace<FSignalingVadEvent>();
+			return ReadVad(Reader, OutMessage.Get<FSignalingVadEvent>(), NumAllocations);
+		case EFrequentEvent::Layers:
+			OutMessage.Emplace<FSignalingLayersEvent>();
+			return ReadLayersEvent(Reader, OutMessage.Get<FSignalingLayersEvent>(), NumAllocations);
+		case EFrequentEvent::ViewerCount:
+			OutMessage.Emplace<FSignalingViewerCountEvent>();
+			return ReadViewerCount(Reader, OutMessage.Get<FSignalingViewerCountEvent>());
+		default:
+			return false;
+		}
+	}
+}
+
+namespace Millicast::Player
+{
+
+bool ParseJsonInteger(FStringView Text, int32& OutValue)
+{
+	return ParseInteger(Text, OutValue);
+}
+
+bool ParseJsonInteger(FStringView Text, int64& OutValue)
+{
+	return ParseInteger(Text, OutValue);
+}
+
+bool TryParseFrequentSignalingEvent(const FString& Msg, FSignalingMessage& OutMessage, int32& OutNumAllocations)
+{
+	FJsonPullReader Reader(Msg);
+	if (Reader.Next() != EToken::ObjectStart)
+	{
+		return false;
+	}
+
+	bool bIsEvent = false;
+	bool bHasData = false;
+	EFrequentEvent Event = EFrequentEvent::None;
+
+	const bool bParsed = ReadObject(Reader, [&](FStringView Key, EToken Token)
+	{
+		if (IsKey(Key, TEXT("type")))
+		{
+			bIsEvent = Token == EToken::String && IsKey(Reader.GetValue(), TEXT("event"));
+			return bIsEvent;
+		}
+
+		if (IsKey(Key, TEXT("name")))
+		{
+			Event = Token == EToken::String ? GetFrequentEvent(Reader.GetValue()) : EFrequentEvent::None;
+			return Event != EFrequentEvent::None;
+		}
+
+		if (IsKey(Key, TEXT("data")))
+		{
+			// The shape of the data depends on the name, which the server sends first
+			bHasData = Token == EToken::ObjectStart && ReadData(Reader, Event, OutMessage, OutNumAllocations);
+			return bHasData;
+		}
+
+		return Reader.SkipValue(Token);
+	});
+
+	return bParsed && bIsEvent && bHasData;
+}
+
+}
@@ -0,0 +1,21 @@
+// Copyright Millicast 2023. All Rights Reserved.
+
+#pragma once
+
+#include "Containers/StringView.h"
+#include "MillicastSignalingMessages.h"
+
+namespace Millicast::Player
+{
+	/**
+	 * Parse the vad, layers and viewercount events, which are received many times per second in large rooms, with a pull
+	 * reader over the message text. No Json object is built and no string is allocated besides the ones of the event.
+	 * Returns false for any other message or an unexpected shape, which then goes through ParseSignalingMessage.
+	 * OutNumAllocations is increased by the allocations made for the event.
+	 */
+	bool TryParseFrequentSignalingEvent(const FString& Msg, FSignalingMessage& OutMessage, int32& OutNumAllocations);
+
+	/** Value of a Json number, false if it is not an integer or does not fit */
+	bool ParseJsonInteger(FStringView Text, int32& OutValue);
+	bool ParseJsonInteger(FStringView Text, int64& OutValue);
+}
@@ -0,0 +1,372 @@
+// Copyright Millicast 2023. All Rights Reserved.
+
+#include "MillicastSignalingMessages.h"
+
+#include "Async/Async.h"
+#include "Dom/JsonObject.h"
+#include "Dom/JsonValue.h"
+#include "HAL/IConsoleManager.h"
+#include "MillicastPlayerPrivate.h"
+#include "MillicastSignalingFastPath.h"
+#include "ProfilingDebugging/CsvProfiler.h"
+#include "Serialization/JsonReader.h"
+#include "Serialization/JsonSerializer.h"
+
+CSV_DEFINE_CATEGORY(Millicast_Signaling, false);
+
+static TAutoConsoleVariable<int32> CVarMillicastSignalingFastPath(
+	TEXT("Millicast.Player.SignalingFastPath"),
+	1,
+	TEXT("Parse the vad, layers and viewercount events without the Json module. 0 parses every message with the Json module, to compare both."),
+	ECVF_Default);
+
+namespace
+{
+	using namespace Millicast::Player;
+
+	FSignalingMessage ParseActiveEvent(const FJsonObject& DataJson)
+	{
+		FSignalingActiveEvent Event;
+		DataJson.TryGetStringField("streamId", Event.StreamId);
+		DataJson.TryGetStringField("sourceId", Event.SourceId);
+
+		const TArray<TSharedPtr<FJsonValue>>* TracksJson;
+		if (DataJson.TryGetArrayField("tracks", TracksJson))
+		{
+			Event.Tracks.Reserve(TracksJson->Num());
+
+			for (const auto& t : *TracksJson)
+			{
+				const TSharedPtr<FJsonObject>* TrackJson;
+				if (!t->TryGetObject(TrackJson))
+				{
+					continue;
+				}
+
+				FMillicastTrackInfo TrackInfo;
+				(*TrackJson)->TryGetStringField("media", TrackInfo.Media);
+				(*TrackJson)->TryGetStringField("trackId", TrackInfo.TrackId);
+
+				Event.Tracks.Emplace(MoveTemp(TrackInfo));
+			}
+		}
+
+		return FSignalingMessage(TInPlaceType<FSignalingActiveEvent>(), MoveTemp(Event));
+	}
+
+	FSignalingMessage ParseInactiveEvent(const FJsonObject& DataJson)
+	{
+		FSignalingInactiveEvent Event;
+		DataJson.TryGetStringField("streamId", Event.StreamId);
+		DataJson.TryGetStringField("sourceId", Event.SourceId);
+
+		return FSignalingMessage(TInPlaceType<FSignalingInactiveEvent>(), MoveTemp(Event));
+	}
+
+	FSignalingMessage ParseVadEvent(const FJsonObject& DataJson)
+	{
+		FSignalingVadEvent Event;
+		DataJson.TryGetStringField("mediaId", Event.Mid);
+		DataJson.TryGetStringField("sourceId", Event.SourceId);
+
+		return FSignalingMessage(TInPlaceType<FSignalingVadEvent>(), MoveTemp(Event));
+	}
+
+	FSignalingMessage ParseLayersEvent(const FJsonObject& DataJson)
+	{
+		FSignalingLayersEvent Event;
+
+		const TSharedPtr<FJsonObject>* MediaJson;
+		if (DataJson.TryGetObjectField("medias", MediaJson))
+		{
+			Event.Medias.Reserve((*MediaJson)->Values.Num());
+
+			for (const auto& it : (*MediaJson)->Values)
+			{
+				TArray<FMillicastLayerData> ActiveLayers;
+
+				const TSharedPtr<FJsonObject>* LayersObject;
+				const TArray<TSharedPtr<FJsonValue>>* layers;
+				if (it.Value->TryGetObject(LayersObject) && (*LayersObject)->TryGetArrayField("layers", layers))
+				{
+					ActiveLayers.Reserve(layers->Num());
+
+					for (const auto& l : *layers)
+					{
+						const TSharedPtr<FJsonObject>* LayerJson;
+						if (!l->TryGetObject(LayerJson))
+						{
+							continue;
+						}
+
+						FMillicastLayerData data;
+						(*LayerJson)->TryGetStringField("encodingId", data.EncodingId);
+						(*LayerJson)->TryGetNumberField("temporalLayerId", data.TemporalLayerId);
+						(*LayerJson)->TryGetNumberField("spatialLayerId", data.SpatialLayerId);
+						(*LayerJson)->TryGetNumberField("width", data.Width);
+						(*LayerJson)->TryGetNumberField("height", data.Height);
+						(*LayerJson)->TryGetNumberField("bitrate", data.Bitrate);
+
+						ActiveLayers.Emplace(MoveTemp(data));
+					}
+				}
+
+				Event.Medias.Emplace(it.Key, MoveTemp(ActiveLayers));
+			}
+		}
+
+		return FSignalingMessage(TInPlaceType<FSignalingLayersEvent>(), MoveTemp(Event));
+	}
+
+	FSignalingMessage ParseViewerCountEvent(const FJsonObject& DataJson)
+	{
+		FSignalingViewerCountEvent Event;
+		DataJson.TryGetNumberField("viewercount", Event.Count);
+
+		return FSignalingMessage(TInPlaceType<FSignalingViewerCountEvent>(), MoveTemp(Event));
+	}
+
+	FSignalingMessage ParseEvent(const FJsonObject& JsonMsg)
+	{
+		FString EventName;
+		JsonMsg.TryGetStringField("name", EventName);
+
+		UE_LOG(LogMillicastPlayer, Log, TEXT("Received event : %s"), *EventName);
+
+		if (EventName == "stopped")
+		{
+			return FSignalingMessage(TInPlaceType<FSignalingStoppedEvent>());
+		}
+
+		if (EventName == "migrate")
+		{
+			return FSignalingMessage(TInPlaceType<FSignalingMigrateEvent>());
+		}
+
+		const TSharedPtr<FJsonObject>* DataJson;
+		if (!JsonMsg.TryGetObjectField("data", DataJson))
+		{
+			UE_LOG(LogMillicastPlayer, Warning, TEXT("Event %s without data"), *EventName);
+			return FSignalingMessage();
+		}
+
+		if (EventName == "active") return ParseActiveEvent(**DataJson);
+		if (EventName == "inactive") return ParseInactiveEvent(**DataJson);
+		if (EventName == "vad") return ParseVadEvent(**DataJson);
+		if (EventName == "layers") return ParseLayersEvent(**DataJson);
+		if (EventName == "viewercount") return ParseViewerCountEvent(**DataJson);
+
+		UE_LOG(LogMillicastPlayer, Warning, TEXT("WebSocket event not handled (yet?) %s"), *EventName);
+		return FSignalingMessage();
+	}
+
+	FSignalingMessage ParseResponse(const FJsonObject& JsonMsg)
+	{
+		FSignalingResponse Response;
+		JsonMsg.TryGetNumberField("transId", Response.TransId);
+
+		// Only the view command answers with data
+		const TSharedPtr<FJsonObject>* DataJson;
+		if (JsonMsg.TryGetObjectField("data", DataJson))
+		{
+			(*DataJson)->TryGetStringField("sdp", Response.Sdp);
+			(*DataJson)->TryGetStringField("subscriberId", Response.ServerId);
+			(*DataJson)->TryGetStringField("clusterId", Response.ClusterId);
+		}
+
+		return FSignalingMessage(TInPlaceType<FSignalingResponse>(), MoveTemp(Response));
+	}
+
+	FSignalingMessage ParseError(const FJsonObject& JsonMsg)
+	{
+		FSignalingError Error;
+		JsonMsg.TryGetNumberField("transId", Error.TransId);
+		JsonMsg.TryGetStringField("data", Error.Message);
+
+		return FSignalingMessage(TInPlaceType<FSignalingError>(), MoveTemp(Error));
+	}
+}
+
+namespace Millicast::Player
+{
+
+const TArray<FString>& GetSignalingEventNames()
+{
+	static const TArray<FString> EventNames = { "active", "inactive", "stopped", "vad", "layers", "viewercount", "migrate" };
+	return EventNames;
+}
+
+FSignalingMessage ParseSignalingMessage(const FString& Msg)
+{
+	TSharedPtr<FJsonObject> JsonMsg;
+	auto Reader = TJsonReaderFactory<>::Create(Msg);
+
+	if (!FJsonSerializer::Deserialize(Reader, JsonMsg) || !JsonMsg.IsValid())
+	{
+		UE_LOG(LogMillicastPlayer, Error, TEXT("[ParseSignalingMessage] Failed to deserialize"));
+		return FSignalingMessage();
+	}
+
+	FString Type;
+	if (!JsonMsg->TryGetStringField("type", Type))
+	{
+		UE_LOG(LogMillicastPlayer, Error, TEXT("[ParseSignalingMessage] Missing type field"));
+		return FSignalingMessage();
+	}
+
+	if (Type == "event") return ParseEvent(*JsonMsg);
+	if (Type == "response") return ParseResponse(*JsonMsg);
+	if (Type == "error") return ParseError(*JsonMsg);
+
+	UE_LOG(LogMillicastPlayer, Warning, TEXT("WebSocket response type not handled (yet?) %s"), *Type);
+	return FSignalingMessage();
+}
+
+FSignalingMessageQueue::FSignalingMessageQueue(FHandler InHandler)
+	: Handler(MoveTemp(InHandler))
+{
+}
+
+void FSignalingMessageQueue::Push(FString Msg)
+{
+	RawMessages.Enqueue(TPair<uint32, FString>(Epoch.Load(), MoveTemp(Msg)));
+
+	if (!bParsing.Exchange(true))
+	{
+		AsyncTask(ENamedThreads::AnyBackgroundThreadNormalTask, [Self = AsShared()]()
+		{
+			Self->ParsePending();
+		});
+	}
+}
+
+void FSignalingMessageQueue::Flush()
+{
+	++Epoch;
+}
+
+void FSignalingMessageQueue::ParsePending()
+{
+	for (;;)
+	{
+		FBatch Batch;
+
+		TPair<uint32, FString> Raw;
+		while (RawMessages.Dequeue(Raw))
+		{
+			if (Raw.Key != Epoch.Load())
+			{
+				continue;
+			}
+
+			FSignalingMessage Message = Parse(Raw.Value);
+			if (!Message.IsType<FEmptyVariantState>())
+			{
+				Batch.Emplace(Raw.Key, MoveTemp(Message));
+			}
+		}
+
+		Dispatch(MoveTemp(Batch));
+		ReportStats();
+
+		bParsing = false;
+
+		// A message pushed after the last dequeue saw the flag still set and did not start a task
+		if (RawMessages.IsEmpty() || bParsing.Exchange(true))
+		{
+			return;
+		}
+	}
+}
+
+FSignalingMessage FSignalingMessageQueue::Parse(const FString& Msg)
+{
+	FSignalingMessage Message;
+
+	const uint64 StartCycles = FPlatformTime::Cycles64();
+	int32 NumAllocations = 0;
+
+	if (CVarMillicastSignalingFastPath.GetValueOnAnyThread() != 0 && TryParseFrequentSignalingEvent(Msg, Message, NumAllocations))
+	{
+		Stats.FastPathCycles += FPlatformTime::Cycles64() - StartCycles;
+		Stats.NumFastPathAllocations += NumAllocations;
+		++Stats.NumFastPathEvents;
+
+		UE_LOG(LogMillicastPlayer, VeryVerbose, TEXT("Millicast WebSocket new Message : %s"), *Msg);
+		return Message;
+	}
+
+	UE_LOG(LogMillicastPlayer, Log, TEXT("Millicast WebSocket new Message : %s"), *Msg);
+
+	Message = ParseSignalingMessage(Msg);
+
+	Stats.JsonCycles += FPlatformTime::Cycles64() - StartCycles;
+	++Stats.NumJsonMessages;
+
+	return Message;
+}
+
+void FSignalingMessageQueue::Dispatch(FBatch&& Batch)
+{
+	if (Batch.Num() == 0)
+	{
+		return;
+	}
+
+	// One game thread task per parsing pass. Game thread tasks run in the order they are queued,
+	// and a single parsing task queues them at a time
+	TWeakPtr<FSignalingMessageQueue, ESPMode::ThreadSafe> WeakSelf = AsShared();
+	AsyncTask(ENamedThreads::GameThread, [WeakSelf, Batch = MoveTemp(Batch)]()
+	{
+		for (const auto& Entry : Batch)
+		{
+			// The handler may flush the queue, or destroy its owner
+			auto Self = WeakSelf.Pin();
+			if (!Self)
+			{
+				return;
+			}
+
+			if (Self->Epoch.Load() == Entry.Key)
+			{
+				Self->Handler(Entry.Value);
+			}
+		}
+	});
+}
+
+void FSignalingMessageQueue::ReportStats()
+{
+	const double Now = FPlatformTime::Seconds();
+	if (Stats.WindowStartTime == 0.0)
+	{
+		Stats.WindowStartTime = Now;
+		return;
+	}
+
+	const double Elapsed = Now - Stats.WindowStartTime;
+	if (Elapsed < 1.0)
+	{
+		return;
+	}
+
+	const float FastPathEventsPerSecond = Stats.NumFastPathEvents / Elapsed;
+	const float JsonMessagesPerSecond = Stats.NumJsonMessages / Elapsed;
+	const float FastPathUsPerEvent = Stats.NumFastPathEvents > 0 ? FPlatformTime::ToMilliseconds64(Stats.FastPathCycles) * 1000.0 / Stats.NumFastPathEvents : 0.f;
+	const float JsonUsPerMessage = Stats.NumJsonMessages > 0 ? FPlatformTime::ToMilliseconds64(Stats.JsonCycles) * 1000.0 / Stats.NumJsonMessages : 0.f;
+	const float FastPathAllocationsPerEvent = Stats.NumFastPathEvents > 0 ? static_cast<float>(Stats.NumFastPathAllocations) / Stats.NumFastPathEvents : 0.f;
+
+	CSV_CUSTOM_STAT(Millicast_Signaling, FastPathEventsPerSecond, FastPathEventsPerSecond, ECsvCustomStatOp::Set);
+	CSV_CUSTOM_STAT(Millicast_Signaling, FastPathUsPerEvent, FastPathUsPerEvent, ECsvCustomStatOp::Set);
+	CSV_CUSTOM_STAT(Millicast_Signaling, FastPathAllocationsPerEvent, FastPathAllocationsPerEvent, ECsvCustomStatOp::Set);
+	CSV_CUSTOM_STAT(Millicast_Signaling, JsonMessagesPerSecond, JsonMessagesPerSecond, ECsvCustomStatOp::Set);
+	CSV_CUSTOM_STAT(Millicast_Signaling, JsonUsPerMessage, JsonUsPerMessage, ECsvCustomStatOp::Set);
+
+	UE_LOG(LogMillicastPlayer, Verbose, TEXT("Signaling parsing : %.1f events/s on the fast path (%.2f us, %.1f allocations per event), %.1f messages/s with the Json module (%.2f us per message)"),
+		FastPathEventsPerSecond, FastPathUsPerEvent, FastPathAllocationsPerEvent, JsonMessagesPerSecond, JsonUsPerMessage);
+
+	Stats = FParseStats{};
+	Stats.WindowStartTime = Now;
+}
+
+}
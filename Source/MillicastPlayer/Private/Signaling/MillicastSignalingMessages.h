@@ -0,0 +1,134 @@
+// Copyright Millicast 2023. All Rights Reserved.
+
+#pragma once
+
+#include "Components/MillicastSubscriberComponent.h"
+#include "Containers/Queue.h"
+#include "Misc/TVariant.h"
+#include "Templates/Atomic.h"
+
+namespace Millicast::Player
+{
+	/** Messages of the Millicast signaling, parsed from the WebSocket text into what the subscriber acts upon */
+	struct FSignalingResponse
+	{
+		int32 TransId = 0;
+
+		/** Set in the answer to the view command */
+		FString Sdp;
+		FString ServerId;
+		FString ClusterId;
+	};
+
+	struct FSignalingError
+	{
+		/** 0 if the error is not about a command */
+		int32 TransId = 0;
+		FString Message;
+	};
+
+	struct FSignalingActiveEvent
+	{
+		FString StreamId;
+		FString SourceId;
+		TArray<FMillicastTrackInfo> Tracks;
+	};
+
+	struct FSignalingInactiveEvent
+	{
+		FString StreamId;
+		FString SourceId;
+	};
+
+	struct FSignalingStoppedEvent
+	{
+	};
+
+	struct FSignalingVadEvent
+	{
+		FString Mid;
+		FString SourceId;
+	};
+
+	struct FSignalingLayersEvent
+	{
+		/** Active layers per mid */
+		TArray<TPair<FString, TArray<FMillicastLayerData>>> Medias;
+	};
+
+	struct FSignalingViewerCountEvent
+	{
+		int32 Count = 0;
+	};
+
+	struct FSignalingMigrateEvent
+	{
+	};
+
+	/** FEmptyVariantState for the messages that are invalid or not handled */
+	using FSignalingMessage = TVariant<FEmptyVariantState,
+		FSignalingResponse,
+		FSignalingError,
+		FSignalingActiveEvent,
+		FSignalingInactiveEvent,
+		FSignalingStoppedEvent,
+		FSignalingVadEvent,
+		FSignalingLayersEvent,
+		FSignalingViewerCountEvent,
+		FSignalingMigrateEvent>;
+
+	/** Names of the events parsed by ParseSignalingMessage, requested in the view command */
+	const TArray<FString>& GetSignalingEventNames();
+
+	/** Parse a message received on the WebSocket. Does not touch any state, can be called from any thread */
+	FSignalingMessage ParseSignalingMessage(const FString& Msg);
+
+	/**
+	 * Parse the messages of a WebSocket on a background task and hand them to the game thread in the order they were received.
+	 * A single task runs at a time, it is started by the first message pushed while none is running.
+	 */
+	class FSignalingMessageQueue : public TSharedFromThis<FSignalingMessageQueue, ESPMode::ThreadSafe>
+	{
+	public:
+		using FHandler = TFunction<void(const FSignalingMessage&)>;
+
+		/** The handler is called on the game thread */
+		explicit FSignalingMessageQueue(FHandler InHandler);
+
+		void Push(FString Msg);
+
+		/** Drop the messages pushed so far that have not been handled yet, for instance when their WebSocket is replaced */
+		void Flush();
+
+	private:
+		struct FParseStats
+		{
+			int32 NumFastPathEvents = 0;
+			int32 NumFastPathAllocations = 0;
+			uint64 FastPathCycles = 0;
+
+			int32 NumJsonMessages = 0;
+			uint64 JsonCycles = 0;
+
+			double WindowStartTime = 0.0;
+		};
+
+		using FBatch = TArray<TPair<uint32, FSignalingMessage>>;
+
+		void ParsePending();
+		FSignalingMessage Parse(const FString& Msg);
+		void Dispatch(FBatch&& Batch);
+
+		/** Report the events per second and the cost per event of both parsers, once per second */
+		void ReportStats();
+
+		FHandler Handler;
+
+		/** Only touched by the parsing task */
+		FParseStats Stats;
+
+		TQueue<TPair<uint32, FString>, EQueueMode::Mpsc> RawMessages;
+		TAtomic<bool> bParsing { false };
+		TAtomic<uint32> Epoch { 0 };
+	};
+}
@@ -0,0 +1,85 @@
+// Copyright Millicast 2023. All Rights Reserved.
+
+#include "MillicastSignalingTransactions.h"
+
+#include "MillicastPlayerPrivate.h"
+
+namespace Millicast::Player
+{
+
+int32 FSignalingTransactions::Add(const FString& Name, FCompletion OnComplete)
+{
+	const int32 TransId = NextTransId;
+	NextTransId = NextTransId < MAX_int32 ? NextTransId + 1 : 1;
+
+	Pending.Add(TransId, FPendingCommand{ Name, FPlatformTime::Seconds(), MoveTemp(OnComplete) });
+	return TransId;
+}
+
+bool FSignalingTransactions::Complete(int32 TransId, EMillicastCommandStatus Status, const FSignalingResponse* Response)
+{
+	FPendingCommand Command;
+	if (!Pending.RemoveAndCopyValue(TransId, Command))
+	{
+		return false;
+	}
+
+	Complete(MoveTemp(Command), Status, Response);
+	return true;
+}
+
+void FSignalingTransactions::Expire(double TimeoutSeconds)
+{
+	const double Deadline = FPlatformTime::Seconds() - TimeoutSeconds;
+
+	// The completions may send new commands, collect the expired ones first
+	TArray<FPendingCommand> Expired;
+	for (auto It = Pending.CreateIterator(); It; ++It)
+	{
+		if (It->Value.SendTime < Deadline)
+		{
+			Expired.Emplace(MoveTemp(It->Value));
+			It.RemoveCurrent();
+		}
+	}
+
+	for (auto& Command : Expired)
+	{
+		Complete(MoveTemp(Command), EMillicastCommandStatus::TimedOut, nullptr);
+	}
+}
+
+void FSignalingTransactions::CancelAll()
+{
+	TMap<int32, FPendingCommand> Cancelled = MoveTemp(Pending);
+	Pending.Reset();
+
+	for (auto& Entry : Cancelled)
+	{
+		Complete(MoveTemp(Entry.Value), EMillicastCommandStatus::Cancelled, nullptr);
+	}
+}
+
+double FSignalingTransactions::GetLastRoundTripMs(const FString& Name) const
+{
+	const double* RoundTripMs = LastRoundTripMs.Find(Name);
+	return RoundTripMs ? *RoundTripMs : -1.0;
+}
+
+void FSignalingTransactions::Complete(FPendingCommand&& Command, EMillicastCommandStatus Status, const FSignalingResponse* Response)
+{
+	const double RoundTripMs = (FPlatformTime::Seconds() - Command.SendTime) * 1000.0;
+
+	// Only answered commands measure the signaling latency
+	if (Status == EMillicastCommandStatus::Succeeded || Status == EMillicastCommandStatus::Failed)
+	{
+		LastRoundTripMs.Add(Command.Name, RoundTripMs);
+	}
+
+	if (Command.OnComplete)
+	{
+		Command.OnComplete(Status, RoundTripMs, Status == EMillicastCommandStatus::Succeeded ? Response : nullptr);
+	}
+}
+
+}
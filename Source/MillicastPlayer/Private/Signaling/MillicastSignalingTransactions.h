@@ -0,0 +1,50 @@
+// Copyright Millicast 2023. All Rights Reserved.
+
+#pragma once
+
+#include "MillicastSignalingMessages.h"
+
+namespace Millicast::Player
+{
+	/**
+	 * Commands sent on the signaling, waiting for the response or the error with the same transId.
+	 * Used on the game thread only, where the signaling messages are handled.
+	 */
+	class FSignalingTransactions
+	{
+	public:
+		/** Response is only set when the command succeeded */
+		using FCompletion = TFunction<void(EMillicastCommandStatus Status, double RoundTripMs, const FSignalingResponse* Response)>;
+
+		/** Returns the transId to send with the command */
+		int32 Add(const FString& Name, FCompletion OnComplete);
+
+		/** Returns false if no command is waiting with this transId, for instance because it timed out */
+		bool Complete(int32 TransId, EMillicastCommandStatus Status, const FSignalingResponse* Response = nullptr);
+
+		/** Time out the commands sent more than TimeoutSeconds ago */
+		void Expire(double TimeoutSeconds);
+
+		/** Cancel every pending command, when their WebSocket is closed */
+		void CancelAll();
+
+		bool HasPending() const { return Pending.Num() > 0; }
+
+		/** Round trip time of the last completed command with this name, in milliseconds. -1 if there is none */
+		double GetLastRoundTripMs(const FString& Name) const;
+
+	private:
+		struct FPendingCommand
+		{
+			FString Name;
+			double SendTime = 0.0;
+			FCompletion OnComplete;
+		};
+
+		void Complete(FPendingCommand&& Command, EMillicastCommandStatus Status, const FSignalingResponse* Response);
+
+		TMap<int32, FPendingCommand> Pending;
+		TMap<FString, double> LastRoundTripMs;
+		int32 NextTransId = 1;
+	};
+}
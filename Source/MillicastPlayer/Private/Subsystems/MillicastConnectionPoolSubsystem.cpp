@@ -0,0 +1,176 @@
+// Copyright Millicast 2023. All Rights Reserved.
+
+#include "Subsystems/MillicastConnectionPoolSubsystem.h"
+
+#include "MillicastPlayerPrivate.h"
+#include "MillicastUtil.h"
+#include "Util.h"
+#include "WebRTC/PeerConnection.h"
+
+void UMillicastConnectionPoolSubsystem::Deinitialize()
+{
+	UE_LOG(LogMillicastPlayer, Verbose, TEXT("%S"), __FUNCTION__);
+
+	PoolSize = 0;
+
+	for (auto& Entry : Connections)
+	{
+		delete Entry.PeerConnection;
+	}
+	Connections.Empty();
+
+	Super::Deinitialize();
+}
+
+void UMillicastConnectionPoolSubsystem::Prewarm(int32 Count)
+{
+	UE_LOG(LogMillicastPlayer, Verbose, TEXT("%S"), __FUNCTION__);
+
+	PoolSize = FMath::Max(Count, 0);
+
+	// Drop the most recent connections first, they are the least likely to be ready
+	while (Connections.Num() > PoolSize)
+	{
+		delete Connections.Last().PeerConnection;
+		Connections.Pop();
+	}
+
+	Refill();
+}
+
+int32 UMillicastConnectionPoolSubsystem::GetNumReadyConnections() const
+{
+	int32 NumReady = 0;
+	for (const auto& Entry : Connections)
+	{
+		NumReady += Entry.bReady ? 1 : 0;
+	}
+
+	return NumReady;
+}
+
+Millicast::Player::FWebRTCPeerConnection* UMillicastConnectionPoolSubsystem::Acquire()
+{
+	UE_LOG(LogMillicastPlayer, Verbose, TEXT("%S"), __FUNCTION__);
+
+	const int32 Index = Connections.IndexOfByPredicate([](const FPooledConnection& Entry) { return Entry.bReady; });
+	if (Index == INDEX_NONE)
+	{
+		return nullptr;
+	}
+
+	auto* PeerConnection = Connections[Index].PeerConnection;
+	Connections.RemoveAt(Index);
+
+	// The session description observers were consumed by the offer, give the new owner fresh ones
+	PeerConnection->ResetObservers();
+
+	Refill();
+
+	return PeerConnection;
+}
+
+void UMillicastConnectionPoolSubsystem::SetIceServers(const TArray<webrtc::PeerConnectionInterface::IceServer>& InIceServers)
+{
+	IceServers = InIceServers;
+}
+
+void UMillicastConnectionPoolSubsystem::Refill()
+{
+	while (Connections.Num() < PoolSize)
+	{
+		const int32 NumConnections = Connections.Num();
+		CreatePooledConnection();
+
+		// Creating a connection fails for all of them, the next Acquire or Prewarm call tries again
+		if (Connections.Num() == NumConnections)
+		{
+			break;
+		}
+	}
+}
+
+void UMillicastConnectionPoolSubsystem::CreatePooledConnection()
+{
+	using namespace Millicast::Player;
+
+	webrtc::PeerConnectionInterface::RTCConfiguration Config = FWebRTCPeerConnection::GetDefaultConfig();
+	for (const auto& Server : IceServers)
+	{
+		Config.servers.push_back(Server);
+	}
+
+	auto* PeerConnection = FWebRTCPeerConnection::Create(Config);
+	if (!PeerConnection)
+	{
+		UE_LOG(LogMillicastPlayer, Warning, TEXT("Could not create pooled peerconnection"));
+		return;
+	}
+
+	FPooledConnection Entry;
+	Entry.PeerConnection = PeerConnection;
+	Connections.Add(Entry);
+
+	// Same transceivers as the ones offer_to_receive would add, created up front so the offer is final
+	PeerConnection->AddRecvOnlyTransceivers();
+
+	PeerConnection->OaOptions.offer_to_receive_video = true;
+	PeerConnection->OaOptions.offer_to_receive_audio = true;
+
+	TWeakObjectPtr<UMillicastConnectionPoolSubsystem> WeakThis(this);
+	const uint64 PeerConnectionId = PeerConnection->GetId();
+
+#if MILLICAST_HAS_CXX20
+	PeerConnection->CreateLocalOffer([=, this]()
+#else
+	PeerConnection->CreateLocalOffer([=]()
+#endif
+	{
+#if MILLICAST_HAS_CXX20
+		AsyncGameThreadTaskWithCapture(WeakThis, [=, this]()
+#else
+		AsyncGameThreadTaskWithCapture(WeakThis, [=]()
+#endif
+		{
+			OnPooledConnectionPrepared(PeerConnectionId, true);
+		});
+	},
+#if MILLICAST_HAS_CXX20
+	[=, this](const std::string&)
+#else
+	[=](const std::string&)
+#endif
+	{
+#if MILLICAST_HAS_CXX20
+		AsyncGameThreadTaskWithCapture(WeakThis, [=, this]()
+#else
+		AsyncGameThreadTaskWithCapture(WeakThis, [=]()
+#endif
+		{
+			OnPooledConnectionPrepared(PeerConnectionId, false);
+		});
+	});
+}
+
+void UMillicastConnectionPoolSubsystem::OnPooledConnectionPrepared(uint64 PeerConnectionId, bool bSuccess)
+{
+	auto* Entry = Connections.FindByPredicate([PeerConnectionId](const FPooledConnection& It) { return It.PeerConnection->GetId() == PeerConnectionId; });
+	if (!Entry)
+	{
+		// Dropped by Prewarm in the meantime
+		return;
+	}
+
+	if (bSuccess)
+	{
+		UE_LOG(LogMillicastPlayer, Log, TEXT("Pooled peerconnection ready"));
+		Entry->bReady = true;
+		return;
+	}
+
+	// Not retried here, the next Acquire or Prewarm call refills the pool
+	UE_LOG(LogMillicastPlayer, Warning, TEXT("Could not prepare pooled peerconnection"));
+	auto* PeerConnection = Entry->PeerConnection;
+	Connections.RemoveAll([PeerConnection](const FPooledConnection& It) { return It.PeerConnection == PeerConnection; });
+	delete PeerConnection;
+}
@@ -0,0 +1,263 @@
+// Copyright Millicast 2023. All Rights Reserved.
+
+#include "Subsystems/MillicastSubscriptionManagerSubsystem.h"
+
+#include "Components/MillicastLayerSelection.h"
+#include "MillicastPlayerPrivate.h"
+
+namespace
+{
+	// Used until the resolution and the frame rate of a subscriber are known
+	constexpr float DefaultMegapixelsPerFrame = 1920.f * 1080.f / 1'000'000.f;
+	constexpr float DefaultFramesPerSecond = 30.f;
+
+	// Cost of the lowest layer relative to the full quality when the layers do not report their resolution
+	constexpr float ReducedCostRatio = 0.25f;
+}
+
+void UMillicastSubscriptionManagerSubsystem::Deinitialize()
+{
+	UE_LOG(LogMillicastPlayer, Verbose, TEXT("%S"), __FUNCTION__);
+
+	Subscribers.Empty();
+
+	Super::Deinitialize();
+}
+
+void UMillicastSubscriptionManagerSubsystem::SetDecoderBudget(float InMaxDecodedMegapixelsPerSecond, int32 InMaxActiveDecoders)
+{
+	MaxDecodedMegapixelsPerSecond = FMath::Max(InMaxDecodedMegapixelsPerSecond, 0.f);
+	MaxActiveDecoders = FMath::Max(InMaxActiveDecoders, 0);
+
+	UpdateTiers();
+}
+
+void UMillicastSubscriptionManagerSubsystem::SetReceiveBitrateBudget(int32 InMaxReceiveBitrateKbps)
+{
+	MaxReceiveBitrateKbps = FMath::Max(InMaxReceiveBitrateKbps, 0);
+
+	UpdateTiers();
+}
+
+void UMillicastSubscriptionManagerSubsystem::Register(UMillicastSubscriberComponent* Subscriber)
+{
+	Subscribers.AddUnique(Subscriber);
+}
+
+void UMillicastSubscriptionManagerSubsystem::Unregister(UMillicastSubscriberComponent* Subscriber)
+{
+	Subscribers.Remove(Subscriber);
+}
+
+bool UMillicastSubscriptionManagerSubsystem::IsTickable() const
+{
+	return !HasAnyFlags(RF_ClassDefaultObject) && Subscribers.Num() > 0;
+}
+
+void UMillicastSubscriptionManagerSubsystem::Tick(float DeltaTime)
+{
+	TimeUntilUpdate -= DeltaTime;
+	if (TimeUntilUpdate > 0.f)
+	{
+		return;
+	}
+
+	TimeUntilUpdate = UpdateIntervalSeconds;
+	UpdateTiers();
+}
+
+void UMillicastSubscriptionManagerSubsystem::UpdateTiers()
+{
+	Subscribers.RemoveAll([](const TWeakObjectPtr<UMillicastSubscriberComponent>& Subscriber) { return !Subscriber.IsValid(); });
+
+	struct FRankedSubscriber
+	{
+		UMillicastSubscriberComponent* Subscriber;
+		float Importance;
+	};
+
+	TArray<FRankedSubscriber> Ranked;
+	Ranked.Reserve(Subscribers.Num());
+
+	for (const auto& WeakSubscriber : Subscribers)
+	{
+		auto* Subscriber = WeakSubscriber.Get();
+
+		// Subscribers that do not receive anything keep their tier and take no budget
+		if (!Subscriber->IsConnectionActive())
+		{
+			continue;
+		}
+
+		const float ScreenSize = Subscriber->GetScreenSizeHint();
+		const float Importance = Subscriber->GetPriority() * (ScreenSize > 0.f ? ScreenSize : 1.f);
+		Ranked.Add({ Subscriber, Importance });
+	}
+
+	Ranked.StableSort([](const FRankedSubscriber& A, const FRankedSubscriber& B) { return A.Importance > B.Importance; });
+
+	// Paused subscribers still decode their lowest layer, its cost is set aside for all of them before any is given more
+	float UsedMegapixelsPerSecond = 0.f;
+	for (const auto& Entry : Ranked)
+	{
+		UsedMegapixelsPerSecond += EstimateDecodedMegapixelsPerSecond(Entry.Subscriber, EMillicastSubscriptionTier::Paused);
+	}
+
+	int32 NumActiveDecoders = 0;
+
+	TArray<FReceiveBitrateShare> Shares;
+
+	for (const auto& Entry : Ranked)
+	{
+		const bool bDecoderAvailable = MaxActiveDecoders == 0 || NumActiveDecoders < MaxActiveDecoders;
+		const float PausedMegapixelsPerSecond = EstimateDecodedMegapixelsPerSecond(Entry.Subscriber, EMillicastSubscriptionTier::Paused);
+
+		auto Fits = [&](EMillicastSubscriptionTier Tier)
+		{
+			return MaxDecodedMegapixelsPerSecond <= 0.f
+				|| UsedMegapixelsPerSecond - PausedMegapixelsPerSecond + EstimateDecodedMegapixelsPerSecond(Entry.Subscriber, Tier) <= MaxDecodedMegapixelsPerSecond;
+		};
+
+		EMillicastSubscriptionTier Tier = EMillicastSubscriptionTier::Paused;
+		if (Entry.Importance > 0.f && bDecoderAvailable)
+		{
+			if (Fits(EMillicastSubscriptionTier::Full))
+			{
+				Tier = EMillicastSubscriptionTier::Full;
+			}
+			else if (Fits(EMillicastSubscriptionTier::Reduced))
+			{
+				Tier = EMillicastSubscriptionTier::Reduced;
+			}
+		}
+
+		UsedMegapixelsPerSecond += EstimateDecodedMegapixelsPerSecond(Entry.Subscriber, Tier) - PausedMegapixelsPerSecond;
+
+		// Paused or not, the subscriber keeps its decoder
+		++NumActiveDecoders;
+
+		if (Tier != EMillicastSubscriptionTier::Paused)
+		{
+			Shares.Add({ Entry.Subscriber, Entry.Importance, GetMaxUsableReceiveBitrateKbps(Entry.Subscriber, Tier) });
+		}
+		else
+		{
+			Entry.Subscriber->SetAllocatedReceiveBitrate(0);
+		}
+
+		Entry.Subscriber->SetSubscriptionTier(Tier);
+	}
+
+	UsedDecodedMegapixelsPerSecond = UsedMegapixelsPerSecond;
+
+	AllocateReceiveBitrate(Shares);
+}
+
+void UMillicastSubscriptionManagerSubsystem::AllocateReceiveBitrate(const TArray<FReceiveBitrateShare>& Shares) const
+{
+	if (MaxReceiveBitrateKbps <= 0)
+	{
+		for (const auto& Share : Shares)
+		{
+			Share.Subscriber->SetAllocatedReceiveBitrate(0);
+		}
+		return;
+	}
+
+	TArray<FReceiveBitrateShare> Unsettled = Shares;
+	float RemainingKbps = MaxReceiveBitrateKbps;
+
+	// Settle the subscribers that cannot use their share, until every one left can use more than it gets
+	bool bSettled = true;
+	while (bSettled && Unsettled.Num() > 0)
+	{
+		bSettled = false;
+
+		float TotalWeight = 0.f;
+		for (const auto& Share : Unsettled)
+		{
+			TotalWeight += Share.Weight;
+		}
+
+		for (int32 i = Unsettled.Num() - 1; i >= 0; --i)
+		{
+			const auto& Share = Unsettled[i];
+			if (Share.MaxUsableKbps <= RemainingKbps * Share.Weight / TotalWeight)
+			{
+				Share.Subscriber->SetAllocatedReceiveBitrate(Share.MaxUsableKbps);
+				RemainingKbps -= Share.MaxUsableKbps;
+				Unsettled.RemoveAt(i);
+				bSettled = true;
+			}
+		}
+	}
+
+	float TotalWeight = 0.f;
+	for (const auto& Share : Unsettled)
+	{
+		TotalWeight += Share.Weight;
+	}
+
+	for (const auto& Share : Unsettled)
+	{
+		// At least 1 kbps, 0 would remove the cap
+		const int32 AllocatedKbps = FMath::Max(FMath::FloorToInt(RemainingKbps * Share.Weight / TotalWeight), 1);
+		Share.Subscriber->SetAllocatedReceiveBitrate(AllocatedKbps);
+	}
+}
+
+int32 UMillicastSubscriptionManagerSubsystem::GetMaxUsableReceiveBitrateKbps(const UMillicastSubscriberComponent* Subscriber, EMillicastSubscriptionTier Tier)
+{
+	using namespace Millicast::Player;
+
+	const auto* Layers = Subscriber->GetMainVideoLayers();
+	const auto* Layer = Layers ? (Tier == EMillicastSubscriptionTier::Full ? FindHighestLayer(*Layers) : FindLowestLayer(*Layers, false)) : nullptr;
+
+	int32 MaxUsableKbps = Layer && Layer->Bitrate > 0 ? FMath::DivideAndRoundUp(Layer->Bitrate, 1000) : MAX_int32;
+	if (Subscriber->GetMaxReceiveBitrate() > 0)
+	{
+		MaxUsableKbps = FMath::Min(MaxUsableKbps, Subscriber->GetMaxReceiveBitrate());
+	}
+
+	return MaxUsableKbps;
+}
+
+float UMillicastSubscriptionManagerSubsystem::EstimateDecodedMegapixelsPerSecond(const UMillicastSubscriberComponent* Subscriber, EMillicastSubscriptionTier Tier)
+{
+	using namespace Millicast::Player;
+
+	// The stats describe what is decoded right now, whatever the tier
+	float FullMegapixelsPerFrame = DefaultMegapixelsPerFrame;
+	float FramesPerSecond = DefaultFramesPerSecond;
+
+	const FPlayerStatsData Stats = Subscriber->GetStats();
+	if (Stats.FramesPerSecond > 0)
+	{
+		FramesPerSecond = Stats.FramesPerSecond;
+	}
+	if (Stats.Width > 0 && Stats.Height > 0 && Subscriber->GetSubscriptionTier() == EMillicastSubscriptionTier::Full)
+	{
+		FullMegapixelsPerFrame = Stats.Width * Stats.Height / 1'000'000.f;
+	}
+
+	const auto* Layers = Subscriber->GetMainVideoLayers();
+	const auto* HighestLayer = Layers ? FindHighestLayer(*Layers) : nullptr;
+	if (HighestLayer && GetLayerPixels(*HighestLayer) > 0)
+	{
+		FullMegapixelsPerFrame = GetLayerPixels(*HighestLayer) / 1'000'000.f;
+	}
+
+	if (Tier == EMillicastSubscriptionTier::Full)
+	{
+		return FullMegapixelsPerFrame * FramesPerSecond;
+	}
+
+	// Paused subscribers receive the lowest frame rate of the lowest layer, whose frame rate is not reported
+	const auto* LowestLayer = Layers ? FindLowestLayer(*Layers, Tier == EMillicastSubscriptionTier::Paused) : nullptr;
+	if (LowestLayer && GetLayerPixels(*LowestLayer) > 0)
+	{
+		return GetLayerPixels(*LowestLayer) / 1'000'000.f * FramesPerSecond;
+	}
+
+	return FullMegapixelsPerFrame * FramesPerSecond * ReducedCostRatio;
+}
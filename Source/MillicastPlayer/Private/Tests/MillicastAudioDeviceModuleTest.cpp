@@ -0,0 +1,115 @@
+// Copyright Millicast 2023. All Rights Reserved.
+
+#include "Misc/AutomationTest.h"
+#include "Tests/MillicastTestAudioTransport.h"
+#include "WebRTC/AudioDeviceModule.h"
+#include "WebRTC/WebRTCFactoryManager.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+namespace Millicast::Player::Tests
+{
+	struct FAudioScalingState
+	{
+		TArray<TSharedPtr<FWebRTCFactoryContext>> Contexts;
+		TArray<TUniquePtr<FTestAudioTransport>> Transports;
+		TArray<int32> NumChunksAtStop;
+	};
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FMillicastAudioDeviceModuleScalingTest, "Millicast.Player.Audio.PerConnectionScaling",
+	EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+bool FMillicastAudioDeviceModuleScalingTest::RunTest(const FString& Parameters)
+{
+	using namespace Millicast::Player;
+	using namespace Millicast::Player::Tests;
+
+	// Half the connections start receiving audio first, then they stop while the other half starts
+	constexpr int32 NumConnections = 16;
+	constexpr float SettleSeconds = 0.3f;
+
+	const TSharedRef<FAudioScalingState> State = MakeShared<FAudioScalingState>();
+
+	for (int32 i = 0; i < NumConnections; ++i)
+	{
+		auto Context = FWebRTCFactoryManager::Get().Acquire(nullptr, 10);
+		if (!TestNotNull(TEXT("Factory context"), Context.Get()))
+		{
+			for (const auto& Acquired : State->Contexts)
+			{
+				FWebRTCFactoryManager::Get().Release(nullptr, Acquired);
+			}
+			return false;
+		}
+
+		auto& Transport = State->Transports.Add_GetRef(MakeUnique<FTestAudioTransport>());
+		Context->AudioDeviceModule->RegisterAudioCallback(Transport.Get());
+		State->Contexts.Add(Context);
+	}
+
+	for (int32 i = 0; i < NumConnections; i += 2)
+	{
+		State->Transports[i]->bStreaming = true;
+		State->Contexts[i]->AudioDeviceModule->StartPlayout();
+	}
+
+	ADD_LATENT_AUTOMATION_COMMAND(FDelayedFunctionLatentCommand([this, State]()
+	{
+		for (int32 i = 0; i < NumConnections; ++i)
+		{
+			const bool bStarted = i % 2 == 0;
+			const auto& AudioDeviceModule = State->Contexts[i]->AudioDeviceModule;
+
+			TestEqual(FString::Printf(TEXT("Connection %d has audio"), i), AudioDeviceModule->IsReadDataAvailable(), bStarted);
+			TestEqual(FString::Printf(TEXT("Connection %d is pulled"), i), State->Transports[i]->NumChunks.Load() > 0, bStarted);
+		}
+
+		State->NumChunksAtStop.SetNumZeroed(NumConnections);
+		for (int32 i = 0; i < NumConnections; ++i)
+		{
+			if (i % 2 == 0)
+			{
+				State->Contexts[i]->AudioDeviceModule->StopPlayout();
+				State->NumChunksAtStop[i] = State->Transports[i]->NumChunks;
+			}
+			else
+			{
+				State->Transports[i]->bStreaming = true;
+				State->Contexts[i]->AudioDeviceModule->StartPlayout();
+			}
+		}
+	}, SettleSeconds));
+
+	ADD_LATENT_AUTOMATION_COMMAND(FDelayedFunctionLatentCommand([this, State]()
+	{
+		for (int32 i = 0; i < NumConnections; ++i)
+		{
+			const bool bStarted = i % 2 == 1;
+			const auto& AudioDeviceModule = State->Contexts[i]->AudioDeviceModule;
+
+			TestEqual(FString::Printf(TEXT("Connection %d has audio"), i), AudioDeviceModule->IsReadDataAvailable(), bStarted);
+
+			if (bStarted)
+			{
+				TestTrue(FString::Printf(TEXT("Connection %d is pulled"), i), State->Transports[i]->NumChunks.Load() > 0);
+			}
+			else
+			{
+				TestEqual(FString::Printf(TEXT("Connection %d is no longer pulled"), i), State->Transports[i]->NumChunks.Load(), State->NumChunksAtStop[i]);
+			}
+		}
+
+		for (int32 i = 0; i < NumConnections; ++i)
+		{
+			State->Contexts[i]->AudioDeviceModule->StopPlayout();
+			FWebRTCFactoryManager::Get().Release(nullptr, State->Contexts[i]);
+		}
+
+		State->Contexts.Empty();
+	}, SettleSeconds));
+
+	return true;
+}
+
+#endif
@@ -0,0 +1,132 @@
+// Copyright Millicast 2023. All Rights Reserved.
+
+#include "Misc/AutomationTest.h"
+#include "Tests/MillicastTestAudioTransport.h"
+#include "WebRTC/AudioDeviceModule.h"
+#include "WebRTC/WebRTCFactoryManager.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+namespace Millicast::Player::Tests
+{
+	struct FPullPeriodResult
+	{
+		int32 PullPeriodMs = 0;
+		double WakeupsPerStreamPerSecond = 0.;
+		double ChunksPerStreamPerSecond = 0.;
+		float CpuPercentPerStream = 0.f;
+	};
+
+	struct FPullPeriodBenchmarkState
+	{
+		TArray<TSharedPtr<FWebRTCFactoryContext>> Contexts;
+		TArray<TUniquePtr<FTestAudioTransport>> Transports;
+		double StartSeconds = 0.;
+		float IdleCpuPercent = 0.f;
+		TArray<FPullPeriodResult> Results;
+	};
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FMillicastAudioPullPeriodBenchmark, "Millicast.Player.Audio.PullPeriodBenchmark",
+	EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::PerfFilter)
+
+bool FMillicastAudioPullPeriodBenchmark::RunTest(const FString& Parameters)
+{
+	using namespace Millicast::Player;
+	using namespace Millicast::Player::Tests;
+
+	constexpr int32 NumStreams = 8;
+	constexpr float MeasureSeconds = 2.f;
+	const int32 PullPeriodsMs[] = { 10, 20, 40, 60 };
+
+	const TSharedRef<FPullPeriodBenchmarkState> State = MakeShared<FPullPeriodBenchmarkState>();
+
+	// The process CPU usage is averaged by the engine over its last update, what the streams add is compared to it
+	ADD_LATENT_AUTOMATION_COMMAND(FDelayedFunctionLatentCommand([State]()
+	{
+		State->IdleCpuPercent = FPlatformTime::GetCPUTime().CPUTimePct;
+	}, MeasureSeconds));
+
+	for (const int32 PullPeriodMs : PullPeriodsMs)
+	{
+		ADD_LATENT_AUTOMATION_COMMAND(FFunctionLatentCommand([this, State, PullPeriodMs]()
+		{
+			for (int32 i = 0; i < NumStreams; ++i)
+			{
+				auto Context = FWebRTCFactoryManager::Get().Acquire(nullptr, PullPeriodMs);
+				if (!Context)
+				{
+					AddError(TEXT("Could not create a factory context"));
+					break;
+				}
+
+				auto& Transport = State->Transports.Add_GetRef(MakeUnique<FTestAudioTransport>());
+				Transport->bStreaming = true;
+				Context->AudioDeviceModule->RegisterAudioCallback(Transport.Get());
+				Context->AudioDeviceModule->StartPlayout();
+				State->Contexts.Add(Context);
+			}
+
+			State->StartSeconds = FPlatformTime::Seconds();
+			return true;
+		}));
+
+		ADD_LATENT_AUTOMATION_COMMAND(FDelayedFunctionLatentCommand([this, State, PullPeriodMs]()
+		{
+			const double Seconds = FPlatformTime::Seconds() - State->StartSeconds;
+			const int32 NumMeasured = FMath::Max(State->Contexts.Num(), 1);
+
+			int32 NumWakeups = 0;
+			int32 NumChunks = 0;
+			for (const auto& Transport : State->Transports)
+			{
+				NumWakeups += Transport->NumWakeups;
+				NumChunks += Transport->NumChunks;
+			}
+
+			FPullPeriodResult Result;
+			Result.PullPeriodMs = PullPeriodMs;
+			Result.WakeupsPerStreamPerSecond = NumWakeups / Seconds / NumMeasured;
+			Result.ChunksPerStreamPerSecond = NumChunks / Seconds / NumMeasured;
+			Result.CpuPercentPerStream = (FPlatformTime::GetCPUTime().CPUTimePct - State->IdleCpuPercent) / NumMeasured;
+			State->Results.Add(Result);
+
+			AddInfo(FString::Printf(TEXT("Pull period %d ms : %.1f wakeups/s, %.1f chunks/s, %.3f %% CPU per stream"),
+				Result.PullPeriodMs, Result.WakeupsPerStreamPerSecond, Result.ChunksPerStreamPerSecond, Result.CpuPercentPerStream));
+
+			for (const auto& Context : State->Contexts)
+			{
+				Context->AudioDeviceModule->StopPlayout();
+				FWebRTCFactoryManager::Get().Release(nullptr, Context);
+			}
+
+			State->Contexts.Empty();
+			State->Transports.Empty();
+		}, MeasureSeconds));
+	}
+
+	ADD_LATENT_AUTOMATION_COMMAND(FFunctionLatentCommand([this, State]()
+	{
+		if (State->Results.Num() < 2)
+		{
+			return true;
+		}
+
+		const FPullPeriodResult& Reference = State->Results[0];
+		for (const FPullPeriodResult& Result : State->Results)
+		{
+			// The same audio is pulled, in fewer and larger batches
+			const double ExpectedWakeups = 1000. / Result.PullPeriodMs;
+			TestTrue(FString::Printf(TEXT("About %.0f wakeups per second at %d ms"), ExpectedWakeups, Result.PullPeriodMs),
+				FMath::IsNearlyEqual(Result.WakeupsPerStreamPerSecond, ExpectedWakeups, ExpectedWakeups * 0.25));
+			TestTrue(FString::Printf(TEXT("Same chunk rate at %d ms"), Result.PullPeriodMs),
+				FMath::IsNearlyEqual(Result.ChunksPerStreamPerSecond, Reference.ChunksPerStreamPerSecond, Reference.ChunksPerStreamPerSecond * 0.25));
+		}
+
+		return true;
+	}));
+
+	return true;
+}
+
+#endif
@@ -0,0 +1,69 @@
+// Copyright Millicast 2023. All Rights Reserved.
+
+#include "HAL/IConsoleManager.h"
+#include "HAL/PlatformMemory.h"
+#include "Misc/AutomationTest.h"
+#include "WebRTC/PeerConnection.h"
+#include "WebRTC/WebRTCFactoryManager.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FMillicastFactoryManagerBenchmark, "Millicast.Player.WebRTC.FactoryScalingBenchmark",
+	EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::PerfFilter)
+
+bool FMillicastFactoryManagerBenchmark::RunTest(const FString& Parameters)
+{
+	using namespace Millicast::Player;
+
+	auto& Manager = FWebRTCFactoryManager::Get();
+
+	// Connections of the running game share the threads, only a clean start shows the cost of the first one
+	if (Manager.GetNumPeerConnections() != 0)
+	{
+		AddWarning(TEXT("Other peerconnections are open, skipping the benchmark"));
+		return true;
+	}
+
+	const IConsoleVariable* WorkerThreadsCVar = IConsoleManager::Get().FindConsoleVariable(TEXT("Millicast.Player.WorkerThreads"));
+	const int32 MaxWorkers = WorkerThreadsCVar ? WorkerThreadsCVar->GetInt() : 0;
+
+	const int32 SubscriberCounts[] = { 1, 4, 16, 32 };
+	for (const int32 NumSubscribers : SubscriberCounts)
+	{
+		const uint64 UsedMemoryBefore = FPlatformMemory::GetStats().UsedPhysical;
+
+		TArray<FWebRTCPeerConnection*> PeerConnections;
+		for (int32 i = 0; i < NumSubscribers; ++i)
+		{
+			if (auto* PeerConnection = FWebRTCPeerConnection::Create(FWebRTCPeerConnection::GetDefaultConfig()))
+			{
+				PeerConnection->AddRecvOnlyTransceivers();
+				PeerConnections.Add(PeerConnection);
+			}
+		}
+
+		const uint64 UsedMemoryAfter = FPlatformMemory::GetStats().UsedPhysical;
+		const int32 NumThreads = Manager.GetNumThreads();
+
+		// Before the manager, each connection had its own signaling, worker and network threads besides its audio queue
+		const int32 NumThreadsUnshared = 4 * NumSubscribers;
+		const int32 NumWorkers = MaxWorkers > 0 ? FMath::Min(NumSubscribers, MaxWorkers) : NumSubscribers;
+
+		AddInfo(FString::Printf(TEXT("%d subscribers : %d threads (%d unshared), %.2f MB per subscriber"), NumSubscribers, NumThreads,
+			NumThreadsUnshared, (static_cast<double>(UsedMemoryAfter) - UsedMemoryBefore) / NumSubscribers / (1024. * 1024.)));
+
+		TestEqual(FString::Printf(TEXT("All %d peerconnections created"), NumSubscribers), PeerConnections.Num(), NumSubscribers);
+		TestEqual(FString::Printf(TEXT("Threads of %d subscribers"), NumSubscribers), NumThreads, 2 + NumWorkers + NumSubscribers);
+
+		for (auto* PeerConnection : PeerConnections)
+		{
+			delete PeerConnection;
+		}
+
+		TestEqual(TEXT("Threads released with the last connection"), Manager.GetNumThreads(), 0);
+	}
+
+	return true;
+}
+
+#endif
@@ -0,0 +1,43 @@
+// Copyright Millicast 2023. All Rights Reserved.
+
+#include "Misc/AutomationTest.h"
+#include "Signaling/MillicastSignalingFastPath.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FMillicastSignalingFastPathIntegerTest, "Millicast.Player.Signaling.FastPath.Integers",
+	EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::EngineFilter)
+
+bool FMillicastSignalingFastPathIntegerTest::RunTest(const FString& Parameters)
+{
+	using namespace Millicast::Player;
+
+	int64 Value64 = 0;
+	TestTrue(TEXT("int64 max is parsed"), ParseJsonInteger(TEXT("9223372036854775807"), Value64) && Value64 == MAX_int64);
+	TestTrue(TEXT("int64 min is parsed"), ParseJsonInteger(TEXT("-9223372036854775808"), Value64) && Value64 == MIN_int64);
+	TestFalse(TEXT("int64 max + 1 overflows"), ParseJsonInteger(TEXT("9223372036854775808"), Value64));
+	TestFalse(TEXT("int64 min - 1 overflows"), ParseJsonInteger(TEXT("-9223372036854775809"), Value64));
+	TestFalse(TEXT("int64 max * 10 overflows"), ParseJsonInteger(TEXT("92233720368547758070"), Value64));
+
+	int32 Value32 = 0;
+	TestTrue(TEXT("int32 max is parsed"), ParseJsonInteger(TEXT("2147483647"), Value32) && Value32 == MAX_int32);
+	TestTrue(TEXT("int32 min is parsed"), ParseJsonInteger(TEXT("-2147483648"), Value32) && Value32 == MIN_int32);
+	TestFalse(TEXT("int32 max + 1 overflows"), ParseJsonInteger(TEXT("2147483648"), Value32));
+	TestFalse(TEXT("int32 min - 1 overflows"), ParseJsonInteger(TEXT("-2147483649"), Value32));
+
+	TestTrue(TEXT("zero is parsed"), ParseJsonInteger(TEXT("0"), Value32) && Value32 == 0);
+	TestFalse(TEXT("a lone minus is not a number"), ParseJsonInteger(TEXT("-"), Value32));
+	TestFalse(TEXT("a decimal is not an integer"), ParseJsonInteger(TEXT("1.5"), Value32));
+	TestFalse(TEXT("an exponent is not an integer"), ParseJsonInteger(TEXT("1e3"), Value32));
+
+	// An event that does not fit is left to the Json module instead of being read wrong
+	FSignalingMessage Message;
+	int32 NumAllocations = 0;
+	TestTrue(TEXT("viewercount is parsed"), TryParseFrequentSignalingEvent(TEXT("{\"type\":\"event\",\"name\":\"viewercount\",\"data\":{\"viewercount\":2147483647}}"), Message, NumAllocations)
+		&& Message.IsType<FSignalingViewerCountEvent>() && Message.Get<FSignalingViewerCountEvent>().Count == MAX_int32);
+	TestFalse(TEXT("viewercount overflow falls back"), TryParseFrequentSignalingEvent(TEXT("{\"type\":\"event\",\"name\":\"viewercount\",\"data\":{\"viewercount\":2147483648}}"), Message, NumAllocations));
+
+	return true;
+}
+
+#endif
@@ -0,0 +1,60 @@
+// Copyright Millicast 2023. All Rights Reserved.
+
+#pragma once
+
+#include "WebRTC/WebRTCInc.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+namespace Millicast::Player::Tests
+{
+	/**
+	 * Stands for the WebRTC mixer of one connection. Reports silence before the stream starts, like WebRTC does,
+	 * and counts the chunks pulled and the wakeups, a wakeup being a batch of chunks pulled back to back.
+	 */
+	class FTestAudioTransport : public webrtc::AudioTransport
+	{
+	public:
+		/** Whether the connection receives audio, WebRTC reports an elapsed time of -1 until then */
+		TAtomic<bool> bStreaming{ false };
+
+		TAtomic<int32> NumChunks{ 0 };
+		TAtomic<int32> NumWakeups{ 0 };
+
+		int32_t RecordedDataIsAvailable(const void*, const size_t, const size_t, const size_t, const uint32_t, const uint32_t,
+			const int32_t, const uint32_t, const bool, uint32_t&) override
+		{
+			return 0;
+		}
+
+		int32_t NeedMorePlayData(const size_t nSamples, const size_t, const size_t, const uint32_t, void*,
+			size_t& nSamplesOut, int64_t* elapsed_time_ms, int64_t* ntp_time_ms) override
+		{
+			// The chunks of one pull come within microseconds, pulls are at least 10 ms apart
+			const uint64 NowCycles = FPlatformTime::Cycles64();
+			if (FPlatformTime::ToMilliseconds64(NowCycles - LastChunkCycles) > 2.)
+			{
+				++NumWakeups;
+			}
+			LastChunkCycles = NowCycles;
+
+			++NumChunks;
+
+			nSamplesOut = nSamples;
+			*elapsed_time_ms = bStreaming ? 0 : -1;
+			*ntp_time_ms = 0;
+			return 0;
+		}
+
+		void PullRenderData(int, int, size_t, size_t, void*, int64_t* elapsed_time_ms, int64_t* ntp_time_ms) override
+		{
+			*elapsed_time_ms = -1;
+			*ntp_time_ms = 0;
+		}
+
+	private:
+		uint64 LastChunkCycles = 0;
+	};
+}
+
+#endif
@@ -6,13 +6,15 @@
 #include "MillicastPlayerPrivate.h"
 #include "MillicastUtil.h"
 #include "Async/Async.h"
+#include "ProfilingDebugging/CsvProfiler.h"
 #include "Util.h"
 
+CSV_DEFINE_CATEGORY(Millicast_Audio, false);
+
 namespace Millicast::Player
 {
 
 const char FAudioDeviceModule::kTimerQueueName[] = "FAudioDeviceModuleTimer";
-TAtomic<bool> FAudioDeviceModule::ReadDataAvailable = false;
 
 FAudioDeviceModule::FAudioDeviceModule(webrtc::TaskQueueFactory* queue_factory) noexcept
 	: TaskQueue(queue_factory->CreateTaskQueue(kTimerQueueName, webrtc::TaskQueueFactory::Priority::NORMAL))
@@ -104,16 +106,13 @@ int32_t FAudioDeviceModule::StartPlayout()
 	UE_LOG(LogMillicastPlayer, Verbose, TEXT("%S"), __FUNCTION__);
 	SetPlaying(true);
 
+	// Keep this module alive until the first Process call, each connection schedules its own pulls
 	const rtc::scoped_refptr<FAudioDeviceModule> SelfRef(this);
-#if MILLICAST_HAS_CXX20
-	AsyncGameThreadTaskUnguarded([=, this]
-#else
-	AsyncGameThreadTaskUnguarded([=]
-#endif
+	AsyncGameThreadTaskUnguarded([SelfRef]
 	{
-		ReadDataAvailable = false;
-		AudioBuffer.SetNumUninitialized(AudioParameters.GetNumberSamples() * AudioParameters.GetNumberBytesPerSample());
-		Process();
+		SelfRef->bReadDataAvailable = false;
+		SelfRef->AudioBuffer.SetNumUninitialized(SelfRef->AudioParameters.GetNumberSamples() * SelfRef->AudioParameters.GetNumberBytesPerSample());
+		SelfRef->Process();
 	});
 
 	return 0;
@@ -126,7 +125,7 @@ int32_t FAudioDeviceModule::StopPlayout()
 	SetPlaying(false);
 	
 	bIsStarted = false;
-	ReadDataAvailable = false;
+	bReadDataAvailable = false;
 
 	return 0;
 }
@@ -253,7 +252,7 @@ void FAudioDeviceModule::Process()
 	// We are on the game thread here
 	PullAudioData();
 	
-	NextFrameTime += AudioParameters.TimePerFrameMs;
+	NextFrameTime += PullPeriodMs;
 	const int64_t current_time = rtc::TimeMillis();
 	const int64_t wait_time = (NextFrameTime > current_time) ? NextFrameTime - current_time : 0;
 	
@@ -295,19 +294,35 @@ void FAudioDeviceModule::OnStatsDelivered(const rtc::scoped_refptr<const webrtc:
 	}
 }
 
+void FAudioDeviceModule::SetPullPeriodMs(int32 InPullPeriodMs)
+{
+	// WebRTC mixes 10 ms at a time, the period has to be a multiple of it
+	const int32 ChunkMs = AudioParameters.TimePerFrameMs;
+	PullPeriodMs = FMath::Max(ChunkMs, InPullPeriodMs / ChunkMs * ChunkMs);
+}
+
 void FAudioDeviceModule::PullAudioData()
 {
-	int64_t elapsed, ntp;
+	TRACE_CPUPROFILER_EVENT_SCOPE(FAudioDeviceModule::PullAudioData);
+	CSV_SCOPED_TIMING_STAT(Millicast_Audio, PullAudioData);
+	CSV_CUSTOM_STAT(Millicast_Audio, PullCount, 1, ECsvCustomStatOp::Accumulate);
+
+	int64_t elapsed = -1, ntp;
 	size_t out;
 
-	AudioCallback->NeedMorePlayData(AudioParameters.GetNumberSamples(), AudioParameters.SampleSize,
-		AudioParameters.NumberOfChannels, AudioParameters.SamplesPerSecond, AudioBuffer.GetData(),
-		out, &elapsed, &ntp);
+	// Pull the whole period in one go, track sinks batch the chunks and hand consumers a single block
+	const int32 NumChunks = PullPeriodMs / AudioParameters.TimePerFrameMs;
+	for (int32 i = 0; i < NumChunks; ++i)
+	{
+		AudioCallback->NeedMorePlayData(AudioParameters.GetNumberSamples(), AudioParameters.SampleSize,
+			AudioParameters.NumberOfChannels, AudioParameters.SamplesPerSecond, AudioBuffer.GetData(),
+			out, &elapsed, &ntp);
+	}
 
 	// Before the stream actually started playing, elapsed == -1 and all samples are silent. Don't queue those
-	ReadDataAvailable = (elapsed >= 0);
+	bReadDataAvailable = (elapsed >= 0);
 
-	if (ReadDataAvailable && !ChannelCheck)
+	if (bReadDataAvailable && !ChannelCheck && PeerConnection)
 	{
 		PeerConnection->GetStats(this);
 		ChannelCheck = true;
@@ -30,7 +30,15 @@ namespace Millicast::Player
 		static rtc::scoped_refptr<FAudioDeviceModule> Create(webrtc::TaskQueueFactory* queue_factory, FWebRTCPeerConnection* PeerConnection);
 
 	public:
-		static TAtomic<bool> ReadDataAvailable;
+		// True once WebRTC delivers real (non silent) audio for this connection
+		bool IsReadDataAvailable() const { return bReadDataAvailable; }
+
+		// How often audio is pulled from WebRTC. Longer periods mean fewer wakeups but more latency
+		void SetPullPeriodMs(int32 InPullPeriodMs);
+		int32 GetPullPeriodMs() const { return PullPeriodMs; }
+
+		// The connection queried for the audio channel count, cleared when it is released
+		void SetPeerConnection(FWebRTCPeerConnection* InPeerConnection) { PeerConnection = InPeerConnection; }
 
 	public:
 		// webrtc::AudioDeviceModule interface
@@ -203,6 +211,10 @@ namespace Millicast::Player
 
 		bool bIsStarted = false;
 
+		// Before the stream actually started playing, all samples are silent. Tracks check this before queuing
+		TAtomic<bool> bReadDataAvailable{ false };
+		TAtomic<int32> PullPeriodMs{ 10 };
+
 		bool ChannelCheck = false;
 		int64_t NextFrameTime = 0;
 
@@ -217,7 +229,7 @@ namespace Millicast::Player
 		mutable FCriticalSection CriticalSection;
 
 		FMillicastAudioParameters AudioParameters;
-		FWebRTCPeerConnection* PeerConnection;
+		FWebRTCPeerConnection* PeerConnection = nullptr;
 
 		// Inherited via RTCStatsCollectorCallback
 		void OnStatsDelivered(const rtc::scoped_refptr<const webrtc::RTCStatsReport>& report);
@@ -1,7 +1,8 @@
 #include "MillicastMediaTracks.h"
+#include "Audio/MillicastAudioMath.h"
 #include "MillicastPlayerPrivate.h"
+#include "MillicastTexture2DPlayer.h"
 #include "PeerConnection.h"
-#include "SampleBuffer.h"
 #include "Async/Async.h"
 #include "WebRTC/AudioDeviceModule.h"
 #include "Util.h"
@@ -15,6 +16,28 @@ void UMillicastVideoTrackImpl::OnFrame(const webrtc::VideoFrame& VideoFrame)
 {
 	const int32 Width = VideoFrame.width();
 	const int32 Height = VideoFrame.height();
+
+	const uint64 NowCycles = FPlatformTime::Cycles64();
+	LastFrameCycles = NowCycles;
+
+	// Set from the game thread, copied under the lock that guards its writes
+	TSharedPtr<FMillicastConnectionTimer, ESPMode::ThreadSafe> Timer;
+	{
+		FScopeLock Lock(&CriticalSection);
+		Timer = ConnectionTimer;
+	}
+
+	if (Timer)
+	{
+		Timer->MarkAt(EMillicastConnectionStage::FirstDecodedFrame, NowCycles);
+	}
+
+	const uint64 SwitchCycles = SwitchStartCycles.Exchange(0);
+	if (SwitchCycles != 0)
+	{
+		LastSwitchGapMs = FPlatformTime::ToMilliseconds64(NowCycles - SwitchCycles);
+		UE_LOG(LogMillicastPlayer, Log, TEXT("Video track %s switched, gap %.1f ms"), *Mid, LastSwitchGapMs.Load());
+	}
 	
 	if(CachedResolution.X != Width || CachedResolution.Y != Height)
 	{
@@ -63,6 +86,11 @@ void UMillicastVideoTrackImpl::OnFrame(const webrtc::VideoFrame& VideoFrame)
 				UE_LOG(LogMillicastPlayer, Warning, TEXT("Removing invalid consumer"));
 				VideoConsumers.RemoveAtSwap(Index);
 			}
+
+			if (ConnectionTimer && VideoConsumers.Num() > 0)
+			{
+				ConnectionTimer->Mark(EMillicastConnectionStage::FirstConsumerFrame);
+			}
 		}
 	});
 }
@@ -75,6 +103,12 @@ void UMillicastVideoTrackImpl::Initialize(FString InMid, rtc::scoped_refptr<webr
 	RtcVideoTrack = InVideoTrack;
 }
 
+void UMillicastVideoTrackImpl::SetConnectionTimer(TSharedPtr<FMillicastConnectionTimer, ESPMode::ThreadSafe> InConnectionTimer)
+{
+	FScopeLock Lock(&CriticalSection);
+	ConnectionTimer = MoveTemp(InConnectionTimer);
+}
+
 UMillicastVideoTrackImpl::~UMillicastVideoTrackImpl()
 {
 	UE_LOG(LogMillicastPlayer, Verbose, TEXT("%S"), __FUNCTION__);
@@ -121,6 +155,29 @@ void UMillicastVideoTrackImpl::Terminate()
 	VideoConsumers.Empty();
 }
 
+void UMillicastVideoTrackImpl::ReplaceTrack(rtc::scoped_refptr<webrtc::MediaStreamTrackInterface> InVideoTrack)
+{
+	UE_LOG(LogMillicastPlayer, Verbose, TEXT("%S"), __FUNCTION__);
+
+	FScopeLock Lock(&CriticalSection);
+
+	if (VideoConsumers.Num() > 0)
+	{
+		if (RtcVideoTrack)
+		{
+			static_cast<webrtc::VideoTrackInterface*>(RtcVideoTrack.get())->RemoveSink(this);
+		}
+
+		static_cast<webrtc::VideoTrackInterface*>(InVideoTrack.get())->AddOrUpdateSink(this, rtc::VideoSinkWants{});
+	}
+
+	// Nothing was rendered yet, the gap runs from the switch itself
+	const uint64 LastCycles = LastFrameCycles;
+	SwitchStartCycles = LastCycles != 0 ? LastCycles : FPlatformTime::Cycles64();
+
+	RtcVideoTrack = InVideoTrack;
+}
+
 void UMillicastVideoTrackImpl::AddConsumer(TScriptInterface<IMillicastVideoConsumer> VideoConsumer)
 {
 	UE_LOG(LogMillicastPlayer, Verbose, TEXT("%S"), __FUNCTION__);
@@ -137,6 +194,11 @@ void UMillicastVideoTrackImpl::AddConsumer(TScriptInterface<IMillicastVideoConsu
 	{
 		FScopeLock Lock(&CriticalSection);
 
+		if (auto* TexturePlayer = Cast<UMillicastTexture2DPlayer>(VideoConsumer.GetObject()))
+		{
+			TexturePlayer->SetConnectionTimer(ConnectionTimer);
+		}
+
 		// don't add consumer if already there
 		if (VideoConsumers.Contains(consumer))
 		{
@@ -180,38 +242,133 @@ void UMillicastVideoTrackImpl::RemoveConsumer(TScriptInterface<IMillicastVideoCo
 
 void UMillicastAudioTrackImpl::OnData(const void* AudioData, int BitPerSample, int SampleRate, size_t NumberOfChannels, size_t NumberOfFrames)
 {
-	// TODO [RW] this is bad, we limit usage to one AudioDeviceModule. Needs to not be static anymore
-	if (!Millicast::Player::FAudioDeviceModule::ReadDataAvailable)
-	{
-		// Do not error log here, this is normal if no audio is being streamed
-		return;
-	}
-	
 	if (SampleRate != 48000)
 	{
 		UE_LOG(LogMillicastPlayer, Verbose, TEXT("Audio sample rate is not 48kHz"));
 		return;
 	}
 
-	Audio::TSampleBuffer<int16> Buffer(static_cast<const int16*>(AudioData), NumberOfFrames * NumberOfChannels, NumberOfChannels, SampleRate);
-
 	// Queue Audio Data for Consumers
 	{
 		FScopeLock Lock(&CriticalSection);
 
-		for (auto& ConsumerRef : AudioConsumers)
+		// Each connection has its own audio device module, so one stream never gates another
+		if (!AudioDeviceModule || !AudioDeviceModule->IsReadDataAvailable())
 		{
-			if (auto* Consumer = ConsumerRef.Get())
-			{
-				const auto& Params = Consumer->GetAudioParameters();
-				if (Params.NumberOfChannels != NumberOfChannels)
-				{
-					Buffer.MixBufferToChannels(Params.NumberOfChannels);
-				}
+			// Do not error log here, this is normal if no audio is being streamed
+			return;
+		}
+
+		const int16* PcmData = static_cast<const int16*>(AudioData);
+		const int32 NumSamples = NumberOfFrames * NumberOfChannels;
+
+		// Levels are measured on every chunk, whatever the pull period, so meters stay at 10 ms resolution
+		FloatBuffer.SetNumUninitialized(NumSamples, false);
+		Millicast::Player::AudioMath::ConvertInt16ToFloat(PcmData, FloatBuffer.GetData(), NumSamples);
+		UpdateAudioLevels(FloatBuffer.GetData(), NumSamples);
+
+		// The sink stays attached for the levels, there may be no one to hand the samples to
+		if (AudioConsumers.Num() == 0)
+		{
+			BatchFrames = 0;
+			return;
+		}
+
+		const int32 BatchTargetFrames = AudioDeviceModule->GetPullPeriodMs() * SampleRate / 1000;
+
+		// Default 10 ms period, WebRTC's chunk is the block
+		if (BatchTargetFrames <= static_cast<int32>(NumberOfFrames) && BatchFrames == 0)
+		{
+			DeliverAudioData(PcmData, FloatBuffer.GetData(), SampleRate, NumberOfChannels, NumberOfFrames);
+			return;
+		}
+
+		// Don't mix channel layouts in one block
+		if (BatchFrames > 0 && BatchChannels != static_cast<int32>(NumberOfChannels))
+		{
+			DeliverAudioData(BatchBuffer.GetData(), FloatBatchBuffer.GetData(), SampleRate, BatchChannels, BatchFrames);
+			BatchFrames = 0;
+		}
+
+		// The float samples of the levels are batched along, so they are not converted again for the consumers
+		const int32 BatchOffset = BatchFrames * NumberOfChannels;
+		BatchBuffer.SetNumUninitialized(BatchOffset + NumSamples, false);
+		FloatBatchBuffer.SetNumUninitialized(BatchOffset + NumSamples, false);
+		FMemory::Memcpy(BatchBuffer.GetData() + BatchOffset, PcmData, NumSamples * sizeof(int16));
+		FMemory::Memcpy(FloatBatchBuffer.GetData() + BatchOffset, FloatBuffer.GetData(), NumSamples * sizeof(float));
+		BatchFrames += NumberOfFrames;
+		BatchChannels = NumberOfChannels;
+
+		if (BatchFrames >= BatchTargetFrames)
+		{
+			DeliverAudioData(BatchBuffer.GetData(), FloatBatchBuffer.GetData(), SampleRate, BatchChannels, BatchFrames);
+			BatchFrames = 0;
+		}
+	}
+}
+
+void UMillicastAudioTrackImpl::UpdateAudioLevels(const float* FloatData, int32 NumSamples)
+{
+	// Keeps the voice active for 200 ms after the level drops, so pauses between words don't flicker
+	constexpr int32 HangoverChunks = 20;
+
+	float SumOfSquares = 0.f;
+	float PeakLevel = 0.f;
+	Millicast::Player::AudioMath::ComputeLevels(FloatData, NumSamples, SumOfSquares, PeakLevel);
+
+	const float RmsLevel = NumSamples > 0 ? FMath::Sqrt(SumOfSquares / NumSamples) : 0.f;
+
+	if (RmsLevel >= VoiceActivityThreshold.Load())
+	{
+		VoiceHangoverChunks = HangoverChunks;
+	}
+	else if (VoiceHangoverChunks > 0)
+	{
+		--VoiceHangoverChunks;
+	}
+
+	Rms = RmsLevel;
+	Peak = PeakLevel;
+	bVoiceActive = VoiceHangoverChunks > 0;
+}
+
+void UMillicastAudioTrackImpl::DeliverAudioData(const int16* PcmData, const float* FloatData, int32 SampleRate, int32 NumberOfChannels, int32 NumberOfFrames)
+{
+	const int32 NumSamples = NumberOfFrames * NumberOfChannels;
 
-				Consumer->QueueAudioData((uint8*)Buffer.GetData(), NumberOfFrames);
+	for (auto& ConsumerRef : AudioConsumers)
+	{
+		auto* Consumer = ConsumerRef.Get();
+		if (!Consumer)
+		{
+			continue;
+		}
+
+		const auto Params = Consumer->GetAudioParameters();
+		if (Params.SampleFormat == EMillicastAudioSampleFormat::Float32)
+		{
+			if (Params.NumberOfChannels != NumberOfChannels)
+			{
+				FloatMixBuffer.CopyPCMData(FloatData, NumSamples, NumberOfChannels, SampleRate);
+				FloatMixBuffer.MixBufferToChannels(Params.NumberOfChannels);
+				Consumer->QueueAudioData((const uint8*)FloatMixBuffer.GetData(), NumberOfFrames);
+				continue;
 			}
+
+			Consumer->QueueAudioData((const uint8*)FloatData, NumberOfFrames);
+			continue;
 		}
+
+		// Only copy the samples when they have to be remixed, otherwise hand out WebRTC's buffer directly
+		if (Params.NumberOfChannels != NumberOfChannels)
+		{
+			PcmMixBuffer.CopyPCMData(PcmData, NumSamples, NumberOfChannels, SampleRate);
+			PcmMixBuffer.MixBufferToChannels(Params.NumberOfChannels);
+			Consumer->QueueAudioData((const uint8*)PcmMixBuffer.GetData(), NumberOfFrames);
+			continue;
+		}
+
+		Consumer->QueueAudioData((const uint8*)PcmData, NumberOfFrames);
 	}
 }
 
@@ -219,20 +376,31 @@ UMillicastAudioTrackImpl::~UMillicastAudioTrackImpl()
 {
 	UE_LOG(LogMillicastPlayer, Verbose, TEXT("%S"), __FUNCTION__);
 
-	if (AudioConsumers.Num() > 0 && RtcAudioTrack)
+	if (RtcAudioTrack)
 	{
-		UE_LOG(LogMillicastPlayer, Verbose, TEXT("Clearing audio consumers"));
+		UE_LOG(LogMillicastPlayer, Verbose, TEXT("Remove audio sink"));
 		auto track = static_cast<webrtc::AudioTrackInterface*>(RtcAudioTrack.get());
 		track->RemoveSink(this);
 	}
 }
 
-void UMillicastAudioTrackImpl::Initialize(FString InMid, rtc::scoped_refptr<webrtc::MediaStreamTrackInterface> InAudioTrack)
+void UMillicastAudioTrackImpl::Initialize(FString InMid, rtc::scoped_refptr<webrtc::MediaStreamTrackInterface> InAudioTrack,
+	rtc::scoped_refptr<Millicast::Player::FAudioDeviceModule> InAudioDeviceModule)
 {
 	UE_LOG(LogMillicastPlayer, Verbose, TEXT("%S"), __FUNCTION__);
 
+	FScopeLock Lock(&CriticalSection);
+
 	Mid = MoveTemp(InMid);
 	RtcAudioTrack = InAudioTrack;
+	AudioDeviceModule = InAudioDeviceModule;
+
+	// Attached for the lifetime of the track, so the levels and the voice activity are measured without consumers
+	if (RtcAudioTrack)
+	{
+		UE_LOG(LogMillicastPlayer, VeryVerbose, TEXT("Adding audio sink"));
+		static_cast<webrtc::AudioTrackInterface*>(RtcAudioTrack.get())->AddSink(this);
+	}
 }
 
 FString UMillicastAudioTrackImpl::GetMid() const noexcept
@@ -264,8 +432,57 @@ void UMillicastAudioTrackImpl::SetEnabled(bool Enabled)
 void UMillicastAudioTrackImpl::Terminate()
 {
 	UE_LOG(LogMillicastPlayer, Verbose, TEXT("%S"), __FUNCTION__);
+
+	FScopeLock Lock(&CriticalSection);
+
+	if (RtcAudioTrack)
+	{
+		static_cast<webrtc::AudioTrackInterface*>(RtcAudioTrack.get())->RemoveSink(this);
+	}
+
 	RtcAudioTrack = nullptr;
+	AudioDeviceModule = nullptr;
 	AudioConsumers.Empty();
+
+	Rms = 0.f;
+	Peak = 0.f;
+	bVoiceActive = false;
+}
+
+void UMillicastAudioTrackImpl::ReplaceTrack(rtc::scoped_refptr<webrtc::MediaStreamTrackInterface> InAudioTrack,
+	rtc::scoped_refptr<Millicast::Player::FAudioDeviceModule> InAudioDeviceModule)
+{
+	UE_LOG(LogMillicastPlayer, Verbose, TEXT("%S"), __FUNCTION__);
+
+	FScopeLock Lock(&CriticalSection);
+
+	if (RtcAudioTrack)
+	{
+		static_cast<webrtc::AudioTrackInterface*>(RtcAudioTrack.get())->RemoveSink(this);
+	}
+
+	static_cast<webrtc::AudioTrackInterface*>(InAudioTrack.get())->AddSink(this);
+
+	RtcAudioTrack = InAudioTrack;
+	AudioDeviceModule = InAudioDeviceModule;
+
+	// A partial block of the previous track is not worth delaying the new one for
+	BatchFrames = 0;
+}
+
+FMillicastAudioLevels UMillicastAudioTrackImpl::GetAudioLevels() const
+{
+	FMillicastAudioLevels Levels;
+	Levels.Rms = Rms;
+	Levels.Peak = Peak;
+	Levels.bVoiceActive = bVoiceActive;
+
+	return Levels;
+}
+
+void UMillicastAudioTrackImpl::SetVoiceActivityThreshold(float ThresholdDb)
+{
+	VoiceActivityThreshold = FMath::Pow(10.f, ThresholdDb / 20.f);
 }
 
 void UMillicastAudioTrackImpl::AddConsumer(TScriptInterface<IMillicastExternalAudioConsumer> AudioConsumer)
@@ -291,11 +508,12 @@ void UMillicastAudioTrackImpl::AddConsumer(TScriptInterface<IMillicastExternalAu
 			return;
 		}
 
-		if (AudioConsumers.Num() == 0)
+		// Consumers receive one block per pull period, let them size their buffering accordingly
+		if (AudioDeviceModule)
 		{
-			UE_LOG(LogMillicastPlayer, VeryVerbose, TEXT("Adding audio sink"));
-			auto track = static_cast<webrtc::AudioTrackInterface*>(RtcAudioTrack.get());
-			track->AddSink(this);
+			auto Params = WeakConsumer->GetAudioParameters();
+			Params.TimePerFrameMs = AudioDeviceModule->GetPullPeriodMs();
+			WeakConsumer->UpdateAudioParameters(MoveTemp(Params));
 		}
 
 		WeakConsumer->Initialize();
@@ -316,12 +534,5 @@ void UMillicastAudioTrackImpl::RemoveConsumer(TScriptInterface<IMillicastExterna
 		FScopeLock Lock(&CriticalSection);
 
 		AudioConsumers.Remove(consumer);
-
-		if (AudioConsumers.Num() == 0)
-		{
-			UE_LOG(LogMillicastPlayer, VeryVerbose, TEXT("Remove audio sink"));
-			auto track = static_cast<webrtc::AudioTrackInterface*>(RtcAudioTrack.get());
-			track->RemoveSink(this);
-		}
 	}	
 }
@@ -3,6 +3,9 @@
 #pragma once
 
 #include "IMillicastMediaTrack.h"
+#include "MillicastConnectionTimings.h"
+#include "SampleBuffer.h"
+#include "WebRTC/AudioDeviceModule.h"
 
 #include <api/media_stream_interface.h>
 #include <UObject/WeakInterfacePtr.h>
@@ -27,6 +30,14 @@ private:
 	TArray<uint8> Buffer;
 	FIntPoint CachedResolution;
 
+	// Time of the last frame, and of the switch to another WebRTC track, used to measure the gap a switch causes
+	TAtomic<uint64> LastFrameCycles{ 0 };
+	TAtomic<uint64> SwitchStartCycles{ 0 };
+	TAtomic<float> LastSwitchGapMs{ -1.f };
+
+	// Marks the first decoded frame and the first frame handed to the consumers
+	TSharedPtr<FMillicastConnectionTimer, ESPMode::ThreadSafe> ConnectionTimer;
+
 protected:
 	/* VideoSinkInterface */
 	void OnFrame(const webrtc::VideoFrame& VideoFrame) override;
@@ -34,6 +45,9 @@ protected:
 public:
 	void Initialize(FString InMid, rtc::scoped_refptr<webrtc::MediaStreamTrackInterface> InVideoTrack);
 
+	/** Must be set before adding consumers. Texture players added afterwards get it too, to mark their first upload */
+	void SetConnectionTimer(TSharedPtr<FMillicastConnectionTimer, ESPMode::ThreadSafe> InConnectionTimer);
+
 	~UMillicastVideoTrackImpl() override;
 
 	/* UMillicastMediaTrack overrides */
@@ -49,6 +63,12 @@ public:
 
 	void Terminate();
 
+	/** Receive the frames of another WebRTC track from now on, keeping the consumers. Used when migrating to another connection */
+	void ReplaceTrack(rtc::scoped_refptr<webrtc::MediaStreamTrackInterface> InVideoTrack);
+
+	/** Time between the last frame of the previous WebRTC track and the first frame of the new one, -1 if the track was never replaced */
+	float GetLastSwitchGapMs() const { return LastSwitchGapMs; }
+
 	/* UMillicastVideoTrack overrides */
 	void AddConsumer(TScriptInterface<IMillicastVideoConsumer> VideoConsumer) override;
 	void RemoveConsumer(TScriptInterface<IMillicastVideoConsumer> VideoConsumer) override;
@@ -66,10 +86,39 @@ private:
 	rtc::scoped_refptr<webrtc::MediaStreamTrackInterface> RtcAudioTrack;
 	FString Mid;
 
+	// Audio device module of the connection this track belongs to. Gates queuing until its audio is actually playing
+	rtc::scoped_refptr<Millicast::Player::FAudioDeviceModule> AudioDeviceModule;
+
 	TArray<TWeakInterfacePtr<IMillicastExternalAudioConsumer>> AudioConsumers;
 
 	FCriticalSection CriticalSection;
 
+	// Float copy of the last decoded samples, reused across callbacks for the levels and the Float32 consumers
+	TArray<float> FloatBuffer;
+
+	// 10 ms chunks pulled in the same batch, delivered together once the pull period is reached
+	TArray<int16> BatchBuffer;
+	TArray<float> FloatBatchBuffer;
+	int32 BatchFrames = 0;
+	int32 BatchChannels = 0;
+
+	// Levels of the last chunk, written by the WebRTC audio thread and read lock free by anyone
+	TAtomic<float> Rms{ 0.f };
+	TAtomic<float> Peak{ 0.f };
+	TAtomic<bool> bVoiceActive{ false };
+	TAtomic<float> VoiceActivityThreshold{ 0.0056f }; // -45 dBFS
+	int32 VoiceHangoverChunks = 0;
+
+	// Samples remixed for the consumers asking for another channel count, reused across blocks
+	Audio::TSampleBuffer<float> FloatMixBuffer;
+	Audio::TSampleBuffer<int16> PcmMixBuffer;
+
+	// Hands a block, in both sample formats, to every consumer. CriticalSection must be held
+	void DeliverAudioData(const int16* PcmData, const float* FloatData, int32 SampleRate, int32 NumberOfChannels, int32 NumberOfFrames);
+
+	// Updates the levels and the voice activity from the float samples of one chunk
+	void UpdateAudioLevels(const float* FloatData, int32 NumSamples);
+
 protected:
 	/* VideoSinkInterface */
 	void OnData(const void* AudioData, int BitPerSample, int SampleRate, size_t NumberOfChannels, size_t NumberOfFrames) override;
@@ -77,7 +126,8 @@ protected:
 public:
 	~UMillicastAudioTrackImpl() override;
 
-	void Initialize(FString InMid, rtc::scoped_refptr<webrtc::MediaStreamTrackInterface> InAudioTrack);
+	void Initialize(FString InMid, rtc::scoped_refptr<webrtc::MediaStreamTrackInterface> InAudioTrack,
+		rtc::scoped_refptr<Millicast::Player::FAudioDeviceModule> InAudioDeviceModule);
 
 	/* UMillicastMediaTrack overrides */
 	FString GetMid() const noexcept override;
@@ -92,9 +142,17 @@ public:
 
 	void Terminate();
 
+	/** Receive the samples of another WebRTC track from now on, keeping the consumers. Used when migrating to another connection */
+	void ReplaceTrack(rtc::scoped_refptr<webrtc::MediaStreamTrackInterface> InAudioTrack,
+		rtc::scoped_refptr<Millicast::Player::FAudioDeviceModule> InAudioDeviceModule);
+
 	/* UMillicastVideoTrack overrides */
 	void AddConsumer(TScriptInterface<IMillicastExternalAudioConsumer> AudioConsumer) override;
 
 	void RemoveConsumer(TScriptInterface<IMillicastExternalAudioConsumer> AudioConsumer) override;
+
+	FMillicastAudioLevels GetAudioLevels() const override;
+
+	void SetVoiceActivityThreshold(float ThresholdDb) override;
 };
 
@@ -7,46 +7,24 @@
 #include <api/jsep_session_description.h>
 
 #include "AudioDeviceModule.h"
+#include "WebRTCFactoryManager.h"
+#include "WebRTC/PlayerStats.h"
 #include "WebRTC/PlayerStatsCollector.h"
 #include "MillicastPlayerPrivate.h"
 #include "MillicastUtil.h"
-
-namespace
-{
-#if WEBRTC_VERSION < 96
-// Missing in old version of libwebrtc
-std::unique_ptr<webrtc::SessionDescriptionInterface> CloneSessionDescription(const webrtc::SessionDescriptionInterface* Source)
-{
-	auto NewDescription = std::make_unique<webrtc::JsepSessionDescription>(Source->GetType(),
-		Source->description()->Clone(),
-		Source->session_id(),
-		Source->session_version());
-
-	for (size_t i = 0; i < Source->number_of_mediasections(); ++i)
-	{
-		auto candidates = Source->candidates(i);
-		for (size_t j = 0; j < candidates->count(); ++j) {
-			auto c = candidates->at(j);
-			auto new_candidate = webrtc::CreateIceCandidate(c->sdp_mid(),
-				c->sdp_mline_index(),
-				c->candidate());
-			NewDescription->AddCandidate(new_candidate.release());
-		}
-	}
-
-	return NewDescription;
-}
-#endif
-}
+#include "Util.h"
 
 namespace Millicast::Player
 {
 
+static TAtomic<uint64> LastPeerConnectionId{ 0 };
+
 class FFrameTransformer : public webrtc::FrameTransformerInterface
 {
 	std::unordered_map <uint64_t, rtc::scoped_refptr<webrtc::TransformedFrameCallback>> Callbacks; // ssrc, callback
 	TArray<uint8> UserData;
 	FWebRTCPeerConnection* PeerConnection{ nullptr };
+	TSharedRef<FPeerConnectionLifetime, ESPMode::ThreadSafe> Lifetime;
 
 	using FMetadataHeader = uint32_t;
 	static constexpr auto HEADER_TYPE_LENGTH = sizeof(FMetadataHeader);
@@ -54,7 +32,8 @@ class FFrameTransformer : public webrtc::FrameTransformerInterface
 	static constexpr FMetadataHeader START_VALUE = 0xCAFEBABE;
 
 public:
-	explicit FFrameTransformer(FWebRTCPeerConnection * InPeerConnection) noexcept : PeerConnection(InPeerConnection) {}
+	FFrameTransformer(FWebRTCPeerConnection* InPeerConnection, TSharedRef<FPeerConnectionLifetime, ESPMode::ThreadSafe> InLifetime) noexcept
+		: PeerConnection(InPeerConnection), Lifetime(MoveTemp(InLifetime)) {}
 
 	~FFrameTransformer() = default;
 
@@ -106,10 +85,13 @@ public:
 					UserData.Append(data_view.data() + length - user_data_length - HEADER_TYPE_LENGTH, 
 						user_data_length);
 
-					// Provide the extracted data to the user
-					if (PeerConnection->OnFrameMetadata)
+					// Provide the extracted data to the user, the receiver may outlive the connection
 					{
-						PeerConnection->OnFrameMetadata(ssrc, TransformableFrame->GetTimestamp(), UserData);
+						FScopeLock Lock(&Lifetime->Section);
+						if (Lifetime->bAlive && PeerConnection->OnFrameMetadata)
+						{
+							PeerConnection->OnFrameMetadata(ssrc, TransformableFrame->GetTimestamp(), UserData);
+						}
 					}
 
 					// Set the final transformed data.
@@ -134,97 +116,41 @@ public:
 	}
 };
 
-TAtomic<int> FWebRTCPeerConnection::RefCounter = 0;
-
-void FWebRTCPeerConnection::CreatePeerConnectionFactory()
+FWebRTCPeerConnection::~FWebRTCPeerConnection() noexcept
 {
 	UE_LOG(LogMillicastPlayer, Verbose, TEXT("%S"), __FUNCTION__);
 
-	if (RefCounter == 0)
+	// The signaling thread is shared and keeps running, callbacks still queued on it must not reach this wrapper
 	{
-		UE_LOG(LogMillicastPlayer, Log, TEXT("Initialize ssl and random"));
-
-		++RefCounter; // increase ref count, todo: move this in the start of module
-		rtc::InitializeSSL();
-		rtc::InitRandom(static_cast<int>(rtc::Time()));
+		FScopeLock Lock(&Lifetime->Section);
+		Lifetime->bAlive = false;
 	}
-	else
-	{
-		++RefCounter;
-	}
-
-	UE_LOG(LogMillicastPlayer, Log, TEXT("Creating Signaling thread"));
-	SignalingThread = TUniquePtr<rtc::Thread>(rtc::Thread::Create().release());
-	SignalingThread->SetName("WebRTCSignalingThread", nullptr);
-	SignalingThread->Start();
-
-	UE_LOG(LogMillicastPlayer, Log, TEXT("Creating Worker thread"));
-	WorkingThread = TUniquePtr<rtc::Thread>(rtc::Thread::Create().release());
-	WorkingThread->SetName("WebRTCWorkerThread", nullptr);
-	WorkingThread->Start();
 
-	UE_LOG(LogMillicastPlayer, Log, TEXT("Creating Networking thread"));
-	NetworkingThread = TUniquePtr<rtc::Thread>(rtc::Thread::CreateWithSocketServer().release());
-	NetworkingThread->SetName("WebRTCNetworkThread", nullptr);
-	NetworkingThread->Start();
-
-	UE_LOG(LogMillicastPlayer, Log, TEXT("Creating audio device module"));
-	TaskQueueFactory = webrtc::CreateDefaultTaskQueueFactory();
-	AudioDeviceModule = FAudioDeviceModule::Create(TaskQueueFactory.get(), this);
-
-	UE_LOG(LogMillicastPlayer, Log, TEXT("Creating Peerconnection factory. Count %d"), RefCounter.Load());
-	PeerConnectionFactory = webrtc::CreatePeerConnectionFactory(
-		NetworkingThread.Get(), WorkingThread.Get(), SignalingThread.Get(),
-		AudioDeviceModule,
-		webrtc::CreateAudioEncoderFactory<webrtc::AudioEncoderOpus, webrtc::AudioEncoderMultiChannelOpus>(),
-		webrtc::CreateAudioDecoderFactory<webrtc::AudioDecoderOpus, webrtc::AudioDecoderMultiChannelOpus>(),
-		webrtc::CreateBuiltinVideoEncoderFactory(),
-		webrtc::CreateBuiltinVideoDecoderFactory(),
-		nullptr,
-		nullptr
-	).release();
-
-	// Check
-	if (!PeerConnectionFactory)
+#if ENGINE_MAJOR_VERSION >= 5 && ENGINE_MINOR_VERSION > 0
+	// The sampler must not poll while the peerconnection is released. A pending report is delivered when it closes
+	if (RTCStatsCollector)
 	{
-		UE_LOG(LogMillicastPlayer, Error, TEXT("Creating PeerConnectionFactory | Failed"));
-		return;
+		RTCStatsCollector->Detach();
 	}
+#endif
 
-	webrtc::PeerConnectionFactoryInterface::Options Options;
-	Options.crypto_options.srtp.enable_gcm_crypto_suites = true;
-	PeerConnectionFactory->SetOptions(Options);
-}
-
-FWebRTCPeerConnection::~FWebRTCPeerConnection() noexcept
-{
-	UE_LOG(LogMillicastPlayer, Verbose, TEXT("%S"), __FUNCTION__);
-
-	PeerConnection = nullptr;
-
-	// We take another reference count here in the lambda, to make sure it does not go out of scope before the callback is called
-	UE_LOG(LogMillicastPlayer, Verbose, TEXT("Stop audio device module"));
-	AsyncGameThreadTaskUnguarded([RefAudioDeviceModule = AudioDeviceModule]()
+	// Receivers may outlive this wrapper, and so may the peerconnection when a pending offer holds it.
+	// Closing it stops the observer callbacks, which are not reference counted
+	if (PeerConnection)
 	{
-		RefAudioDeviceModule->SetPlaying(false);
-	});
-	
-	UE_LOG(LogMillicastPlayer, Verbose, TEXT("Destroy peerconnectino factory, count %d"), RefCounter.Load());
-	PeerConnectionFactory = nullptr;
-	AudioDeviceModule = nullptr;
+		for (const auto& Receiver : PeerConnection->GetReceivers())
+		{
+			Receiver->SetObserver(nullptr);
+		}
 
-	UE_LOG(LogMillicastPlayer, Verbose, TEXT("Stop webrtc thread"));
-	SignalingThread->Stop();
-	NetworkingThread->Stop();
-	WorkingThread->Stop();
+		PeerConnection->Close();
+	}
 
-	--RefCounter;
+	PeerConnection = nullptr;
 
-	if (RefCounter == 0)
-	{
-		UE_LOG(LogMillicastPlayer, Verbose, TEXT("Cleanup ssl"));
-		rtc::CleanupSSL(); // move this in the startup module
-	}
+	// The factory, its threads and the audio device module only go away when no other connection uses them
+	FWebRTCFactoryManager::Get().Release(this, FactoryContext);
+	FactoryContext = nullptr;
 }
 
 webrtc::PeerConnectionInterface::RTCConfiguration FWebRTCPeerConnection::GetDefaultConfig()
@@ -240,22 +166,40 @@ webrtc::PeerConnectionInterface::RTCConfiguration FWebRTCPeerConnection::GetDefa
 	return Config;
 }
 
-FWebRTCPeerConnection* FWebRTCPeerConnection::Create(const FRTCConfig& Config)
+FWebRTCPeerConnection* FWebRTCPeerConnection::Create(const FRTCConfig& Config, int32 AudioPullPeriodMs)
 {
 	UE_LOG(LogMillicastPlayer, Verbose, TEXT("%S"), __FUNCTION__);
 
 	FWebRTCPeerConnection* PeerConnectionInstance = new FWebRTCPeerConnection();
+	PeerConnectionInstance->Id = ++LastPeerConnectionId;
 
-	PeerConnectionInstance->Init(Config);
+	PeerConnectionInstance->Init(Config, AudioPullPeriodMs);
+
+	if (!PeerConnectionInstance->PeerConnection)
+	{
+		delete PeerConnectionInstance;
+		return nullptr;
+	}
 
 	return PeerConnectionInstance;
 }
 
-void FWebRTCPeerConnection::Init(const FRTCConfig& Config)
+void FWebRTCPeerConnection::Init(const FRTCConfig& Config, int32 AudioPullPeriodMs)
 {
 	UE_LOG(LogMillicastPlayer, Verbose, TEXT("%S"), __FUNCTION__);
 
-	CreatePeerConnectionFactory();
+	// Opus is mono unless the offer asks for stereo
+	LocalDescriptionEditor.SetCodecParameter(cricket::MediaType::MEDIA_TYPE_AUDIO, cricket::kOpusCodecName, cricket::kCodecParamStereo, "1");
+
+	FactoryContext = FWebRTCFactoryManager::Get().Acquire(this, AudioPullPeriodMs);
+	SignalingThread = FWebRTCFactoryManager::Get().GetSignalingThread();
+
+	if (!FactoryContext)
+	{
+		return;
+	}
+
+	auto& PeerConnectionFactory = FactoryContext->PeerConnectionFactory;
 
 	webrtc::PeerConnectionDependencies Dependencies(this);
 	UE_LOG(LogMillicastPlayer, Verbose, TEXT("Creating peerconnection"));
@@ -273,11 +217,21 @@ void FWebRTCPeerConnection::Init(const FRTCConfig& Config)
 	PeerConnection = PeerConnectionFactory->CreatePeerConnection(Config, nullptr, nullptr, this);
 #endif
 
+	ResetObservers();
+}
+
+void FWebRTCPeerConnection::ResetObservers()
+{
 	CreateSessionDescription = MakeUnique<FCreateSessionDescriptionObserver>();
 	LocalSessionDescription = MakeUnique<FSetSessionDescriptionObserver>();
 	RemoteSessionDescription = MakeUnique<FSetSessionDescriptionObserver>();
 }
 
+rtc::scoped_refptr<FAudioDeviceModule> FWebRTCPeerConnection::GetAudioDeviceModule() const
+{
+	return FactoryContext ? FactoryContext->AudioDeviceModule : nullptr;
+}
+
 FWebRTCPeerConnection::FSetSessionDescriptionObserver*
 FWebRTCPeerConnection::GetLocalDescriptionObserver()
 {
@@ -319,9 +273,151 @@ void FWebRTCPeerConnection::CreateOffer()
 {
 	UE_LOG(LogMillicastPlayer, VeryVerbose, TEXT("%S"), __FUNCTION__);
 
-	SignalingThread->PostTask(RTC_FROM_HERE, [this]() {
-		PeerConnection->CreateOffer(CreateSessionDescription.Release(), OaOptions);
+	// Only reference counted copies, the wrapper may be deleted before the task runs on the shared signaling thread
+	rtc::scoped_refptr<webrtc::PeerConnectionInterface> Pc = PeerConnection;
+	rtc::scoped_refptr<FCreateSessionDescriptionObserver> Observer(CreateSessionDescription.Release());
+	const webrtc::PeerConnectionInterface::RTCOfferAnswerOptions Options = OaOptions;
+
+	SignalingThread->PostTask(RTC_FROM_HERE, [Pc, Observer, Options]() {
+		Pc->CreateOffer(Observer.get(), Options);
+	});
+}
+
+int32 FWebRTCPeerConnection::AddRemoteTransceivers(const TArray<cricket::MediaType>& MediaTypes)
+{
+	int32 NumAdded = 0;
+
+	// In a single signaling thread task, so that the negotiation needed events all come after the last transceiver
+	SignalingThread->Invoke<void>(RTC_FROM_HERE, [&]()
+	{
+		webrtc::RtpTransceiverInit Init;
+		Init.direction = webrtc::RtpTransceiverDirection::kRecvOnly;
+
+		for (const cricket::MediaType MediaType : MediaTypes)
+		{
+			const auto Result = PeerConnection->AddTransceiver(MediaType, Init);
+			if (!Result.ok())
+			{
+				UE_LOG(LogMillicastPlayer, Error, TEXT("Failed to add transceiver for remote track : %S"), Result.error().message());
+				continue;
+			}
+
+			ApplyCodecPreferences(Result.value());
+			++NumAdded;
+		}
+	});
+
+	return NumAdded;
+}
+
+void FWebRTCPeerConnection::AddRecvOnlyTransceivers()
+{
+	webrtc::RtpTransceiverInit Init;
+	Init.direction = webrtc::RtpTransceiverDirection::kRecvOnly;
+
+	PeerConnection->AddTransceiver(cricket::MediaType::MEDIA_TYPE_AUDIO, Init);
+
+	const auto Result = PeerConnection->AddTransceiver(cricket::MediaType::MEDIA_TYPE_VIDEO, Init);
+	if (Result.ok())
+	{
+		ApplyCodecPreferences(Result.value());
+	}
+}
+
+void FWebRTCPeerConnection::ApplyCodecPreferences(const rtc::scoped_refptr<webrtc::RtpTransceiverInterface>& Transceiver) const
+{
+	if (VideoCodecPreferences.Num() == 0 || !FactoryContext || Transceiver->media_type() != cricket::MediaType::MEDIA_TYPE_VIDEO)
+	{
+		return;
+	}
+
+	const auto Capabilities = FactoryContext->PeerConnectionFactory->GetRtpReceiverCapabilities(cricket::MediaType::MEDIA_TYPE_VIDEO);
+
+	const auto IsPreferred = [](const webrtc::RtpCodecCapability& Codec, const FString& Name)
+	{
+		return ToString(Codec.name).Equals(Name, ESearchCase::IgnoreCase);
+	};
+
+	std::vector<webrtc::RtpCodecCapability> Codecs;
+	Codecs.reserve(Capabilities.codecs.size());
+
+	for (const FString& Name : VideoCodecPreferences)
+	{
+		std::copy_if(Capabilities.codecs.begin(), Capabilities.codecs.end(), std::back_inserter(Codecs),
+			[&](const webrtc::RtpCodecCapability& Codec) { return IsPreferred(Codec, Name); });
+	}
+
+	if (Codecs.empty())
+	{
+		UE_LOG(LogMillicastPlayer, Warning, TEXT("None of the preferred video codecs can be decoded, keeping the default order"));
+		return;
+	}
+
+	// Everything else stays available as a fallback, along with rtx, red and ulpfec
+	std::copy_if(Capabilities.codecs.begin(), Capabilities.codecs.end(), std::back_inserter(Codecs), [&](const webrtc::RtpCodecCapability& Codec)
+	{
+		return !VideoCodecPreferences.ContainsByPredicate([&](const FString& Name) { return IsPreferred(Codec, Name); });
+	});
+
+	const auto Error = Transceiver->SetCodecPreferences(Codecs);
+	if (!Error.ok())
+	{
+		UE_LOG(LogMillicastPlayer, Error, TEXT("Could not set the video codec preferences : %S"), Error.message());
+	}
+}
+
+void FWebRTCPeerConnection::CreateLocalOffer(TFunction<void()> OnSuccess, TFunction<void(const std::string&)> OnFailure, TFunction<void()> OnOfferCreated)
+{
+	UE_LOG(LogMillicastPlayer, Verbose, TEXT("%S"), __FUNCTION__);
+
+	// Only ref counted WebRTC objects are captured, so a late callback never touches this wrapper once it is destroyed
+	rtc::scoped_refptr<webrtc::PeerConnectionInterface> Pc = PeerConnection;
+	rtc::scoped_refptr<FSetSessionDescriptionObserver> LocalObserver(LocalSessionDescription.Release());
+
+	LocalObserver->SetOnSuccessCallback([OnSuccess]()
+	{
+		UE_LOG(LogMillicastPlayer, Log, TEXT("pc.setLocalDescription() | sucess"));
+		OnSuccess();
+	});
+
+	LocalObserver->SetOnFailureCallback([OnFailure](const std::string& err)
+	{
+		UE_LOG(LogMillicastPlayer, Error, TEXT("Set local description failed : %s"), *FString(err.c_str()));
+		OnFailure(err);
+	});
+
+	// Copied, edits made afterwards apply to the next offer
+	FSdpEditor Editor = GetLocalDescriptionEditor();
+
+	CreateSessionDescription->SetOnSuccessCallback([Pc, LocalObserver, OnFailure, OnOfferCreated, Editor](const std::string& Type, const std::string& Sdp)
+	{
+		UE_LOG(LogMillicastPlayer, Log, TEXT("pc.createOffer() | sucess\nsdp : %s"), *FString(Sdp.c_str()));
+
+		if (OnOfferCreated)
+		{
+			OnOfferCreated();
+		}
+
+		webrtc::SdpParseError ParseError;
+		webrtc::SessionDescriptionInterface* SessionDescription = webrtc::CreateSessionDescription(Type, Sdp, &ParseError);
+		if (!SessionDescription)
+		{
+			OnFailure(ParseError.description);
+			return;
+		}
+
+		Editor.Apply(*SessionDescription->description());
+
+		Pc->SetLocalDescription(LocalObserver.get(), SessionDescription);
+	});
+
+	CreateSessionDescription->SetOnFailureCallback([OnFailure](const std::string& err)
+	{
+		UE_LOG(LogMillicastPlayer, Error, TEXT("pc.createOffer() | Error: %s"), *FString(err.c_str()));
+		OnFailure(err);
 	});
+
+	CreateOffer();
 }
 
 template<typename Callback>
@@ -361,6 +457,8 @@ void FWebRTCPeerConnection::SetLocalDescription(const std::string& Sdp, const st
 		return;
 	}
 
+	GetLocalDescriptionEditor().Apply(*SessionDescription->description());
+
 	PeerConnection->SetLocalDescription(LocalSessionDescription.Release(), SessionDescription);
 }
 
@@ -375,6 +473,11 @@ void FWebRTCPeerConnection::SetRemoteDescription(const std::string& Sdp, const s
 	PeerConnection->SetRemoteDescription(RemoteSessionDescription.Release(), SessionDescription);
 }
 
+void FWebRTCPeerConnection::SetRemoteDescription(std::unique_ptr<webrtc::SessionDescriptionInterface> SessionDescription)
+{
+	PeerConnection->SetRemoteDescription(RemoteSessionDescription.Release(), SessionDescription.release());
+}
+
 void FWebRTCPeerConnection::OnSignalingChange(webrtc::PeerConnectionInterface::SignalingState State)
 {
 	switch (State)
@@ -414,12 +517,17 @@ void FWebRTCPeerConnection::OnTrack(rtc::scoped_refptr<webrtc::RtpTransceiverInt
 {
 	UE_LOG(LogMillicastPlayer, Verbose, TEXT("%S"), __FUNCTION__);
 
+	// Called right away if the receiver already got its first packet
+	Transceiver->receiver()->SetObserver(this);
+
+	ApplyLatencySettings(Transceiver->receiver());
+
 	if (OnVideoTrack && Transceiver->media_type() == cricket::MediaType::MEDIA_TYPE_VIDEO)
 	{
 		OnVideoTrack(*Transceiver->mid(), Transceiver->receiver()->track());
 		if (bUseFrameTransformer)
 		{
-			auto Transformer = rtc::make_ref_counted<FFrameTransformer>(this);
+			auto Transformer = rtc::make_ref_counted<FFrameTransformer>(this, Lifetime);
 			Transceiver->receiver()->SetDepacketizerToDecoderFrameTransformer(Transformer);
 		}
 	}
@@ -443,50 +551,95 @@ void FWebRTCPeerConnection::OnRenegotiationNeeded()
 {
 	UE_LOG(LogMillicastPlayer, Verbose, TEXT("%S"), __FUNCTION__);
 
-	std::string sdp;
 	auto remote_sdp = PeerConnection->remote_description();
 
 	if (!remote_sdp) return;
 
-	remote_sdp->ToString(&sdp);
-	if (sdp.empty()) return;
+	// Transceivers added while a renegotiation is in flight are negotiated together once it completes
+	if (bRenegotiating)
+	{
+		bRenegotiationPending = true;
+		return;
+	}
 
-	CreateSessionDescription = MakeUnique<FCreateSessionDescriptionObserver>();
-	LocalSessionDescription = MakeUnique<FSetSessionDescriptionObserver>();
-	RemoteSessionDescription = MakeUnique<FSetSessionDescriptionObserver>();
+	// Already covered by the previous renegotiation, WebRTC queues one event per added transceiver
+	if (!HasUnnegotiatedTransceivers())
+	{
+		return;
+	}
+
+	bRenegotiating = true;
+	bRenegotiationPending = false;
 
-	CreateSessionDescription->SetOnSuccessCallback([this](const std::string& type, const std::string& sdp) {
+	ResetObservers();
+
+	// The observers are reference counted by WebRTC and may complete after this wrapper is deleted
+	CreateSessionDescription->SetOnSuccessCallback(WhileAlive([this](const std::string& type, const std::string& sdp) {
 		UE_LOG(LogMillicastPlayer, Log, TEXT("[renegociation] pc.createOffer() | Success"));
 		SetLocalDescription(sdp, type);
-	});
+	}));
 
-	CreateSessionDescription->SetOnFailureCallback([](const std::string& err) {
+	CreateSessionDescription->SetOnFailureCallback(WhileAlive([this](const std::string& err) {
 		UE_LOG(LogMillicastPlayer, Error, TEXT("[renegociation] pc.createOffer() | Error: %s"), *FString(err.c_str()));
-	});
+		FinishRenegotiation();
+	}));
 
-	LocalSessionDescription->SetOnSuccessCallback([this]() {
+	LocalSessionDescription->SetOnSuccessCallback(WhileAlive([this]() {
 		UE_LOG(LogMillicastPlayer, Log, TEXT("[renegociation] pc.setLocalDescription() | success"));
 		Renegociate(PeerConnection->local_description(), PeerConnection->remote_description());
-	});
+	}));
 
-	LocalSessionDescription->SetOnFailureCallback([](const std::string& err) {
+	LocalSessionDescription->SetOnFailureCallback(WhileAlive([this](const std::string& err) {
 		UE_LOG(LogMillicastPlayer, Error, TEXT("[renegociation]  Set local description failed | Error: %s"), *FString(err.c_str()));
-	});
+		FinishRenegotiation();
+	}));
 
-	RemoteSessionDescription->SetOnSuccessCallback([]() {
+	RemoteSessionDescription->SetOnSuccessCallback(WhileAlive([this]() {
 		UE_LOG(LogMillicastPlayer, Log, TEXT("[renegociation] Set remote description | success"));
-	});
+		FinishRenegotiation();
+	}));
 
-	RemoteSessionDescription->SetOnFailureCallback([](const std::string& err) {
+	RemoteSessionDescription->SetOnFailureCallback(WhileAlive([this](const std::string& err) {
 		UE_LOG(LogMillicastPlayer, Error, TEXT("[renegociation]  Set remote description failed | Error: %s"), *FString(err.c_str()));
-	});
+		FinishRenegotiation();
+	}));
 
 	UE_LOG(LogMillicastPlayer, Log, TEXT("Starting renegociation"));
 	CreateOffer();
 }
 
-void FWebRTCPeerConnection::OnIceConnectionChange(webrtc::PeerConnectionInterface::IceConnectionState)
-{}
+bool FWebRTCPeerConnection::HasUnnegotiatedTransceivers() const
+{
+	for (const auto& Transceiver : PeerConnection->GetTransceivers())
+	{
+		if (!Transceiver->mid() && !Transceiver->stopped())
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void FWebRTCPeerConnection::FinishRenegotiation()
+{
+	bRenegotiating = false;
+
+	if (bRenegotiationPending)
+	{
+		OnRenegotiationNeeded();
+	}
+}
+
+void FWebRTCPeerConnection::OnIceConnectionChange(webrtc::PeerConnectionInterface::IceConnectionState State)
+{
+	UE_LOG(LogMillicastPlayer, Verbose, TEXT("Ice connection state change: %S"), webrtc::PeerConnectionInterface::AsString(State).data());
+
+	if (OnIceConnectionStateChanged)
+	{
+		OnIceConnectionStateChanged(State);
+	}
+}
 
 void FWebRTCPeerConnection::OnIceGatheringChange(webrtc::PeerConnectionInterface::IceGatheringState)
 {}
@@ -497,33 +650,43 @@ void FWebRTCPeerConnection::OnIceCandidate(const webrtc::IceCandidateInterface*)
 void FWebRTCPeerConnection::OnIceConnectionReceivingChange(bool)
 {}
 
+void FWebRTCPeerConnection::OnFirstPacketReceived(cricket::MediaType MediaType)
+{
+	UE_LOG(LogMillicastPlayer, Verbose, TEXT("%S"), __FUNCTION__);
+
+	if (OnFirstRtpPacket)
+	{
+		OnFirstRtpPacket(MediaType);
+	}
+}
+
 #if ENGINE_MAJOR_VERSION >= 5 && ENGINE_MINOR_VERSION > 0
 FPlayerStatsCollector* FWebRTCPeerConnection::GetStatsCollector() const
 {
-	return RTCStatsCollector.Get();
+	return RTCStatsCollector.get();
 }
 	
 void FWebRTCPeerConnection::EnableStats(bool Enable)
 {
 	if (Enable && !RTCStatsCollector)
 	{
-		RTCStatsCollector = MakeUnique<FPlayerStatsCollector>(this);
+		// Registered once referenced, the sampler may take and drop its own reference right away
+		RTCStatsCollector = new FPlayerStatsCollector(this);
+		FPlayerStats::Get().RegisterStatsCollector(RTCStatsCollector.get());
 	}
-	else
+	else if (!Enable && RTCStatsCollector)
 	{
+		RTCStatsCollector->Detach();
 		RTCStatsCollector = nullptr;
 	}
 }
 
 void FWebRTCPeerConnection::PollStats()
 {
-	if (PeerConnection)
+	// A single report with every receiver and the candidate pairs, instead of one collection per transceiver
+	if (PeerConnection && RTCStatsCollector)
 	{
-		std::vector<rtc::scoped_refptr<webrtc::RtpTransceiverInterface>> Transceivers = PeerConnection->GetTransceivers();
-		for (rtc::scoped_refptr<webrtc::RtpTransceiverInterface> Transceiver : Transceivers)
-		{
-			PeerConnection->GetStats(Transceiver->receiver(), RTCStatsCollector.Get());
-		}
+		PeerConnection->GetStats(RTCStatsCollector.get());
 	}
 }
 
@@ -556,25 +719,40 @@ static inline webrtc::RtpTransceiverDirection reverse_direction(webrtc::RtpTrans
 void FWebRTCPeerConnection::Renegociate(const webrtc::SessionDescriptionInterface* local_sdp, const webrtc::SessionDescriptionInterface* remote_sdp)
 {
 	UE_LOG(LogMillicastPlayer, Verbose, TEXT("%S"), __FUNCTION__);
-	// Clone the remote sdp to have a setup a new one
-#if WEBRTC_VERSION < 96
-	auto NewRemote = CloneSessionDescription(remote_sdp);
-#else
-	auto NewRemote = remote_sdp->Clone();
-#endif
 
-	if (!NewRemote) {
+	if (!local_sdp || !remote_sdp) {
+		UE_LOG(LogMillicastPlayer, Error, TEXT("[renegociation] Missing local or remote description"));
+		FinishRenegotiation();
+		return;
+	}
+
+	// A single copy of the remote description, completed in place and handed over to WebRTC without going through the sdp text
+	auto remote_desc = remote_sdp->description()->Clone();
+	if (!remote_desc) {
 		UE_LOG(LogMillicastPlayer, Error, TEXT("Could not clone remote sdp"));
+		FinishRenegotiation();
 		return;
 	}
 
 	auto local_desc = local_sdp->description();
 
+	// Every added media section is bundled on the transport of the first one
+	const auto first_content = remote_desc->FirstContent();
+	const auto first_transport_info = first_content ? remote_desc->GetTransportInfoByName(first_content->name) : nullptr;
+	const auto bundle_group = remote_desc->GetGroupByName(cricket::GROUP_TYPE_BUNDLE);
+	if (!first_transport_info || !bundle_group || remote_sdp->number_of_mediasections() == 0) {
+		UE_LOG(LogMillicastPlayer, Error, TEXT("[renegociation] The remote sdp has no bundled transport to add the new media sections to"));
+		FinishRenegotiation();
+		return;
+	}
+
+	const auto first_transport = first_transport_info->description;
+	cricket::ContentGroup bundle = *bundle_group;
+
+	std::vector<std::pair<std::string, int>> added_mids; // mid, mline index
 	int mline_index = 0; // Keep track of the mline index to add ice candidates
 	for (const auto& offer_content : local_desc->contents())
 	{
-		auto remote_desc = NewRemote->description();
-
 		// Find the corresponding mid in the answer
 		auto answered_media = remote_desc->GetContentDescriptionByName(offer_content.mid());
 
@@ -594,42 +772,51 @@ void FWebRTCPeerConnection::Renegociate(const webrtc::SessionDescriptionInterfac
 				std::move(answered_media_new));
 
 			// Copy the transport info from the first mid of the remote desc
-			auto transport_info = remote_desc->GetTransportInfoByName(remote_desc->FirstContent()->name);
-			cricket::TransportInfo new_transport_info{ offer_content.mid(), transport_info->description };
-
-			remote_desc->AddTransportInfo(new_transport_info);
+			remote_desc->AddTransportInfo(cricket::TransportInfo{ offer_content.mid(), first_transport });
 
-			// Add mid to the BUNDLE group
-			cricket::ContentGroup bundle = remote_desc->groups().front();
 			bundle.AddContentName(offer_content.mid());
-			remote_desc->RemoveGroupByName(bundle.semantics());
-			remote_desc->AddGroup(bundle);
-
-			// reinit to update the number of mediasections
-			auto new_remote_jsep = static_cast<webrtc::JsepSessionDescription*>(NewRemote.get());
-			new_remote_jsep->Initialize(remote_desc->Clone(),
-				NewRemote->session_id(),
-				NewRemote->session_version());
-
-			// Copy ice candidates for the new mline_index
-			auto candidates = NewRemote->candidates(0);
-			for (size_t i = 0; i < candidates->count(); ++i) {
-				auto c = candidates->at(i);
-				auto new_candidate = webrtc::CreateIceCandidate(offer_content.mid(),
-					mline_index,
-					c->candidate());
-				NewRemote->AddCandidate(new_candidate.release());
-			}
+
+			added_mids.emplace_back(offer_content.mid(), mline_index);
 		}
 
 		++mline_index;
 	}
 
-	std::string sdp;
-	NewRemote->ToString(&sdp);
+	// Replace the BUNDLE group once, with all the added mids
+	remote_desc->RemoveGroupByName(bundle.semantics());
+	remote_desc->AddGroup(bundle);
 
-	UE_LOG(LogMillicastPlayer, Log, TEXT("[renegociation] remote sdp : %s"), *FString(sdp.c_str()));
-	SetRemoteDescription(sdp);
+	// Initialized once all the media sections are there, so the candidates collections have the right size
+	auto NewRemote = std::make_unique<webrtc::JsepSessionDescription>(remote_sdp->GetType());
+	NewRemote->Initialize(std::move(remote_desc), remote_sdp->session_id(), remote_sdp->session_version());
+
+	// AddCandidate copies the candidate
+	for (size_t i = 0; i < remote_sdp->number_of_mediasections(); ++i)
+	{
+		auto candidates = remote_sdp->candidates(i);
+		for (size_t j = 0; j < candidates->count(); ++j) {
+			NewRemote->AddCandidate(candidates->at(j));
+		}
+	}
+
+	// The added media sections are bundled on the transport of the first one
+	auto first_candidates = remote_sdp->candidates(0);
+	for (const auto& [mid, index] : added_mids)
+	{
+		for (size_t i = 0; i < first_candidates->count(); ++i) {
+			auto new_candidate = webrtc::CreateIceCandidate(mid, index, first_candidates->at(i)->candidate());
+			NewRemote->AddCandidate(new_candidate.get());
+		}
+	}
+
+	if (UE_LOG_ACTIVE(LogMillicastPlayer, Log))
+	{
+		std::string sdp;
+		NewRemote->ToString(&sdp);
+		UE_LOG(LogMillicastPlayer, Log, TEXT("[renegociation] remote sdp : %s"), *FString(sdp.c_str()));
+	}
+
+	SetRemoteDescription(std::move(NewRemote));
 }
 
 void FWebRTCPeerConnection::EnableFrameTransformer(bool Enable)
@@ -637,4 +824,64 @@ void FWebRTCPeerConnection::EnableFrameTransformer(bool Enable)
 	bUseFrameTransformer = Enable;
 }
 
+void FWebRTCPeerConnection::SetLatencySettings(const FLatencySettings& Settings)
+{
+	{
+		FScopeLock Lock(&LatencySettingsSection);
+		LatencySettings = Settings;
+	}
+
+	EditLocalDescription([&Settings](FSdpEditor& Editor)
+	{
+		if (Settings.bPlayoutDelayExtension)
+		{
+			Editor.AddHeaderExtension(cricket::MediaType::MEDIA_TYPE_VIDEO, webrtc::RtpExtension::kPlayoutDelayUri);
+		}
+		else
+		{
+			// Back to what WebRTC offers by default, which may include the extension
+			Editor.ResetHeaderExtension(cricket::MediaType::MEDIA_TYPE_VIDEO, webrtc::RtpExtension::kPlayoutDelayUri);
+		}
+	});
+
+	if (PeerConnection)
+	{
+		for (const auto& Receiver : PeerConnection->GetReceivers())
+		{
+			ApplyLatencySettings(Receiver);
+		}
+	}
+}
+
+void FWebRTCPeerConnection::EditLocalDescription(TFunctionRef<void(FSdpEditor&)> Edit)
+{
+	FScopeLock Lock(&LocalDescriptionEditorSection);
+	Edit(LocalDescriptionEditor);
+}
+
+FSdpEditor FWebRTCPeerConnection::GetLocalDescriptionEditor() const
+{
+	FScopeLock Lock(&LocalDescriptionEditorSection);
+	return LocalDescriptionEditor;
+}
+
+FLatencySettings FWebRTCPeerConnection::GetLatencySettings() const
+{
+	FScopeLock Lock(&LatencySettingsSection);
+	return LatencySettings;
+}
+
+void FWebRTCPeerConnection::ApplyLatencySettings(const rtc::scoped_refptr<webrtc::RtpReceiverInterface>& Receiver) const
+{
+	const FLatencySettings Settings = GetLatencySettings();
+
+	absl::optional<double> DelaySeconds;
+	if (Settings.MinimumJitterBufferDelayMs.IsSet())
+	{
+		DelaySeconds = Settings.MinimumJitterBufferDelayMs.GetValue() / 1000.0;
+	}
+
+	Receiver->SetJitterBufferMinimumDelay(DelaySeconds);
+}
+
 }
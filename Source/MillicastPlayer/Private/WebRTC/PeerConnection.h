@@ -3,6 +3,7 @@
 #pragma once
 
 #include "Runtime/Launch/Resources/Version.h"
+#include "SdpEditor.h"
 #include "SessionDescriptionObserver.h"
 #include "WebRTC/WebRTCInc.h"
 
@@ -17,22 +18,63 @@ namespace Millicast::Player
 {
 	class FAudioDeviceModule;
 	class FPlayerStatsCollector;
+	struct FWebRTCFactoryContext;
+
+	/**
+	 * Shared with the callbacks WebRTC may still run on the signaling and decoding threads once the wrapper is deleted.
+	 * The destructor clears bAlive under the lock, so a callback holding the lock finishes first and later ones do nothing.
+	 */
+	struct FPeerConnectionLifetime
+	{
+		FCriticalSection Section;
+		bool bAlive = true;
+	};
+
+	/** Receive side buffering of a connection */
+	struct FLatencySettings
+	{
+		/** Minimum delay of the audio and video jitter buffers, unset to let WebRTC adapt it */
+		TOptional<double> MinimumJitterBufferDelayMs;
+
+		/** Upper bound of the expected delay, only used to check it is met. Negative when there is none */
+		double MaximumDelayMs = -1.0;
+
+		/** Offer the playout-delay header extension so the delay range requested by the publisher is honored */
+		bool bPlayoutDelayExtension = false;
+	};
 	
 /*
  * Small wrapper for the WebRTC peerconnection
  */
-	class FWebRTCPeerConnection : public webrtc::PeerConnectionObserver
+	class FWebRTCPeerConnection : public webrtc::PeerConnectionObserver, public webrtc::RtpReceiverObserverInterface
 	{
 		using FMediaStreamVector = std::vector<rtc::scoped_refptr<webrtc::MediaStreamInterface>>;
 		using FRTCConfig = webrtc::PeerConnectionInterface::RTCConfiguration;
 
 		rtc::scoped_refptr<webrtc::PeerConnectionInterface> PeerConnection;
 
-		TUniquePtr<rtc::Thread>                SignalingThread;
-		TUniquePtr<rtc::Thread>                WorkingThread;
-		TUniquePtr<rtc::Thread>                NetworkingThread;
-		rtc::scoped_refptr<FAudioDeviceModule> AudioDeviceModule;
-		std::unique_ptr<webrtc::TaskQueueFactory> TaskQueueFactory;
+		// Unique for the lifetime of the process, unlike the address of a deleted connection
+		uint64 Id = 0;
+
+		TSharedRef<FPeerConnectionLifetime, ESPMode::ThreadSafe> Lifetime = MakeShared<FPeerConnectionLifetime, ESPMode::ThreadSafe>();
+
+		/** Wraps a callback capturing this so that it does nothing once the wrapper is deleted */
+		template<typename Callback>
+		auto WhileAlive(Callback&& Fn)
+		{
+			return [Lifetime = Lifetime, Fn = Forward<Callback>(Fn)](auto&&... Args)
+			{
+				FScopeLock Lock(&Lifetime->Section);
+				if (Lifetime->bAlive)
+				{
+					Fn(Forward<decltype(Args)>(Args)...);
+				}
+			};
+		}
+
+		// Factory and audio device module of this connection, on a worker thread possibly shared with other connections
+		TSharedPtr<FWebRTCFactoryContext>      FactoryContext;
+		rtc::Thread*                           SignalingThread = nullptr;
 
 		using FCreateSessionDescriptionObserver = TSessionDescriptionObserver<webrtc::CreateSessionDescriptionObserver>;
 		using FSetSessionDescriptionObserver = TSessionDescriptionObserver<webrtc::SetSessionDescriptionObserver>;
@@ -43,8 +85,18 @@ namespace Millicast::Player
 
 		bool bUseFrameTransformer{ false };
 
+		// Set from the game thread, read when receivers are created on the signaling thread
+		FLatencySettings LatencySettings;
+		mutable FCriticalSection LatencySettingsSection;
+		void ApplyLatencySettings(const rtc::scoped_refptr<webrtc::RtpReceiverInterface>& Receiver) const;
+
+		// Applied to every local description before it is set, enables opus stereo by default.
+		// Edited from the game thread, applied on the signaling thread from a copy taken under the lock
+		FSdpEditor LocalDescriptionEditor;
+		mutable FCriticalSection LocalDescriptionEditorSection;
+
 #if ENGINE_MAJOR_VERSION >= 5 && ENGINE_MINOR_VERSION > 0
-		TUniquePtr<FPlayerStatsCollector>             RTCStatsCollector;
+		rtc::scoped_refptr<FPlayerStatsCollector>     RTCStatsCollector;
 #endif
 
 		template<typename Callback>
@@ -52,13 +104,16 @@ namespace Millicast::Player
 			const std::string&,
 			Callback&&);
 
-		rtc::scoped_refptr<webrtc::PeerConnectionFactoryInterface> PeerConnectionFactory;
-		void CreatePeerConnectionFactory();
 
 		void Renegociate(const webrtc::SessionDescriptionInterface* local_sdp,
 			const webrtc::SessionDescriptionInterface* remote_sdp);
 
-		static TAtomic<int> RefCounter; // Number of Peerconnection factory created
+		// Signaling thread only. One renegotiation at a time, the events received meanwhile are merged into a single next one
+		bool bRenegotiating = false;
+		bool bRenegotiationPending = false;
+
+		bool HasUnnegotiatedTransceivers() const;
+		void FinishRenegotiation();
 
 	public:
 		FString ClusterId;
@@ -67,18 +122,36 @@ namespace Millicast::Player
 		std::function<void(const std::string& mid, rtc::scoped_refptr<webrtc::MediaStreamTrackInterface>)> OnVideoTrack = nullptr;
 		std::function<void(const std::string& mid, rtc::scoped_refptr<webrtc::MediaStreamTrackInterface>)> OnAudioTrack = nullptr;
 		std::function<void(uint32 Ssrc, uint32 Timestamp, const TArray<uint8>& Data)> OnFrameMetadata = nullptr;
+		std::function<void(webrtc::PeerConnectionInterface::IceConnectionState)> OnIceConnectionStateChanged = nullptr;
+		std::function<void(cricket::MediaType)> OnFirstRtpPacket = nullptr;
 
 		webrtc::PeerConnectionInterface::RTCOfferAnswerOptions OaOptions;
+
+		/** Edit the local description editor under its lock. The edits apply from the next local description */
+		void EditLocalDescription(TFunctionRef<void(FSdpEditor&)> Edit);
+
+		/** Copy of the local description editor, taken under its lock */
+		FSdpEditor GetLocalDescriptionEditor() const;
+
+		/** Names of the video codecs to receive, such as H264 or VP8, most preferred first. The other codecs are offered after them */
+		TArray<FString> VideoCodecPreferences;
 		
 		~FWebRTCPeerConnection() noexcept;
-		void Init(const FRTCConfig& Config);
+		void Init(const FRTCConfig& Config, int32 AudioPullPeriodMs);
 
 #if ENGINE_MAJOR_VERSION >= 5 && ENGINE_MINOR_VERSION > 0
 		FPlayerStatsCollector* GetStatsCollector() const;
 #endif
 		
 		static FRTCConfig GetDefaultConfig();
-		static FWebRTCPeerConnection* Create(const FRTCConfig& Config);
+		/** nullptr if the factory or the peerconnection could not be created */
+		static FWebRTCPeerConnection* Create(const FRTCConfig& Config, int32 AudioPullPeriodMs = 10);
+
+		/** Identifies this connection in asynchronous callbacks that may outlive it */
+		uint64 GetId() const { return Id; }
+
+		/** The audio device module driving the audio pulls of this connection */
+		rtc::scoped_refptr<FAudioDeviceModule> GetAudioDeviceModule() const;
 
 		FSetSessionDescriptionObserver* GetLocalDescriptionObserver();
 		FSetSessionDescriptionObserver* GetRemoteDescriptionObserver();
@@ -89,8 +162,31 @@ namespace Millicast::Player
 		const FCreateSessionDescriptionObserver* GetCreateDescriptionObserver() const;
 
 		void CreateOffer();
+
+		/** Add a recv only audio and video transceiver, with the codec preferences, as offer_to_receive would do during the offer */
+		void AddRecvOnlyTransceivers();
+
+		/**
+		 * Add recv only transceivers for remote tracks, all at once so that they are negotiated with a single offer.
+		 * Returns the number of transceivers added.
+		 */
+		int32 AddRemoteTransceivers(const TArray<cricket::MediaType>& MediaTypes);
+
+		/** Order the codecs of a video transceiver according to VideoCodecPreferences. Must be called before the offer */
+		void ApplyCodecPreferences(const rtc::scoped_refptr<webrtc::RtpTransceiverInterface>& Transceiver) const;
+
+		/**
+		 * Creates an offer, applies LocalDescriptionEditor to it and sets it as the local description.
+		 * Callbacks are called from a WebRTC thread. Consumes the create and local description observers.
+		 */
+		void CreateLocalOffer(TFunction<void()> OnSuccess, TFunction<void(const std::string&)> OnFailure, TFunction<void()> OnOfferCreated = nullptr);
+
+		/** Creates fresh session description observers, the previous ones having been handed over to WebRTC */
+		void ResetObservers();
+
 		void SetLocalDescription(const std::string& Sdp, const std::string& Type);
 		void SetRemoteDescription(const std::string& Sdp, const std::string& Type = std::string("answer"));
+		void SetRemoteDescription(std::unique_ptr<webrtc::SessionDescriptionInterface> SessionDescription);
 
 		// PeerConnection Observer interface
 		void OnSignalingChange(webrtc::PeerConnectionInterface::SignalingState new_state) override;
@@ -107,8 +203,18 @@ namespace Millicast::Player
 		void OnIceCandidate(const webrtc::IceCandidateInterface* candidate) override;
 		void OnIceConnectionReceivingChange(bool receiving) override;
 
+		// RtpReceiverObserver interface
+		void OnFirstPacketReceived(cricket::MediaType MediaType) override;
+
 		void EnableFrameTransformer(bool Enable);
 
+		/**
+		 * Applies right away to the existing receivers and to the ones created afterwards.
+		 * The playout-delay extension is only offered from the next local offer.
+		 */
+		void SetLatencySettings(const FLatencySettings& Settings);
+		FLatencySettings GetLatencySettings() const;
+
 #if ENGINE_MAJOR_VERSION >= 5 && ENGINE_MINOR_VERSION > 0
 		void EnableStats(bool Enable);
 		void PollStats();
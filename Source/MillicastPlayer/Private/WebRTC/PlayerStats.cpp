@@ -52,8 +52,7 @@ namespace Millicast::Player
 		
 		for (FPlayerStatsCollector* Collector : StatsCollectors)
 		{
-			Collector->Poll();
-			const auto& Data = Collector->GetData();
+			const auto Data = Collector->GetData();
 
 			GEngine->AddOnScreenDebugMessage(MessageKey++, 0.0f, FColor::Green, FString::Printf(TEXT("RTT = %.2f ms"), Data.Rtt), true);
 			GEngine->AddOnScreenDebugMessage(MessageKey++, 0.0f, FColor::Green, FString::Printf(TEXT("Video resolution = %dx%d"), Data.Width, Data.Height), true);
@@ -67,6 +66,11 @@ namespace Millicast::Player
 
 			GEngine->AddOnScreenDebugMessage(MessageKey++, 0.0f, FColor::Green, FString::Printf(TEXT("Video Bitrate = %.2f %s"), VideoBitrate, *VideoBitrateUnit), true);
 			GEngine->AddOnScreenDebugMessage(MessageKey++, 0.0f, FColor::Green, FString::Printf(TEXT("Audio Bitrate = %.2f %s"), AudioBitrate, *AudioBitrateUnit), true);
+			if (Data.AvailableIncomingBitrate > 0.0f)
+			{
+				auto [IncomingBitrate, IncomingBitrateUnit] = GetInUnit(Data.AvailableIncomingBitrate, TEXT("bps"));
+				GEngine->AddOnScreenDebugMessage(MessageKey++, 0.0f, FColor::Green, FString::Printf(TEXT("Available Incoming Bitrate = %.2f %s"), IncomingBitrate, *IncomingBitrateUnit), true);
+			}
 			GEngine->AddOnScreenDebugMessage(MessageKey++, 0.0f, FColor::Green, FString::Printf(TEXT("Video Total Received = %lld %s"), VideoBytes, *VideoBytesUnit), true);
 			GEngine->AddOnScreenDebugMessage(MessageKey++, 0.0f, FColor::Green, FString::Printf(TEXT("Audio Total Received = %lld %s"), AudioBytes, *AudioBytesUnit), true);
 			GEngine->AddOnScreenDebugMessage(MessageKey++, 0.0f, FColor::Green, FString::Printf(TEXT("Average Video decode time = %.2f ms"), Data.VideoDecodeTimeAverage), true);
@@ -76,6 +80,12 @@ namespace Millicast::Player
 			GEngine->AddOnScreenDebugMessage(MessageKey++, 0.0f, FColor::Green, FString::Printf(TEXT("Audio Jitter Delay = %.2f ms"), Data.AudioJitterAverageDelay), true);
 			GEngine->AddOnScreenDebugMessage(MessageKey++, 0.0f, FColor::Green, FString::Printf(TEXT("Video Jitter = %.2f ms"), Data.VideoJitter), true);
 			GEngine->AddOnScreenDebugMessage(MessageKey++, 0.0f, FColor::Green, FString::Printf(TEXT("Audio Jitter = %.2f ms"), Data.AudioJitter), true);
+			GEngine->AddOnScreenDebugMessage(MessageKey++, 0.0f, FColor::Green, FString::Printf(TEXT("Video Jitter Buffer Delay = %.2f ms"), Data.VideoJitterBufferCurrentDelay), true);
+			GEngine->AddOnScreenDebugMessage(MessageKey++, 0.0f, FColor::Green, FString::Printf(TEXT("Audio Jitter Buffer Delay = %.2f ms"), Data.AudioJitterBufferCurrentDelay), true);
+			if (Data.MaximumDelay >= 0.0f)
+			{
+				GEngine->AddOnScreenDebugMessage(MessageKey++, 0.0f, Data.bLatencyTargetMet ? FColor::Green : FColor::Red, FString::Printf(TEXT("Latency Target = %.0f ms"), Data.MaximumDelay), true);
+			}
 			GEngine->AddOnScreenDebugMessage(MessageKey++, 0.0f, FColor::Green, FString::Printf(TEXT("Codecs = %s,%s"), *Data.VideoCodec, *Data.AudioCodec), true);
 			GEngine->AddOnScreenDebugMessage(MessageKey++, 0.0f, FColor::Green, FString::Printf(TEXT("Cluster = %s"), *Collector->GetClusterId()), true);
 			GEngine->AddOnScreenDebugMessage(MessageKey++, 0.0f, FColor::Green, FString::Printf(TEXT("Server = %s"), *Collector->GetServerId()), true);
@@ -88,6 +98,7 @@ namespace Millicast::Player
 			CSV_CUSTOM_STAT(Millicast_Player, FramesPerSecond, (int)Data.FramesPerSecond, ECsvCustomStatOp::Set);
 			CSV_CUSTOM_STAT(Millicast_Player, VideoBitrate, Data.VideoBitrate, ECsvCustomStatOp::Set);
 			CSV_CUSTOM_STAT(Millicast_Player, AudioBitrate, Data.AudioBitrate, ECsvCustomStatOp::Set);
+			CSV_CUSTOM_STAT(Millicast_Player, AvailableIncomingBitrate, Data.AvailableIncomingBitrate, ECsvCustomStatOp::Set);
 			CSV_CUSTOM_STAT(Millicast_Player, VideoTotalReceived, (int)Data.VideoTotalReceived, ECsvCustomStatOp::Set);
 			CSV_CUSTOM_STAT(Millicast_Player, AudioTotalReceived, (int)Data.AudioTotalReceived, ECsvCustomStatOp::Set);
 			CSV_CUSTOM_STAT(Millicast_Player, VideoPacketLoss, Data.VideoPacketLoss, ECsvCustomStatOp::Set);
@@ -96,6 +107,10 @@ namespace Millicast::Player
 			CSV_CUSTOM_STAT(Millicast_Player, AudioJitter, Data.AudioJitter, ECsvCustomStatOp::Set);
 			CSV_CUSTOM_STAT(Millicast_Player, VideoJitterAverageDelay, Data.VideoJitterAverageDelay, ECsvCustomStatOp::Set);
 			CSV_CUSTOM_STAT(Millicast_Player, AudioJitterAverageDelay, Data.AudioJitterAverageDelay, ECsvCustomStatOp::Set);
+			CSV_CUSTOM_STAT(Millicast_Player, VideoJitterBufferCurrentDelay, Data.VideoJitterBufferCurrentDelay, ECsvCustomStatOp::Set);
+			CSV_CUSTOM_STAT(Millicast_Player, AudioJitterBufferCurrentDelay, Data.AudioJitterBufferCurrentDelay, ECsvCustomStatOp::Set);
+			CSV_CUSTOM_STAT(Millicast_Player, JitterBufferMinimumDelay, Data.JitterBufferMinimumDelay, ECsvCustomStatOp::Set);
+			CSV_CUSTOM_STAT(Millicast_Player, LatencyTargetMet, Data.bLatencyTargetMet ? 1 : 0, ECsvCustomStatOp::Set);
 			// CSV_CUSTOM_STAT(Millicast_Player, VideoCodec, *Data.VideoCodec, ECsvCustomStatOp::Set);
 			// CSV_CUSTOM_STAT(Millicast_Player, AudioCodec, *Data.AudioCodec, ECsvCustomStatOp::Set);
 			CSV_CUSTOM_STAT(Millicast_Player, LastVideoReceivedTimestamp, Data.LastVideoReceivedTimestamp, ECsvCustomStatOp::Set);
@@ -152,14 +167,46 @@ namespace Millicast::Player
 
 		UE_LOG(LogMillicastPlayer, Verbose, TEXT("%S"), __FUNCTION__);
 		StatsCollectors.Add(Collector);
+
+		if (!Sampler)
+		{
+			Sampler = MakeUnique<FPlayerStatsSampler>([this]() { PollCollectors(); });
+		}
 	}
 
 	void FPlayerStats::UnregisterStatsCollector(FPlayerStatsCollector* Collector)
 	{
-		FScopeLock Lock(&CollectorsCriticalSection);
-		
-		UE_LOG(LogMillicastPlayer, Verbose, TEXT("%S"), __FUNCTION__);
-		StatsCollectors.Remove(Collector);
+		TUniquePtr<FPlayerStatsSampler> StoppedSampler;
+
+		{
+			FScopeLock Lock(&CollectorsCriticalSection);
+
+			UE_LOG(LogMillicastPlayer, Verbose, TEXT("%S"), __FUNCTION__);
+			// Also called from the destructor of a detached collector, possibly on the sampler thread which must not join itself
+			if (StatsCollectors.Remove(Collector) > 0 && StatsCollectors.Num() == 0)
+			{
+				StoppedSampler = MoveTemp(Sampler);
+			}
+		}
+
+		// Joined without the lock, which the sampler thread may be waiting for
+		StoppedSampler.Reset();
+	}
+
+	void FPlayerStats::PollCollectors()
+	{
+		// Polling blocks on the signaling thread of each connection, the overlay must not wait for it behind the lock.
+		// The references keep the collectors alive, a collector detached meanwhile skips the poll
+		TArray<rtc::scoped_refptr<FPlayerStatsCollector>> Collectors;
+		{
+			FScopeLock Lock(&CollectorsCriticalSection);
+			Collectors.Append(StatsCollectors);
+		}
+
+		for (const auto& Collector : Collectors)
+		{
+			Collector->Poll();
+		}
 	}
 }
 
@@ -6,6 +6,7 @@
 
 #if ENGINE_MAJOR_VERSION >= 5 && ENGINE_MINOR_VERSION > 0
 
+#include "PlayerStatsSampler.h"
 #include "Tickable.h"
 #include "WebRTC/WebRTCInc.h"
 
@@ -53,6 +54,7 @@ namespace Millicast::Player
 			return { Value, Unit };
 		}
 
+		/** The sampler runs while at least one collector is registered */
 		void RegisterStatsCollector(FPlayerStatsCollector* Collector);
 		void UnregisterStatsCollector(FPlayerStatsCollector* Collector);
 
@@ -62,7 +64,11 @@ namespace Millicast::Player
 		void RegisterEngineHooks();
 
 	private:
+		/** Called by the sampler thread */
+		void PollCollectors();
+
 		FCriticalSection CollectorsCriticalSection;
+		TUniquePtr<FPlayerStatsSampler> Sampler;
 		
 		bool bRendering = false;
 		bool bHasRegisteredEngineStats = false;
@@ -3,17 +3,23 @@
 #if ENGINE_MAJOR_VERSION >= 5 && ENGINE_MINOR_VERSION > 0
 
 #include "Engine/Engine.h"
+#include "HAL/IConsoleManager.h"
+#include "MillicastPlayerPrivate.h"
 #include "PeerConnection.h"
 #include "ProfilingDebugging/CsvProfiler.h"
 #include "Util.h"
 #include "WebRTC/PlayerStats.h"
 
+static TAutoConsoleVariable<int32> CVarMillicastStatsHistorySize(
+	TEXT("Millicast.Player.StatsHistorySize"),
+	60,
+	TEXT("Number of stats reports kept per connection, oldest first in GetStatsHistory. 0 keeps none."),
+	ECVF_Default);
+
 namespace Millicast::Player
 {
 	FPlayerStatsCollector::FPlayerStatsCollector(FWebRTCPeerConnection* InPeerConnection)
 	{
-		FPlayerStats::Get().RegisterStatsCollector(this);
-
 		PeerConnection = InPeerConnection;
 
 		Data = {};
@@ -26,7 +32,79 @@ namespace Millicast::Player
 
 	void FPlayerStatsCollector::Poll()
 	{
-		PeerConnection->PollStats();
+		FScopeLock Lock(&PollSection);
+		if (!IsDetached())
+		{
+			PeerConnection->PollStats();
+		}
+	}
+
+	void FPlayerStatsCollector::Detach()
+	{
+		FPlayerStats::Get().UnregisterStatsCollector(this);
+
+		{
+			FScopeLock Lock(&DetachSection);
+			bDetached = true;
+		}
+
+		// Wait for a poll in progress
+		FScopeLock Lock(&PollSection);
+	}
+
+	bool FPlayerStatsCollector::IsDetached() const
+	{
+		FScopeLock Lock(&DetachSection);
+		return bDetached;
+	}
+
+	FPlayerStatsData FPlayerStatsCollector::GetData() const
+	{
+		FScopeLock Lock(&DataSection);
+		return Data;
+	}
+
+	TArray<FPlayerStatsData> FPlayerStatsCollector::GetHistory() const
+	{
+		FScopeLock Lock(&DataSection);
+
+		if (History.Num() < HistoryCapacity)
+		{
+			return History;
+		}
+
+		TArray<FPlayerStatsData> Result;
+		Result.Reserve(History.Num());
+		Result.Append(History.GetData() + HistoryNext, History.Num() - HistoryNext);
+		Result.Append(History.GetData(), HistoryNext);
+		return Result;
+	}
+
+	void FPlayerStatsCollector::PushHistory(const FPlayerStatsData& Sample)
+	{
+		const int32 Capacity = FMath::Max(CVarMillicastStatsHistorySize.GetValueOnAnyThread(), 0);
+		if (Capacity != HistoryCapacity)
+		{
+			History.Empty(Capacity);
+			HistoryCapacity = Capacity;
+			HistoryNext = 0;
+		}
+
+		if (HistoryCapacity == 0)
+		{
+			return;
+		}
+
+		if (History.Num() < HistoryCapacity)
+		{
+			History.Add(Sample);
+		}
+		else
+		{
+			History[HistoryNext] = Sample;
+		}
+
+		HistoryNext = (HistoryNext + 1) % HistoryCapacity;
 	}
 
 	void FPlayerStatsCollector::AddRef() const
@@ -38,6 +116,7 @@ namespace Millicast::Player
 	{
 		if (FPlatformAtomics::InterlockedDecrement(&RefCount) == 0)
 		{
+			delete this;
 			return rtc::RefCountReleaseStatus::kDroppedLastRef;
 		}
 
@@ -48,6 +127,16 @@ namespace Millicast::Player
 	{
 		constexpr uint32_t NUM_US = 1'000'000; // number of microseconds in 1 second
 
+		// A report requested before Detach can still arrive, the peerconnection may be gone by then
+		FScopeLock DetachLock(&DetachSection);
+		if (bDetached)
+		{
+			return;
+		}
+
+		// Built from the previous report for the counters, then published at once
+		FPlayerStatsData Sample = Data;
+
 		for (const webrtc::RTCStats& Stats : *Report)
 		{
 			const FString StatsType = FString(Stats.type());
@@ -61,40 +150,43 @@ namespace Millicast::Player
 
 				if (*InboundStat.kind == webrtc::RTCMediaStreamTrackKind::kVideo)
 				{
-					auto lastByteCount = Data.VideoTotalReceived;
+					auto lastByteCount = Sample.VideoTotalReceived;
 					auto timestamp = Stats.timestamp_us();
 
-					Data.Width = InboundStat.frame_width.ValueOrDefault(0);
-					Data.Height = InboundStat.frame_height.ValueOrDefault(0);
-					Data.FramesPerSecond = InboundStat.frames_per_second.ValueOrDefault(0);
-					Data.VideoTotalReceived = InboundStat.bytes_received.ValueOrDefault(0);
-					Data.VideoPacketLoss = InboundStat.packets_lost.ValueOrDefault(-1);
-					Data.VideoJitter = InboundStat.jitter.ValueOrDefault(0) * 1000.;
-					Data.VideoDecodeTime = InboundStat.total_decode_time.ValueOrDefault(0);
-					Data.VideoDecodeTimeAverage = 1000. * Data.VideoDecodeTime / (double)*InboundStat.frames_decoded;
-					Data.FramesDropped = InboundStat.frames_dropped.ValueOrDefault(0);
-					Data.VideoPacketDiscarded = InboundStat.packets_discarded.ValueOrDefault(0);
-					Data.VideoNackCount = InboundStat.nack_count.ValueOrDefault(0);
+					Sample.Width = InboundStat.frame_width.ValueOrDefault(0);
+					Sample.Height = InboundStat.frame_height.ValueOrDefault(0);
+					Sample.FramesPerSecond = InboundStat.frames_per_second.ValueOrDefault(0);
+					Sample.VideoTotalReceived = InboundStat.bytes_received.ValueOrDefault(0);
+					Sample.VideoPacketLoss = InboundStat.packets_lost.ValueOrDefault(-1);
+					Sample.VideoJitter = InboundStat.jitter.ValueOrDefault(0) * 1000.;
+					Sample.VideoDecodeTime = InboundStat.total_decode_time.ValueOrDefault(0);
+					Sample.VideoDecodeTimeAverage = 1000. * Sample.VideoDecodeTime / (double)*InboundStat.frames_decoded;
+					Sample.FramesDropped = InboundStat.frames_dropped.ValueOrDefault(0);
+					Sample.VideoPacketDiscarded = InboundStat.packets_discarded.ValueOrDefault(0);
+					Sample.VideoNackCount = InboundStat.nack_count.ValueOrDefault(0);
 
 					auto videoJitterDelay = InboundStat.jitter_buffer_delay.ValueOrDefault(-1);
 					auto videoJitterEmitted = InboundStat.jitter_buffer_emitted_count.ValueOrDefault(0);
 
-					if (videoJitterDelay != 0)
+					if (videoJitterDelay > 0 && videoJitterEmitted != 0)
 					{
-						Data.VideoJitterAverageDelay = 1000. * videoJitterDelay / videoJitterEmitted;
+						Sample.VideoJitterAverageDelay = 1000. * videoJitterDelay / videoJitterEmitted;
 					}
 					else
 					{
-						Data.VideoJitterAverageDelay = 0;
+						Sample.VideoJitterAverageDelay = 0;
 					}
 
-					if (Data.LastVideoStatTimestamp != 0 && Data.VideoTotalReceived != lastByteCount)
+					Sample.VideoJitterBufferCurrentDelay = GetIntervalDelayMs(videoJitterDelay, videoJitterEmitted,
+						Sample.LastVideoJitterBufferDelay, Sample.LastVideoJitterBufferEmittedCount, Sample.VideoJitterBufferCurrentDelay);
+
+					if (Sample.LastVideoStatTimestamp != 0 && Sample.VideoTotalReceived != lastByteCount)
 					{
-						Data.VideoBitrate = (Data.VideoTotalReceived - lastByteCount) * NUM_US * 8. / (timestamp - Data.LastVideoStatTimestamp);
+						Sample.VideoBitrate = (Sample.VideoTotalReceived - lastByteCount) * NUM_US * 8. / (timestamp - Sample.LastVideoStatTimestamp);
 					}
 
-					Data.LastVideoStatTimestamp = timestamp;
-					Data.LastVideoReceivedTimestamp = InboundStat.last_packet_received_timestamp.ValueOrDefault(-1);
+					Sample.LastVideoStatTimestamp = timestamp;
+					Sample.LastVideoReceivedTimestamp = InboundStat.last_packet_received_timestamp.ValueOrDefault(-1);
 
 					auto CodecStats = Report->GetStatsOfType<webrtc::RTCCodecStats>();
 
@@ -103,42 +195,50 @@ namespace Millicast::Player
 
 					if (it != CodecStats.end())
 					{
-						Data.VideoCodec = ToString(*(*it)->mime_type);
+						const FString VideoCodec = ToString(*(*it)->mime_type);
+						if (VideoCodec != Sample.VideoCodec)
+						{
+							LogNegotiatedVideoCodec(VideoCodec);
+						}
+						Sample.VideoCodec = VideoCodec;
 					}
 				}
 				else
 				{
-					auto lastByteCount = Data.AudioTotalReceived;
+					auto lastByteCount = Sample.AudioTotalReceived;
 					auto timestamp = Stats.timestamp_us();
 
-					Data.AudioTotalReceived = InboundStat.bytes_received.ValueOrDefault(0);
-					Data.AudioPacketLoss = InboundStat.packets_lost.ValueOrDefault(-1);
-					Data.AudioJitter = InboundStat.jitter.ValueOrDefault(0) * 1000.;
-					Data.AudioPacketDiscarded = InboundStat.packets_discarded.ValueOrDefault(0);
-					Data.AudioNackCount = InboundStat.nack_count.ValueOrDefault(0);
-					Data.ConcealedSamples = InboundStat.concealed_samples.ValueOrDefault(0);
-					Data.SilentConcealedSamples = InboundStat.silent_concealed_samples.ValueOrDefault(0);
-					Data.AudioLevel = InboundStat.audio_level.ValueOrDefault(0);
+					Sample.AudioTotalReceived = InboundStat.bytes_received.ValueOrDefault(0);
+					Sample.AudioPacketLoss = InboundStat.packets_lost.ValueOrDefault(-1);
+					Sample.AudioJitter = InboundStat.jitter.ValueOrDefault(0) * 1000.;
+					Sample.AudioPacketDiscarded = InboundStat.packets_discarded.ValueOrDefault(0);
+					Sample.AudioNackCount = InboundStat.nack_count.ValueOrDefault(0);
+					Sample.ConcealedSamples = InboundStat.concealed_samples.ValueOrDefault(0);
+					Sample.SilentConcealedSamples = InboundStat.silent_concealed_samples.ValueOrDefault(0);
+					Sample.AudioLevel = InboundStat.audio_level.ValueOrDefault(0);
 
 					auto audioJitterDelay = InboundStat.jitter_buffer_delay.ValueOrDefault(-1);
 					auto audioJitterEmitted = InboundStat.jitter_buffer_emitted_count.ValueOrDefault(0);
 
-					if (audioJitterDelay != 0)
+					if (audioJitterDelay > 0 && audioJitterEmitted != 0)
 					{
-						Data.AudioJitterAverageDelay = 1000. * audioJitterDelay / audioJitterEmitted;
+						Sample.AudioJitterAverageDelay = 1000. * audioJitterDelay / audioJitterEmitted;
 					}
 					else
 					{
-						Data.AudioJitterAverageDelay = 0;
+						Sample.AudioJitterAverageDelay = 0;
 					}
 
-					if (Data.LastAudioStatTimestamp != 0 && Data.AudioTotalReceived != lastByteCount)
+					Sample.AudioJitterBufferCurrentDelay = GetIntervalDelayMs(audioJitterDelay, audioJitterEmitted,
+						Sample.LastAudioJitterBufferDelay, Sample.LastAudioJitterBufferEmittedCount, Sample.AudioJitterBufferCurrentDelay);
+
+					if (Sample.LastAudioStatTimestamp != 0 && Sample.AudioTotalReceived != lastByteCount)
 					{
-						Data.AudioBitrate = (Data.AudioTotalReceived - lastByteCount) * NUM_US * 8 / (timestamp - Data.LastAudioStatTimestamp);
+						Sample.AudioBitrate = (Sample.AudioTotalReceived - lastByteCount) * NUM_US * 8 / (timestamp - Sample.LastAudioStatTimestamp);
 					}
 
-					Data.LastAudioStatTimestamp = timestamp;
-					Data.LastAudioReceivedTimestamp = InboundStat.last_packet_received_timestamp.ValueOrDefault(-1);
+					Sample.LastAudioStatTimestamp = timestamp;
+					Sample.LastAudioReceivedTimestamp = InboundStat.last_packet_received_timestamp.ValueOrDefault(-1);
 
 					auto CodecStats = Report->GetStatsOfType<webrtc::RTCCodecStats>();
 
@@ -147,22 +247,96 @@ namespace Millicast::Player
 
 					if (it != CodecStats.end())
 					{
-						Data.AudioCodec = ToString(*(*it)->mime_type);
+						Sample.AudioCodec = ToString(*(*it)->mime_type);
 					}
 				}
 			}
 			else if (Stats.type() == std::string("candidate-pair"))
 			{
 				auto CandidateStat = Stats.cast_to<webrtc::RTCIceCandidatePairStats>();
-				Data.Rtt = CandidateStat.current_round_trip_time.ValueOrDefault(0.) * 1000.;
+
+				// The other pairs were checked during the ICE gathering but carry no media
+				if (CandidateStat.nominated.ValueOrDefault(false))
+				{
+					Sample.Rtt = CandidateStat.current_round_trip_time.ValueOrDefault(0.) * 1000.;
+					Sample.AvailableIncomingBitrate = CandidateStat.available_incoming_bitrate.ValueOrDefault(0.);
+				}
 			}
 		}
 
-		Data.Timestamp = Report->timestamp_us();
+		UpdateLatencyTarget(Sample);
+
+		Sample.Timestamp = Report->timestamp_us();
+
+		{
+			FScopeLock Lock(&DataSection);
+			Data = Sample;
+			PushHistory(Sample);
+		}
+
+		DetachLock.Unlock();
 
 		OnStats.Broadcast(Report);
 	}
 
+	float FPlayerStatsCollector::GetIntervalDelayMs(double TotalDelay, uint64 EmittedCount, double& LastTotalDelay, uint64& LastEmittedCount, float PreviousValue)
+	{
+		// Counters restart with a new receiver
+		if (TotalDelay < LastTotalDelay || EmittedCount < LastEmittedCount)
+		{
+			LastTotalDelay = 0.;
+			LastEmittedCount = 0;
+		}
+
+		const uint64 Emitted = EmittedCount - LastEmittedCount;
+		const double Delay = TotalDelay - LastTotalDelay;
+
+		LastTotalDelay = FMath::Max(TotalDelay, 0.);
+		LastEmittedCount = EmittedCount;
+
+		// Nothing came out of the buffer during the interval, keep the last value
+		return Emitted != 0 && Delay >= 0. ? 1000. * Delay / Emitted : PreviousValue;
+	}
+
+	void FPlayerStatsCollector::LogNegotiatedVideoCodec(const FString& MimeType) const
+	{
+		const TArray<FString>& Preferences = PeerConnection->VideoCodecPreferences;
+
+		FString Name;
+		MimeType.Split(TEXT("/"), nullptr, &Name);
+
+		const int32 Rank = Preferences.IndexOfByPredicate([&Name](const FString& Preference) { return Preference.Equals(Name, ESearchCase::IgnoreCase); });
+		if (Preferences.Num() == 0)
+		{
+			UE_LOG(LogMillicastPlayer, Log, TEXT("Negotiated video codec %s"), *MimeType);
+		}
+		else if (Rank == INDEX_NONE)
+		{
+			UE_LOG(LogMillicastPlayer, Warning, TEXT("Negotiated video codec %s, which is not one of the preferred codecs"), *MimeType);
+		}
+		else
+		{
+			UE_LOG(LogMillicastPlayer, Log, TEXT("Negotiated video codec %s, preference %d of %d"), *MimeType, Rank + 1, Preferences.Num());
+		}
+	}
+
+	void FPlayerStatsCollector::UpdateLatencyTarget(FPlayerStatsData& Sample) const
+	{
+		const FLatencySettings Settings = PeerConnection->GetLatencySettings();
+
+		Sample.JitterBufferMinimumDelay = Settings.MinimumJitterBufferDelayMs.Get(-1.);
+		Sample.MaximumDelay = Settings.MaximumDelayMs;
+
+		const bool bWasMet = Sample.bLatencyTargetMet;
+		Sample.bLatencyTargetMet = Settings.MaximumDelayMs < 0. || FMath::Max(Sample.VideoJitterBufferCurrentDelay, Sample.AudioJitterBufferCurrentDelay) <= Settings.MaximumDelayMs;
+
+		if (bWasMet != Sample.bLatencyTargetMet)
+		{
+			UE_LOG(LogMillicastPlayer, Log, TEXT("Latency target of %.0f ms %s : video jitter buffer delay %.1f ms, audio %.1f ms"),
+				Settings.MaximumDelayMs, Sample.bLatencyTargetMet ? TEXT("met") : TEXT("missed"), Sample.VideoJitterBufferCurrentDelay, Sample.AudioJitterBufferCurrentDelay);
+		}
+	}
+
 	const FString& FPlayerStatsCollector::GetClusterId() const
 	{
 		return PeerConnection->ClusterId;
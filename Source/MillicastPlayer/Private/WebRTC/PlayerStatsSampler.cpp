@@ -0,0 +1,71 @@
+// Copyright Millicast 2023. All Rights Reserved.
+
+#include "PlayerStatsSampler.h"
+
+#if ENGINE_MAJOR_VERSION >= 5 && ENGINE_MINOR_VERSION > 0
+
+#include "HAL/Event.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/PlatformProcess.h"
+#include "HAL/RunnableThread.h"
+#include "MillicastPlayerPrivate.h"
+
+static TAutoConsoleVariable<float> CVarMillicastStatsSampleInterval(
+	TEXT("Millicast.Player.StatsSampleInterval"),
+	1.f,
+	TEXT("Seconds between two stats reports of each connection. 0 stops the collection, the stats keep their last values."),
+	ECVF_Default);
+
+namespace Millicast::Player
+{
+	namespace
+	{
+		// How often the interval is read again while the collection is stopped
+		constexpr float StoppedCheckIntervalSeconds = 1.f;
+	}
+
+	FPlayerStatsSampler::FPlayerStatsSampler(TFunction<void()> InPoll)
+		: Poll(MoveTemp(InPoll))
+	{
+		WakeEvent = FPlatformProcess::GetSynchEventFromPool();
+		Thread = FRunnableThread::Create(this, TEXT("MillicastStatsSampler"), 0, TPri_BelowNormal);
+	}
+
+	FPlayerStatsSampler::~FPlayerStatsSampler()
+	{
+		if (Thread)
+		{
+			Stop();
+			Thread->WaitForCompletion();
+			delete Thread;
+		}
+
+		FPlatformProcess::ReturnSynchEventToPool(WakeEvent);
+	}
+
+	uint32 FPlayerStatsSampler::Run()
+	{
+		UE_LOG(LogMillicastPlayer, Verbose, TEXT("%S"), __FUNCTION__);
+
+		while (!bStopping)
+		{
+			const float IntervalSeconds = CVarMillicastStatsSampleInterval.GetValueOnAnyThread();
+			WakeEvent->Wait(FTimespan::FromSeconds(IntervalSeconds > 0.f ? IntervalSeconds : StoppedCheckIntervalSeconds));
+
+			if (!bStopping && IntervalSeconds > 0.f)
+			{
+				Poll();
+			}
+		}
+
+		return 0;
+	}
+
+	void FPlayerStatsSampler::Stop()
+	{
+		bStopping = true;
+		WakeEvent->Trigger();
+	}
+}
+
+#endif
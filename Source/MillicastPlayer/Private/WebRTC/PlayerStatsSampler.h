@@ -0,0 +1,40 @@
+// Copyright Millicast 2023. All Rights Reserved.
+
+#pragma once
+
+#include "Runtime/Launch/Resources/Version.h"
+
+#if ENGINE_MAJOR_VERSION >= 5 && ENGINE_MINOR_VERSION > 0
+
+#include "HAL/Runnable.h"
+#include "Templates/Atomic.h"
+
+class FEvent;
+class FRunnableThread;
+
+namespace Millicast::Player
+{
+	/**
+	 * Thread polling the stats collectors every Millicast.Player.StatsSampleInterval seconds, so that the overlay, the CSV
+	 * and the subscribers only ever read the snapshots of the last reports. Stopped and joined when destroyed.
+	 */
+	class FPlayerStatsSampler : public FRunnable
+	{
+	public:
+		/** Called on the sampler thread, the reports are delivered later on the signaling thread */
+		explicit FPlayerStatsSampler(TFunction<void()> InPoll);
+		~FPlayerStatsSampler();
+
+		// FRunnable interface
+		uint32 Run() override;
+		void Stop() override;
+
+	private:
+		TFunction<void()> Poll;
+		FEvent* WakeEvent = nullptr;
+		FRunnableThread* Thread = nullptr;
+		TAtomic<bool> bStopping { false };
+	};
+}
+
+#endif
@@ -0,0 +1,298 @@
+// Copyright Millicast 2023. All Rights Reserved.
+
+#include "SdpEditor.h"
+
+#include <algorithm>
+#include <pc/session_description.h>
+
+#include "MillicastPlayerPrivate.h"
+
+namespace
+{
+	bool CodecNameEquals(const std::string& A, const std::string& B)
+	{
+		return FCStringAnsi::Stricmp(A.c_str(), B.c_str()) == 0;
+	}
+
+	template<typename TContentDescription, typename TEdits>
+	void EditCodecs(TContentDescription& Content, const TEdits& Edits)
+	{
+		auto Codecs = Content.codecs();
+
+		for (const auto& Parameter : Edits.CodecParameters)
+		{
+			for (auto& Codec : Codecs)
+			{
+				if (CodecNameEquals(Codec.name, Parameter.CodecName))
+				{
+					Codec.SetParam(Parameter.Key, Parameter.Value);
+				}
+			}
+		}
+
+		if (!Edits.CodecOrder.empty())
+		{
+			std::vector<typename std::decay_t<decltype(Codecs)>::value_type> Ordered;
+			Ordered.reserve(Codecs.size());
+
+			for (const auto& Name : Edits.CodecOrder)
+			{
+				std::copy_if(Codecs.begin(), Codecs.end(), std::back_inserter(Ordered),
+					[&Name](const auto& Codec) { return CodecNameEquals(Codec.name, Name); });
+			}
+
+			std::copy_if(Codecs.begin(), Codecs.end(), std::back_inserter(Ordered), [&Edits](const auto& Codec)
+			{
+				return std::none_of(Edits.CodecOrder.begin(), Edits.CodecOrder.end(),
+					[&Codec](const std::string& Name) { return CodecNameEquals(Codec.name, Name); });
+			});
+
+			Codecs = std::move(Ordered);
+		}
+
+		Content.set_codecs(Codecs);
+	}
+}
+
+namespace Millicast::Player
+{
+
+bool FSdpEditor::FMediaEdits::IsEmpty() const
+{
+	return CodecParameters.empty() && CodecOrder.empty() && AddedExtensions.empty() && RemovedExtensions.empty() && !BandwidthKbps.IsSet();
+}
+
+FSdpEditor& FSdpEditor::SetCodecParameter(cricket::MediaType MediaType, const std::string& CodecName, const std::string& Key, const std::string& Value)
+{
+	if (auto* Edits = GetEdits(MediaType))
+	{
+		auto It = std::find_if(Edits->CodecParameters.begin(), Edits->CodecParameters.end(), [&](const FCodecParameter& Parameter)
+		{
+			return CodecNameEquals(Parameter.CodecName, CodecName) && Parameter.Key == Key;
+		});
+
+		if (It != Edits->CodecParameters.end())
+		{
+			It->Value = Value;
+		}
+		else
+		{
+			Edits->CodecParameters.push_back({ CodecName, Key, Value });
+		}
+	}
+
+	return *this;
+}
+
+FSdpEditor& FSdpEditor::SetCodecOrder(cricket::MediaType MediaType, std::vector<std::string> CodecNames)
+{
+	if (auto* Edits = GetEdits(MediaType))
+	{
+		Edits->CodecOrder = std::move(CodecNames);
+	}
+
+	return *this;
+}
+
+FSdpEditor& FSdpEditor::AddHeaderExtension(cricket::MediaType MediaType, const std::string& Uri)
+{
+	if (auto* Edits = GetEdits(MediaType))
+	{
+		Edits->RemovedExtensions.erase(std::remove(Edits->RemovedExtensions.begin(), Edits->RemovedExtensions.end(), Uri), Edits->RemovedExtensions.end());
+		if (std::find(Edits->AddedExtensions.begin(), Edits->AddedExtensions.end(), Uri) == Edits->AddedExtensions.end())
+		{
+			Edits->AddedExtensions.push_back(Uri);
+		}
+	}
+
+	return *this;
+}
+
+FSdpEditor& FSdpEditor::RemoveHeaderExtension(cricket::MediaType MediaType, const std::string& Uri)
+{
+	if (auto* Edits = GetEdits(MediaType))
+	{
+		Edits->AddedExtensions.erase(std::remove(Edits->AddedExtensions.begin(), Edits->AddedExtensions.end(), Uri), Edits->AddedExtensions.end());
+		if (std::find(Edits->RemovedExtensions.begin(), Edits->RemovedExtensions.end(), Uri) == Edits->RemovedExtensions.end())
+		{
+			Edits->RemovedExtensions.push_back(Uri);
+		}
+	}
+
+	return *this;
+}
+
+FSdpEditor& FSdpEditor::ResetHeaderExtension(cricket::MediaType MediaType, const std::string& Uri)
+{
+	if (auto* Edits = GetEdits(MediaType))
+	{
+		Edits->AddedExtensions.erase(std::remove(Edits->AddedExtensions.begin(), Edits->AddedExtensions.end(), Uri), Edits->AddedExtensions.end());
+		Edits->RemovedExtensions.erase(std::remove(Edits->RemovedExtensions.begin(), Edits->RemovedExtensions.end(), Uri), Edits->RemovedExtensions.end());
+	}
+
+	return *this;
+}
+
+FSdpEditor& FSdpEditor::SetBandwidth(cricket::MediaType MediaType, int32 Kbps)
+{
+	if (auto* Edits = GetEdits(MediaType))
+	{
+		Edits->BandwidthKbps = Kbps;
+	}
+
+	return *this;
+}
+
+FSdpEditor& FSdpEditor::Reset(cricket::MediaType MediaType)
+{
+	if (auto* Edits = GetEdits(MediaType))
+	{
+		*Edits = FMediaEdits{};
+	}
+
+	return *this;
+}
+
+bool FSdpEditor::IsEmpty() const
+{
+	return AudioEdits.IsEmpty() && VideoEdits.IsEmpty();
+}
+
+FSdpEditor::FMediaEdits* FSdpEditor::GetEdits(cricket::MediaType MediaType)
+{
+	switch (MediaType)
+	{
+	case cricket::MediaType::MEDIA_TYPE_AUDIO: return &AudioEdits;
+	case cricket::MediaType::MEDIA_TYPE_VIDEO: return &VideoEdits;
+	default: return nullptr;
+	}
+}
+
+const FSdpEditor::FMediaEdits* FSdpEditor::GetEdits(cricket::MediaType MediaType) const
+{
+	return const_cast<FSdpEditor*>(this)->GetEdits(MediaType);
+}
+
+void FSdpEditor::Apply(cricket::SessionDescription& Description) const
+{
+	if (IsEmpty())
+	{
+		return;
+	}
+
+	// Bundled media sections share the header extension ids, an extension keeps the same id in every section
+	std::map<std::string, int> ExtensionIds;
+	for (const auto& Content : Description.contents())
+	{
+		if (const auto* Media = Content.media_description())
+		{
+			for (const auto& Extension : Media->rtp_header_extensions())
+			{
+				ExtensionIds.emplace(Extension.uri, Extension.id);
+			}
+		}
+	}
+
+	for (auto& Content : Description.contents())
+	{
+		auto* Media = Content.media_description();
+		if (!Media)
+		{
+			continue;
+		}
+
+		const auto* Edits = GetEdits(Media->type());
+		if (!Edits || Edits->IsEmpty())
+		{
+			continue;
+		}
+
+		ApplyCodecEdits(*Media, *Edits);
+		ApplyHeaderExtensionEdits(*Media, *Edits, ExtensionIds);
+		ApplyBandwidthEdits(*Media, *Edits);
+	}
+}
+
+void FSdpEditor::ApplyCodecEdits(cricket::MediaContentDescription& Media, const FMediaEdits& Edits)
+{
+	if (Edits.CodecParameters.empty() && Edits.CodecOrder.empty())
+	{
+		return;
+	}
+
+	if (auto* Audio = Media.as_audio())
+	{
+		EditCodecs(*Audio, Edits);
+	}
+	else if (auto* Video = Media.as_video())
+	{
+		EditCodecs(*Video, Edits);
+	}
+}
+
+void FSdpEditor::ApplyHeaderExtensionEdits(cricket::MediaContentDescription& Media, const FMediaEdits& Edits, std::map<std::string, int>& ExtensionIds)
+{
+	if (Edits.AddedExtensions.empty() && Edits.RemovedExtensions.empty())
+	{
+		return;
+	}
+
+	auto Extensions = Media.rtp_header_extensions();
+
+	Extensions.erase(std::remove_if(Extensions.begin(), Extensions.end(), [&Edits](const webrtc::RtpExtension& Extension)
+	{
+		return std::find(Edits.RemovedExtensions.begin(), Edits.RemovedExtensions.end(), Extension.uri) != Edits.RemovedExtensions.end();
+	}), Extensions.end());
+
+	for (const auto& Uri : Edits.AddedExtensions)
+	{
+		const bool bPresent = std::any_of(Extensions.begin(), Extensions.end(), [&Uri](const webrtc::RtpExtension& Extension) { return Extension.uri == Uri; });
+		if (bPresent)
+		{
+			continue;
+		}
+
+		int Id = 0;
+		if (auto It = ExtensionIds.find(Uri); It != ExtensionIds.end())
+		{
+			Id = It->second;
+		}
+		else
+		{
+			// One byte header ids only, the two byte form is not negotiated by every server
+			for (int Candidate = 1; Candidate <= webrtc::RtpExtension::kOneByteHeaderExtensionMaxId && Id == 0; ++Candidate)
+			{
+				const bool bUsed = std::any_of(ExtensionIds.begin(), ExtensionIds.end(), [Candidate](const auto& Entry) { return Entry.second == Candidate; });
+				Id = bUsed ? 0 : Candidate;
+			}
+
+			if (Id == 0)
+			{
+				UE_LOG(LogMillicastPlayer, Warning, TEXT("No free header extension id for %S"), Uri.c_str());
+				continue;
+			}
+
+			ExtensionIds.emplace(Uri, Id);
+		}
+
+		Extensions.emplace_back(Uri, Id);
+	}
+
+	Media.set_rtp_header_extensions(Extensions);
+}
+
+void FSdpEditor::ApplyBandwidthEdits(cricket::MediaContentDescription& Media, const FMediaEdits& Edits)
+{
+	if (!Edits.BandwidthKbps.IsSet())
+	{
+		return;
+	}
+
+	const int32 Kbps = Edits.BandwidthKbps.GetValue();
+	Media.set_bandwidth(Kbps > 0 ? Kbps * 1000 : cricket::kAutoBandwidth);
+#if WEBRTC_VERSION >= 96
+	Media.set_bandwidth_type("AS");
+#endif
+}
+
+}
@@ -0,0 +1,80 @@
+// Copyright Millicast 2023. All Rights Reserved.
+
+#pragma once
+
+#include "WebRTC/WebRTCInc.h"
+
+#include <map>
+#include <vector>
+
+namespace cricket
+{
+	class MediaContentDescription;
+	class SessionDescription;
+}  // cricket
+
+namespace Millicast::Player
+{
+	/**
+	 * Edits to apply to a parsed session description, instead of searching and splicing the sdp text.
+	 * Edits are recorded per media type and applied in a single pass over the media sections by Apply,
+	 * the description is then handed to WebRTC as is, without being serialized and parsed again.
+	 */
+	class FSdpEditor
+	{
+	public:
+		/** Set a fmtp parameter of a codec, for instance stereo=1 for opus */
+		FSdpEditor& SetCodecParameter(cricket::MediaType MediaType, const std::string& CodecName, const std::string& Key, const std::string& Value);
+
+		/** Move these codecs first, in this order. The other codecs keep their relative order. Names are case insensitive */
+		FSdpEditor& SetCodecOrder(cricket::MediaType MediaType, std::vector<std::string> CodecNames);
+
+		/** Offer this header extension, with the first free id, if the media section does not have it already */
+		FSdpEditor& AddHeaderExtension(cricket::MediaType MediaType, const std::string& Uri);
+
+		/** Strip this header extension from the media sections */
+		FSdpEditor& RemoveHeaderExtension(cricket::MediaType MediaType, const std::string& Uri);
+
+		/** Forget a previous add or remove of this header extension, the media sections keep what WebRTC offers */
+		FSdpEditor& ResetHeaderExtension(cricket::MediaType MediaType, const std::string& Uri);
+
+		/** Set the b=AS line of the media sections. 0 or less removes it */
+		FSdpEditor& SetBandwidth(cricket::MediaType MediaType, int32 Kbps);
+
+		/** Forget every edit of this media type */
+		FSdpEditor& Reset(cricket::MediaType MediaType);
+
+		bool IsEmpty() const;
+
+		void Apply(cricket::SessionDescription& Description) const;
+
+	private:
+		struct FCodecParameter
+		{
+			std::string CodecName;
+			std::string Key;
+			std::string Value;
+		};
+
+		struct FMediaEdits
+		{
+			std::vector<FCodecParameter> CodecParameters;
+			std::vector<std::string> CodecOrder;
+			std::vector<std::string> AddedExtensions;
+			std::vector<std::string> RemovedExtensions;
+			TOptional<int32> BandwidthKbps;
+
+			bool IsEmpty() const;
+		};
+
+		FMediaEdits* GetEdits(cricket::MediaType MediaType);
+		const FMediaEdits* GetEdits(cricket::MediaType MediaType) const;
+
+		static void ApplyCodecEdits(cricket::MediaContentDescription& Media, const FMediaEdits& Edits);
+		static void ApplyHeaderExtensionEdits(cricket::MediaContentDescription& Media, const FMediaEdits& Edits, std::map<std::string, int>& ExtensionIds);
+		static void ApplyBandwidthEdits(cricket::MediaContentDescription& Media, const FMediaEdits& Edits);
+
+		FMediaEdits AudioEdits;
+		FMediaEdits VideoEdits;
+	};
+}
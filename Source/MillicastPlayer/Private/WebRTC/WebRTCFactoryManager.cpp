@@ -0,0 +1,240 @@
+// Copyright Millicast 2023. All Rights Reserved.
+
+#include "WebRTCFactoryManager.h"
+
+#include "AudioDeviceModule.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/PlatformMemory.h"
+#include "MillicastPlayerPrivate.h"
+#include "PeerConnection.h"
+#include "Util.h"
+
+namespace Millicast::Player
+{
+
+static TAutoConsoleVariable<int32> CVarMillicastWorkerThreads(
+	TEXT("Millicast.Player.WorkerThreads"),
+	2,
+	TEXT("Maximum number of WebRTC worker threads shared by all the subscribers, each connection keeps its own factory. 0 gives each connection its own thread."),
+	ECVF_Default);
+
+FWebRTCFactoryManager& FWebRTCFactoryManager::Get()
+{
+	static FWebRTCFactoryManager Instance;
+	return Instance;
+}
+
+TSharedPtr<FWebRTCFactoryContext> FWebRTCFactoryManager::Acquire(FWebRTCPeerConnection* PeerConnection, int32 PullPeriodMs)
+{
+	UE_LOG(LogMillicastPlayer, Verbose, TEXT("%S"), __FUNCTION__);
+
+	FScopeLock Lock(&CriticalSection);
+
+	if (NumPeerConnections == 0)
+	{
+		StartSharedThreads();
+	}
+
+	++NumPeerConnections;
+
+	TSharedPtr<FWebRTCFactoryContext> Context = CreateContext(PeerConnection, PullPeriodMs);
+	if (!Context)
+	{
+		--NumPeerConnections;
+
+		if (NumPeerConnections == 0)
+		{
+			StopSharedThreads();
+		}
+		return nullptr;
+	}
+
+	LogUsage(TEXT("Acquire"));
+
+	return Context;
+}
+
+void FWebRTCFactoryManager::Release(FWebRTCPeerConnection* PeerConnection, const TSharedPtr<FWebRTCFactoryContext>& Context)
+{
+	UE_LOG(LogMillicastPlayer, Verbose, TEXT("%S"), __FUNCTION__);
+
+	if (!Context)
+	{
+		return;
+	}
+
+	FScopeLock Lock(&CriticalSection);
+
+	DestroyContext(Context);
+
+	--NumPeerConnections;
+
+	LogUsage(TEXT("Release"));
+
+	if (NumPeerConnections == 0)
+	{
+		StopSharedThreads();
+	}
+}
+
+TSharedPtr<FWebRTCWorker> FWebRTCFactoryManager::AcquireWorker()
+{
+	// Spread connections over the allowed number of worker threads first, then share the least loaded one
+	const int32 MaxWorkers = CVarMillicastWorkerThreads.GetValueOnAnyThread();
+
+	TSharedPtr<FWebRTCWorker> Worker;
+	if (MaxWorkers > 0 && Workers.Num() >= MaxWorkers)
+	{
+		for (const auto& Candidate : Workers)
+		{
+			if (!Worker || Candidate->NumPeerConnections < Worker->NumPeerConnections)
+			{
+				Worker = Candidate;
+			}
+		}
+	}
+
+	if (!Worker)
+	{
+		UE_LOG(LogMillicastPlayer, Log, TEXT("Creating Worker thread"));
+		Worker = MakeShared<FWebRTCWorker>();
+		Worker->Thread = TUniquePtr<rtc::Thread>(rtc::Thread::Create().release());
+		Worker->Thread->SetName("WebRTCWorkerThread", nullptr);
+		Worker->Thread->Start();
+
+		Workers.Add(Worker);
+	}
+
+	++Worker->NumPeerConnections;
+
+	return Worker;
+}
+
+void FWebRTCFactoryManager::ReleaseWorker(const TSharedPtr<FWebRTCWorker>& Worker)
+{
+	if (--Worker->NumPeerConnections > 0)
+	{
+		return;
+	}
+
+	UE_LOG(LogMillicastPlayer, Verbose, TEXT("Stop webrtc worker thread"));
+	Worker->Thread->Stop();
+	Worker->Thread = nullptr;
+
+	Workers.Remove(Worker);
+}
+
+void FWebRTCFactoryManager::StartSharedThreads()
+{
+	UE_LOG(LogMillicastPlayer, Log, TEXT("Initialize ssl and random"));
+	rtc::InitializeSSL();
+	rtc::InitRandom(static_cast<int>(rtc::Time()));
+
+	UE_LOG(LogMillicastPlayer, Log, TEXT("Creating Signaling thread"));
+	SignalingThread = TUniquePtr<rtc::Thread>(rtc::Thread::Create().release());
+	SignalingThread->SetName("WebRTCSignalingThread", nullptr);
+	SignalingThread->Start();
+
+	UE_LOG(LogMillicastPlayer, Log, TEXT("Creating Networking thread"));
+	NetworkingThread = TUniquePtr<rtc::Thread>(rtc::Thread::CreateWithSocketServer().release());
+	NetworkingThread->SetName("WebRTCNetworkThread", nullptr);
+	NetworkingThread->Start();
+
+	TaskQueueFactory = webrtc::CreateDefaultTaskQueueFactory();
+}
+
+void FWebRTCFactoryManager::StopSharedThreads()
+{
+	UE_LOG(LogMillicastPlayer, Verbose, TEXT("Stop shared webrtc threads"));
+
+	TaskQueueFactory = nullptr;
+
+	SignalingThread->Stop();
+	NetworkingThread->Stop();
+
+	SignalingThread = nullptr;
+	NetworkingThread = nullptr;
+
+	UE_LOG(LogMillicastPlayer, Verbose, TEXT("Cleanup ssl"));
+	rtc::CleanupSSL();
+}
+
+TSharedPtr<FWebRTCFactoryContext> FWebRTCFactoryManager::CreateContext(FWebRTCPeerConnection* PeerConnection, int32 PullPeriodMs)
+{
+	auto Context = MakeShared<FWebRTCFactoryContext>();
+	Context->Worker = AcquireWorker();
+
+	UE_LOG(LogMillicastPlayer, Log, TEXT("Creating audio device module"));
+	Context->AudioDeviceModule = FAudioDeviceModule::Create(TaskQueueFactory.get(), PeerConnection);
+	Context->AudioDeviceModule->SetPullPeriodMs(PullPeriodMs);
+
+	UE_LOG(LogMillicastPlayer, Log, TEXT("Creating Peerconnection factory"));
+	Context->PeerConnectionFactory = webrtc::CreatePeerConnectionFactory(
+		NetworkingThread.Get(), Context->Worker->Thread.Get(), SignalingThread.Get(),
+		Context->AudioDeviceModule,
+		webrtc::CreateAudioEncoderFactory<webrtc::AudioEncoderOpus, webrtc::AudioEncoderMultiChannelOpus>(),
+		webrtc::CreateAudioDecoderFactory<webrtc::AudioDecoderOpus, webrtc::AudioDecoderMultiChannelOpus>(),
+		webrtc::CreateBuiltinVideoEncoderFactory(),
+		webrtc::CreateBuiltinVideoDecoderFactory(),
+		nullptr,
+		nullptr
+	).release();
+
+	// Check
+	if (!Context->PeerConnectionFactory)
+	{
+		UE_LOG(LogMillicastPlayer, Error, TEXT("Creating PeerConnectionFactory | Failed"));
+		DestroyContext(Context);
+		return nullptr;
+	}
+
+	webrtc::PeerConnectionFactoryInterface::Options Options;
+	Options.crypto_options.srtp.enable_gcm_crypto_suites = true;
+	Context->PeerConnectionFactory->SetOptions(Options);
+
+	return Context;
+}
+
+void FWebRTCFactoryManager::DestroyContext(const TSharedPtr<FWebRTCFactoryContext>& Context)
+{
+	UE_LOG(LogMillicastPlayer, Verbose, TEXT("Destroy peerconnection factory"));
+
+	// We take another reference count here in the lambda, to make sure it does not go out of scope before the callback is called
+	if (Context->AudioDeviceModule)
+	{
+		Context->AudioDeviceModule->SetPeerConnection(nullptr);
+		AsyncGameThreadTaskUnguarded([RefAudioDeviceModule = Context->AudioDeviceModule]()
+		{
+			RefAudioDeviceModule->SetPlaying(false);
+		});
+	}
+
+	Context->PeerConnectionFactory = nullptr;
+	Context->AudioDeviceModule = nullptr;
+
+	ReleaseWorker(Context->Worker);
+	Context->Worker = nullptr;
+}
+
+int32 FWebRTCFactoryManager::GetNumThreads() const
+{
+	FScopeLock Lock(&CriticalSection);
+	return NumPeerConnections > 0 ? 2 + Workers.Num() + NumPeerConnections : 0;
+}
+
+int32 FWebRTCFactoryManager::GetNumPeerConnections() const
+{
+	FScopeLock Lock(&CriticalSection);
+	return NumPeerConnections;
+}
+
+void FWebRTCFactoryManager::LogUsage(const TCHAR* Reason) const
+{
+	// Memory is reported to compare setups with the same subscriber count
+	const FPlatformMemoryStats MemoryStats = FPlatformMemory::GetStats();
+
+	UE_LOG(LogMillicastPlayer, Log, TEXT("[%s] WebRTC connections: %d, worker threads: %d, threads: %d, used physical memory: %.1f MB"),
+		Reason, NumPeerConnections, Workers.Num(), GetNumThreads(), MemoryStats.UsedPhysical / (1024.0 * 1024.0));
+}
+
+}
@@ -0,0 +1,80 @@
+// Copyright Millicast 2023. All Rights Reserved.
+
+#pragma once
+
+#include "WebRTC/WebRTCInc.h"
+
+namespace webrtc
+{
+	class TaskQueueFactory;
+}  // webrtc
+
+namespace Millicast::Player
+{
+	class FAudioDeviceModule;
+	class FWebRTCPeerConnection;
+
+	/** A pooled worker thread, shared by the factories of the connections it hosts */
+	struct FWebRTCWorker
+	{
+		TUniquePtr<rtc::Thread> Thread;
+		int32 NumPeerConnections = 0;
+	};
+
+	/**
+	 * The peer connection factory and audio device module of one connection, running on a pooled worker thread.
+	 * The audio device module pulls the mix of every stream of its factory, so each connection keeps its own
+	 * to track its audio readiness and pull period.
+	 */
+	struct FWebRTCFactoryContext
+	{
+		TSharedPtr<FWebRTCWorker> Worker;
+		rtc::scoped_refptr<FAudioDeviceModule> AudioDeviceModule;
+		rtc::scoped_refptr<webrtc::PeerConnectionFactoryInterface> PeerConnectionFactory;
+	};
+
+	/**
+	 * Process wide owner of the WebRTC threads and peer connection factories.
+	 * The signaling and network threads are shared by every connection, worker threads are pooled and their number
+	 * is capped by Millicast.Player.WorkerThreads. Each connection has its own factory on one of them. Everything is
+	 * ref counted by FWebRTCPeerConnection and torn down when the last connection is released.
+	 */
+	class FWebRTCFactoryManager
+	{
+	public:
+		static FWebRTCFactoryManager& Get();
+
+		/** Creates the factory context of a new peer connection, on the least loaded worker thread once the cap is reached */
+		TSharedPtr<FWebRTCFactoryContext> Acquire(FWebRTCPeerConnection* PeerConnection, int32 PullPeriodMs);
+
+		/** Must be called once the peer connection is closed. Destroys the context, and the threads when they become unused */
+		void Release(FWebRTCPeerConnection* PeerConnection, const TSharedPtr<FWebRTCFactoryContext>& Context);
+
+		rtc::Thread* GetSignalingThread() const { return SignalingThread.Get(); }
+
+		/** The shared threads, the pooled workers and the audio queue of each connection */
+		int32 GetNumThreads() const;
+		int32 GetNumPeerConnections() const;
+
+	private:
+		void StartSharedThreads();
+		void StopSharedThreads();
+
+		TSharedPtr<FWebRTCWorker> AcquireWorker();
+		void ReleaseWorker(const TSharedPtr<FWebRTCWorker>& Worker);
+
+		TSharedPtr<FWebRTCFactoryContext> CreateContext(FWebRTCPeerConnection* PeerConnection, int32 PullPeriodMs);
+		void DestroyContext(const TSharedPtr<FWebRTCFactoryContext>& Context);
+
+		void LogUsage(const TCHAR* Reason) const;
+
+		mutable FCriticalSection CriticalSection;
+
+		TUniquePtr<rtc::Thread> SignalingThread;
+		TUniquePtr<rtc::Thread> NetworkingThread;
+		std::unique_ptr<webrtc::TaskQueueFactory> TaskQueueFactory;
+
+		TArray<TSharedPtr<FWebRTCWorker>> Workers;
+		int32 NumPeerConnections = 0;
+	};
+}
@@ -0,0 +1,128 @@
+// Copyright Millicast 2023. All Rights Reserved.
+
+#pragma once
+
+#include "Components/SynthComponent.h"
+#include "IMillicastExternalAudioConsumer.h"
+#include "MillicastAudioMixerComponent.generated.h"
+
+class UMillicastAudioTrack;
+class UMillicastAudioMixerComponent;
+
+namespace Millicast::Player
+{
+	struct FAudioMixerInputState;
+	struct FAudioMixerState;
+}
+
+/**
+ * One input of a UMillicastAudioMixerComponent. Consumes a single audio track and
+ * buffers its samples until the mixer render callback sums them with the other inputs.
+ */
+UCLASS(BlueprintType, Category = "MillicastPlayer")
+class MILLICASTPLAYER_API UMillicastAudioMixerInput : public UObject, public IMillicastExternalAudioConsumer
+{
+	GENERATED_BODY()
+
+public:
+	void Setup(UMillicastAudioMixerComponent* InMixer, UMillicastAudioTrack* InTrack, int32 InMaxLatencyMs);
+
+	/**
+	* Set the linear gain applied to this input.
+	*/
+	UFUNCTION(BlueprintCallable, Category = "MillicastPlayer", META = (DisplayName = "SetGain"))
+	void SetGain(float InGain);
+
+	/**
+	* Set the stereo balance of this input, from -1 (left) to 1 (right).
+	*/
+	UFUNCTION(BlueprintCallable, Category = "MillicastPlayer", META = (DisplayName = "SetPan"))
+	void SetPan(float InPan);
+
+	UFUNCTION(BlueprintCallable, Category = "MillicastPlayer", META = (DisplayName = "GetGain"))
+	float GetGain() const { return Gain; }
+
+	UFUNCTION(BlueprintCallable, Category = "MillicastPlayer", META = (DisplayName = "GetPan"))
+	float GetPan() const { return Pan; }
+
+	UFUNCTION(BlueprintCallable, Category = "MillicastPlayer", META = (DisplayName = "GetTrack"))
+	UMillicastAudioTrack* GetTrack() const { return Track.Get(); }
+
+	// IMillicastExternalAudioConsumer
+	FMillicastAudioParameters GetAudioParameters() const override { return AudioParameters; }
+	void UpdateAudioParameters(FMillicastAudioParameters Parameters) noexcept override;
+	void Initialize() override;
+	void Shutdown() override;
+	void QueueAudioData(const uint8* AudioData, int32 NumSamples) override;
+	// ~IMillicastExternalAudioConsumer
+
+	/** Stop feeding the mixer. The render thread drops the input on its next callback */
+	void Detach();
+
+private:
+	void UpdateChannelGains();
+	int32 GetMaxQueuedSamples() const;
+
+	FMillicastAudioParameters AudioParameters;
+	int32 MaxLatencyMs = 40;
+
+	float Gain = 1.f;
+	float Pan = 0.f;
+
+	TWeakObjectPtr<UMillicastAudioMixerComponent> Mixer;
+	TWeakObjectPtr<UMillicastAudioTrack> Track;
+	TSharedPtr<Millicast::Player::FAudioMixerInputState, ESPMode::ThreadSafe> State;
+};
+
+/**
+ * Sums several Millicast audio tracks into a single voice.
+ * Each track added with AddTrack gets its own gain and pan, and the mix happens in the Audio Mixer
+ * render callback, so N tracks cost one voice instead of N procedural sounds.
+ */
+UCLASS(ClassGroup = Synth, BlueprintType, Blueprintable, Category = "MillicastPlayer",
+	META = (DisplayName = "Millicast Audio Mixer Component", BlueprintSpawnableComponent))
+class MILLICASTPLAYER_API UMillicastAudioMixerComponent : public USynthComponent
+{
+	GENERATED_BODY()
+
+public:
+	UMillicastAudioMixerComponent(const FObjectInitializer& ObjectInitializer);
+
+	/** Maximum amount of audio waiting per input before the oldest samples are dropped */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "MillicastPlayer", META = (ClampMin = 10, ClampMax = 500))
+	int32 MaxLatencyMs = 40;
+
+	/**
+	* Mix an audio track into this component's output.
+	* Returns the mixer input, which can be used to change the gain and pan of the track later on.
+	*/
+	UFUNCTION(BlueprintCallable, Category = "MillicastPlayer", META = (DisplayName = "AddTrack"))
+	UMillicastAudioMixerInput* AddTrack(UMillicastAudioTrack* AudioTrack, float Gain = 1.f, float Pan = 0.f);
+
+	/**
+	* Stop mixing an audio track.
+	*/
+	UFUNCTION(BlueprintCallable, Category = "MillicastPlayer", META = (DisplayName = "RemoveTrack"))
+	void RemoveTrack(UMillicastAudioTrack* AudioTrack);
+
+	/**
+	* Number of tracks currently mixed.
+	*/
+	UFUNCTION(BlueprintCallable, Category = "MillicastPlayer", META = (DisplayName = "GetNumTracks"))
+	int32 GetNumTracks() const { return Inputs.Num(); }
+
+	void RegisterInput(const TSharedPtr<Millicast::Player::FAudioMixerInputState, ESPMode::ThreadSafe>& InputState);
+
+protected:
+	// USynthComponent
+	bool Init(int32& SampleRate) override;
+	ISoundGeneratorPtr CreateSoundGenerator(const FSoundGeneratorInitParams& InParams) override;
+
+	void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+private:
+	UPROPERTY()
+	TArray<UMillicastAudioMixerInput*> Inputs;
+
+	TSharedPtr<Millicast::Player::FAudioMixerState, ESPMode::ThreadSafe> MixerState;
+};
@@ -0,0 +1,62 @@
+// Copyright Millicast 2023. All Rights Reserved.
+
+#pragma once
+
+#include "Components/SynthComponent.h"
+#include "IMillicastExternalAudioConsumer.h"
+#include "MillicastSoundGeneratorComponent.generated.h"
+
+namespace Millicast::Player
+{
+	class FAudioRingBuffer;
+}
+
+/**
+ * Audio consumer rendering Millicast audio straight from the Audio Mixer render callback.
+ * Unlike UMillicastAudioInstance there is no USoundWaveProcedural in between, samples are pulled from a
+ * ring buffer as float, which removes a buffer of latency and the mixer side queuing.
+ */
+UCLASS(ClassGroup = Synth, BlueprintType, Blueprintable, Category = "MillicastPlayer",
+	META = (DisplayName = "Millicast Sound Generator Component", BlueprintSpawnableComponent))
+class MILLICASTPLAYER_API UMillicastSoundGeneratorComponent : public USynthComponent, public IMillicastExternalAudioConsumer
+{
+	GENERATED_BODY()
+
+public:
+	UMillicastSoundGeneratorComponent(const FObjectInitializer& ObjectInitializer);
+
+	/** Maximum amount of audio waiting for the render callback before the oldest samples are dropped */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "MillicastPlayer", META = (ClampMin = 10, ClampMax = 500))
+	int32 MaxLatencyMs = 40;
+
+	// IMillicastExternalAudioConsumer
+	FMillicastAudioParameters GetAudioParameters() const override { return AudioParameters; }
+	void UpdateAudioParameters(FMillicastAudioParameters Parameters) noexcept override;
+
+	/**
+	* Start rendering. Called when an audio track is added.
+	*/
+	void Initialize() override;
+
+	/**
+	* Stop rendering. Called when the subscription ends.
+	*/
+	void Shutdown() override;
+
+	/**
+	* Push float samples in the ring buffer read by the render callback.
+	*/
+	void QueueAudioData(const uint8* AudioData, int32 NumSamples) override;
+	// ~IMillicastExternalAudioConsumer
+
+protected:
+	// USynthComponent
+	bool Init(int32& SampleRate) override;
+	ISoundGeneratorPtr CreateSoundGenerator(const FSoundGeneratorInitParams& InParams) override;
+
+private:
+	int32 GetMaxQueuedSamples() const;
+
+	FMillicastAudioParameters AudioParameters;
+	TSharedPtr<Millicast::Player::FAudioRingBuffer, ESPMode::ThreadSafe> RingBuffer;
+};
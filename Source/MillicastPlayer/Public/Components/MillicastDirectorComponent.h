@@ -11,6 +11,7 @@
 DECLARE_DYNAMIC_MULTICAST_DELEGATE_TwoParams(FMillicastDirectorComponentAuthenticated, UMillicastDirectorComponent*, DirectorComponent, const FMillicastSignalingData&, SignalingData);
 DECLARE_DYNAMIC_MULTICAST_DELEGATE_TwoParams(FMillicastDirectorComponentAuthenticationFailure, int32, Code, const FString&, Msg);
 DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FMillicastDirectorComponentAuthenticationRetry, float, NextAttemptInSeconds);
+DECLARE_MULTICAST_DELEGATE_OneParam(FMillicastDirectorComponentRequestStarted, UMillicastDirectorComponent*);
 
 class FJsonValue;
 class IHttpResponse;
@@ -60,6 +61,23 @@ public:
 	void CancelAuthenticateRetry();
 	
 	void RetryAuthenticateWithDelay();
+
+	/**
+	* Broadcast OnAuthenticated with the last director response for this media source, on the next tick, without any request.
+	* Returns false if there is none or its token is about to expire, in which case Authenticate must be used.
+	*/
+	UFUNCTION(BlueprintCallable, Category = "MillicastPlayer", META = (DisplayName = "TryAuthenticateFromCache"))
+	bool TryAuthenticateFromCache();
+
+	/**
+	* Forget the cached director response of this media source, for instance when its token has been rejected.
+	*/
+	UFUNCTION(BlueprintCallable, Category = "MillicastPlayer", META = (DisplayName = "InvalidateCachedSignalingData"))
+	void InvalidateCachedSignalingData();
+
+	/** FPlatformTime::Cycles64 at the start and the end of the last director request, 0 if the signaling data came from the cache */
+	uint64 GetLastRequestStartCycles() const { return LastRequestStartCycles; }
+	uint64 GetLastRequestEndCycles() const { return LastRequestEndCycles; }
 	
 public:
 	/** Called when the response from the director api is successfull */
@@ -74,6 +92,9 @@ public:
 	UPROPERTY(BlueprintAssignable, Category = "Components|Activation")
 	FMillicastDirectorComponentAuthenticationRetry OnAuthenticationRetry;
 
+	/** Called when a request to the director api is issued, before its response */
+	FMillicastDirectorComponentRequestStarted OnRequestStarted;
+
 private:
 	void BeginPlay() override;
 	void TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
@@ -82,6 +103,11 @@ private:
 	void ParseIceServers(const TArray<TSharedPtr<FJsonValue>>& IceServersField, FMillicastSignalingData& SignalingData);
 	void ParseDirectorResponse(TSharedPtr<IHttpResponse, ESPMode::ThreadSafe> Response);
 
+	FString GetCacheKey() const;
+
 private:
 	float TimeUntilNextRetryInSeconds = 0.0f;
+
+	uint64 LastRequestStartCycles = 0;
+	uint64 LastRequestEndCycles = 0;
 };
@@ -0,0 +1,152 @@
+// Copyright Millicast 2023. All Rights Reserved.
+
+#pragma once
+
+#include "Components/ActorComponent.h"
+#include "Components/MillicastSubscriberComponent.h"
+
+#include "MillicastLayerControllerComponent.generated.h"
+
+class UPrimitiveComponent;
+
+DECLARE_DYNAMIC_MULTICAST_SPARSE_DELEGATE_OneParam(FMillicastLayerControllerLayerChanged, UMillicastLayerControllerComponent, OnLayerChanged, const FMillicastLayerData&, Layer);
+
+/**
+	Selects the simulcast layer of a subscriber from local conditions: the smallest layer covering the screen size of the
+	component displaying the video, one layer lower for each step down taken while the game frame time or the decode time
+	is over budget. Steps are taken back up once the times stay under budget, with a margin, for a while.
+	Only acts while the subscriber is in the Full subscription tier.
+*/
+UCLASS(BlueprintType, Blueprintable, Category = "MillicastPlayer",
+	   META = (DisplayName = "Millicast Layer Controller Component", BlueprintSpawnableComponent))
+class MILLICASTPLAYER_API UMillicastLayerControllerComponent : public UActorComponent
+{
+	GENERATED_BODY()
+
+private:
+	/** Subscriber whose layer is selected. The first subscriber of the owner if not set */
+	UPROPERTY(EditAnywhere, Category = "Properties",
+		META = (DisplayName = "Subscriber", AllowPrivateAccess = true))
+	UMillicastSubscriberComponent* Subscriber = nullptr;
+
+	/** Component displaying the video, whose bounds are projected on the screen of the first local player */
+	UPROPERTY(EditAnywhere, Category = "Properties",
+		META = (DisplayName = "Display Component", AllowPrivateAccess = true))
+	UPrimitiveComponent* DisplayComponent = nullptr;
+
+	/** Scale applied to the projected size before looking for a layer covering it, above 1 to favor sharpness */
+	UPROPERTY(EditAnywhere, Category = "Properties",
+		META = (DisplayName = "Screen Size Scale", ClampMin = 0.1, AllowPrivateAccess = true))
+	float ScreenSizeScale = 1.f;
+
+	/** Game frame time above which a step down is taken. 0 disables it */
+	UPROPERTY(EditAnywhere, Category = "Properties",
+		META = (DisplayName = "Frame Time Budget (ms)", ClampMin = 0, AllowPrivateAccess = true))
+	float FrameTimeBudgetMs = 0.f;
+
+	/** Decode time per frame above which a step down is taken. 0 disables it */
+	UPROPERTY(EditAnywhere, Category = "Properties",
+		META = (DisplayName = "Decode Time Budget (ms)", ClampMin = 0, AllowPrivateAccess = true))
+	float DecodeTimeBudgetMs = 0.f;
+
+	/** How long the times must stay over budget before a step down */
+	UPROPERTY(EditAnywhere, Category = "Properties",
+		META = (DisplayName = "Step Down Delay (s)", ClampMin = 0, AllowPrivateAccess = true))
+	float StepDownDelaySeconds = 1.f;
+
+	/** How long the times must stay under budget times the step up ratio before a step up */
+	UPROPERTY(EditAnywhere, Category = "Properties",
+		META = (DisplayName = "Step Up Delay (s)", ClampMin = 0, AllowPrivateAccess = true))
+	float StepUpDelaySeconds = 5.f;
+
+	/** Fraction of the budgets the times must stay under to step up, below 1 so that a step up does not go over budget right away */
+	UPROPERTY(EditAnywhere, Category = "Properties",
+		META = (DisplayName = "Step Up Ratio", ClampMin = 0, ClampMax = 1, AllowPrivateAccess = true))
+	float StepUpRatio = 0.8f;
+
+	/** How long a new screen size must require another layer before switching to it */
+	UPROPERTY(EditAnywhere, Category = "Properties",
+		META = (DisplayName = "Screen Size Delay (s)", ClampMin = 0, AllowPrivateAccess = true))
+	float ScreenSizeDelaySeconds = 0.5f;
+
+public:
+	UMillicastLayerControllerComponent(const FObjectInitializer& ObjectInitializer);
+
+	UFUNCTION(BlueprintCallable, Category = "MillicastPlayer", META = (DisplayName = "SetSubscriber"))
+	void SetSubscriber(UMillicastSubscriberComponent* InSubscriber);
+
+	UFUNCTION(BlueprintCallable, Category = "MillicastPlayer", META = (DisplayName = "SetDisplayComponent"))
+	void SetDisplayComponent(UPrimitiveComponent* InDisplayComponent) { DisplayComponent = InDisplayComponent; }
+
+	/**
+	* Set the budgets, in milliseconds. 0 disables a budget
+	*/
+	UFUNCTION(BlueprintCallable, Category = "MillicastPlayer", META = (DisplayName = "SetBudgets"))
+	void SetBudgets(float InFrameTimeBudgetMs, float InDecodeTimeBudgetMs);
+
+	/**
+	* Stop selecting layers and let the server choose again, until enabled back
+	*/
+	UFUNCTION(BlueprintCallable, Category = "MillicastPlayer", META = (DisplayName = "SetControlEnabled"))
+	void SetControlEnabled(bool bEnabled);
+
+	/**
+	* Width and height in pixels of the display component on screen, as of the last update. Zero when it is not visible
+	*/
+	UFUNCTION(BlueprintCallable, Category = "MillicastPlayer", META = (DisplayName = "GetProjectedSize"))
+	FIntPoint GetProjectedSize() const { return ProjectedSize; }
+
+	/**
+	* Number of layers below the one covering the screen size, taken because of the budgets
+	*/
+	UFUNCTION(BlueprintCallable, Category = "MillicastPlayer", META = (DisplayName = "GetStepsDown"))
+	int32 GetStepsDown() const { return StepsDown; }
+
+public:
+	/** Called when a layer has been selected */
+	UPROPERTY(BlueprintAssignable, Category = "Components|Activation")
+	FMillicastLayerControllerLayerChanged OnLayerChanged;
+
+private:
+	void BeginPlay() override;
+	void TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
+
+	/** Size of the screen space bounding rectangle of the display component, clipped to the viewport. Zero when it is not visible */
+	FIntPoint ComputeProjectedSize() const;
+
+	/** Update the decode time per frame when the stats of the subscriber have been refreshed */
+	void UpdateDecodeTime();
+
+	/** Returns true while the game frame time or the decode time is over budget, false while both are under their step up threshold */
+	TOptional<bool> IsOverBudget();
+	void UpdateStepsDown(float DeltaTime);
+
+	/** Index in the spatial layers of the smallest layer covering the projected size */
+	void UpdateCoveringLayer(const TArray<FMillicastLayerData>& SpatialLayers, float DeltaTime);
+
+	void SelectLayer(const FMillicastLayerData& Layer);
+
+	/** Give the choice of the layer back to the server if it was taken */
+	void ReleaseLayer();
+
+	/** Last layer sent, unset while the server chooses */
+	TOptional<FMillicastLayerData> SelectedLayer;
+
+	FIntPoint ProjectedSize = FIntPoint::ZeroValue;
+	int32 StepsDown = 0;
+	bool bControlEnabled = true;
+
+	// Switched to once the projected size has required it for ScreenSizeDelaySeconds
+	int32 CoveringLayerIndex = INDEX_NONE;
+	int32 PendingCoveringLayerIndex = INDEX_NONE;
+	float PendingCoveringLayerTime = 0.f;
+
+	float OverBudgetTime = 0.f;
+	float UnderBudgetTime = 0.f;
+	float SmoothedFrameTimeMs = 0.f;
+
+	// The stats give the decode time cumulated since the start of the connection
+	float LastVideoDecodeTime = 0.f;
+	double LastVideoDecodeTimeSampleTime = 0.0;
+	float DecodeTimePerFrameMs = 0.f;
+};
@@ -4,6 +4,7 @@
 
 #include "Components/ActorComponent.h"
 #include "IMillicastMediaTrack.h"
+#include "MillicastConnectionTimings.h"
 #include "MillicastSignalingData.h"
 #include "MillicastMediaSource.h"
 #include "Runtime/Launch/Resources/Version.h"
@@ -18,11 +19,27 @@ namespace Millicast
 {
 	namespace Player
 	{
+		class FAudioDeviceModule;
+		class FFirstFrameSink;
 		class FPlayerStatsCollector;
+		class FSignalingMessageQueue;
+		class FSignalingTransactions;
 		class FWebRTCPeerConnection;
+
+		struct FSignalingResponse;
+		struct FSignalingError;
+		struct FSignalingActiveEvent;
+		struct FSignalingInactiveEvent;
+		struct FSignalingStoppedEvent;
+		struct FSignalingVadEvent;
+		struct FSignalingLayersEvent;
+		struct FSignalingViewerCountEvent;
+		struct FSignalingMigrateEvent;
 	}
 }
 
+struct FEmptyVariantState;
+
 USTRUCT(BlueprintType, Blueprintable, Category = "MillicastPlayer")
 struct MILLICASTPLAYER_API FMillicastTrackInfo
 {
@@ -48,6 +65,16 @@ struct MILLICASTPLAYER_API FMillicastLayerData
 
 	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "MillicastPlayer")
 	int32 TemporalLayerId = 0;
+
+	/** Resolution and bitrate in bps of the layer, 0 when the server does not report them */
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "MillicastPlayer")
+	int32 Width = 0;
+
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "MillicastPlayer")
+	int32 Height = 0;
+
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "MillicastPlayer")
+	int32 Bitrate = 0;
 };
 
 USTRUCT(BlueprintType, Blueprintable, Category = "MillicastPlayer", META=(BlueprintSpawnableComponent))
@@ -65,6 +92,25 @@ struct MILLICASTPLAYER_API FMillicastProjectionData
 	FString Media;
 };
 
+// Outcome of a command sent on the signaling
+UENUM(BlueprintType)
+enum class EMillicastCommandStatus : uint8
+{
+	Succeeded UMETA(DisplayName = "Succeeded"),
+	Failed    UMETA(DisplayName = "Failed"),      // The server answered with an error
+	TimedOut  UMETA(DisplayName = "Timed Out"),   // No answer within the command timeout
+	Cancelled UMETA(DisplayName = "Cancelled")    // The WebSocket was closed before the answer
+};
+
+// Decoding quality assigned by UMillicastSubscriptionManagerSubsystem, or set directly
+UENUM(BlueprintType)
+enum class EMillicastSubscriptionTier : uint8
+{
+	Full     UMETA(DisplayName = "Full"),      // Layer chosen by the server, or by Select, under the receive bitrate cap
+	Reduced  UMETA(DisplayName = "Reduced"),   // Lowest resolution layer
+	Paused   UMETA(DisplayName = "Paused")     // Lowest resolution and frame rate layer, video tracks disabled
+};
+
 DECLARE_DYNAMIC_MULTICAST_SPARSE_DELEGATE(FMillicastSubscriberComponentSubscribed, UMillicastSubscriberComponent, OnSubscribed);
 DECLARE_DYNAMIC_MULTICAST_SPARSE_DELEGATE_OneParam(FMillicastSubscriberComponentSubscribedFailure, UMillicastSubscriberComponent, OnSubscribedFailure, const FString&, Msg);
 
@@ -80,8 +126,20 @@ DECLARE_DYNAMIC_MULTICAST_SPARSE_DELEGATE(FMillicastSubscriberComponentStopped,
 DECLARE_DYNAMIC_MULTICAST_SPARSE_DELEGATE_TwoParams(FMillicastSubscriberComponentVad, UMillicastSubscriberComponent, OnVad, const FString&, Mid, const FString&, SourceId);
 DECLARE_DYNAMIC_MULTICAST_SPARSE_DELEGATE_ThreeParams(FMillicastSubscriberComponentLayers, UMillicastSubscriberComponent, OnLayers, const FString&, Mid, const TArray<FMillicastLayerData>&, ActiveLayers, const TArray<FMillicastLayerData>&, InactiveLayers);
 DECLARE_DYNAMIC_MULTICAST_SPARSE_DELEGATE_OneParam(FMillicastSubscriberComponentViewerCount, UMillicastSubscriberComponent, OnViewerCount, int, Count);
+DECLARE_DYNAMIC_MULTICAST_SPARSE_DELEGATE_TwoParams(FMillicastSubscriberComponentProjected, UMillicastSubscriberComponent, OnProjected, const FString&, SourceId, const TArray<FMillicastProjectionData>&, Projections);
+DECLARE_DYNAMIC_MULTICAST_SPARSE_DELEGATE_ThreeParams(FMillicastSubscriberComponentCommandCompleted, UMillicastSubscriberComponent, OnCommandCompleted, const FString&, Name, EMillicastCommandStatus, Status, float, RoundTripMs);
+DECLARE_DYNAMIC_MULTICAST_SPARSE_DELEGATE_OneParam(FMillicastSubscriberComponentSubscriptionTierChanged, UMillicastSubscriberComponent, OnSubscriptionTierChanged, EMillicastSubscriptionTier, Tier);
 DECLARE_DYNAMIC_MULTICAST_SPARSE_DELEGATE_ThreeParams(FMillicastSubscriberComponentFrameMetadata, UMillicastSubscriberComponent, OnFrameMetadata, int32, Ssrc, int32, Timestamp, const TArray<uint8>&, Metadata);
 
+// Receive side buffering. The lower the latency, the less network jitter can be absorbed before frames are dropped or audio is concealed
+UENUM(BlueprintType)
+enum class EMillicastLatencyMode : uint8
+{
+	Default         UMETA(DisplayName = "Default"),            // Jitter buffers adapted by WebRTC
+	LowLatency      UMETA(DisplayName = "Low Latency"),        // Minimum jitter buffer delay and playout delay range set on the subscriber
+	UltraLowLatency UMETA(DisplayName = "Ultra Low Latency")   // No minimum delay, small audio buffer that catches up quickly
+};
+
 enum class EMillicastSubscriberState : uint8
 {
 	Disconnected,
@@ -99,9 +157,6 @@ class MILLICASTPLAYER_API UMillicastSubscriberComponent : public UActorComponent
 	GENERATED_UCLASS_BODY()
 
 private:
-	TMap <FString, TFunction<void(TSharedPtr<class FJsonObject>)>> EventBroadcaster;
-	TMap <FString, TFunction<void(TSharedPtr<FJsonObject>)>> MessageParser;
-
 	/** The Millicast Media Source representing the configuration of the network source */
 	UPROPERTY(EditDefaultsOnly, Category = "Properties",
 			  META = (DisplayName = "Millicast Media Source", AllowPrivateAccess = true))
@@ -111,20 +166,86 @@ private:
 		META = (DisplayName = "Extract Frame Metadata", AllowPrivateAccess = true))
 	bool bUseFrameTransformer = false;
 
-private:
-	void SendCommand(const FString& Name, TSharedPtr<FJsonObject> Data);
+	/** How often audio is pulled from WebRTC and delivered to the consumers. Longer periods mean fewer wakeups but more latency */
+	UPROPERTY(EditDefaultsOnly, Category = "Properties",
+		META = (DisplayName = "Audio Pull Period", AllowPrivateAccess = true))
+	EMillicastAudioPullPeriod AudioPullPeriod = EMillicastAudioPullPeriod::Period10Ms;
+
+	/**
+	 * Take an already negotiated peer connection from UMillicastConnectionPoolSubsystem when subscribing,
+	 * so that only the view command is left to send once the WebSocket is connected.
+	 * The pool is only used with the default audio pull period.
+	 */
+	UPROPERTY(EditDefaultsOnly, Category = "Properties",
+		META = (DisplayName = "Use Connection Pool", AllowPrivateAccess = true))
+	bool bUseConnectionPool = false;
+
+	/**
+	 * Keep the peerconnection, tracks and their consumers when the connection drops, and recover with an ICE restart
+	 * once the signaling is back, instead of tearing everything down and subscribing again.
+	 * A failed media path closes the WebSocket to start the same recovery.
+	 */
+	UPROPERTY(EditDefaultsOnly, Category = "Properties",
+		META = (DisplayName = "Use Ice Restart Recovery", AllowPrivateAccess = true))
+	bool bUseIceRestartRecovery = false;
+
+	/** Receive side buffering of this subscription */
+	UPROPERTY(EditDefaultsOnly, Category = "Properties",
+		META = (DisplayName = "Latency Mode", AllowPrivateAccess = true))
+	EMillicastLatencyMode LatencyMode = EMillicastLatencyMode::Default;
+
+	/** Lower bound of the playout delay in Low Latency mode, set as the minimum delay of the audio and video jitter buffers */
+	UPROPERTY(EditDefaultsOnly, Category = "Properties",
+		META = (DisplayName = "Minimum Jitter Buffer Delay (ms)", ClampMin = 0, EditCondition = "LatencyMode == EMillicastLatencyMode::LowLatency", AllowPrivateAccess = true))
+	int32 MinimumJitterBufferDelayMs = 0;
+
+	/** Upper bound of the playout delay in Low Latency mode. The stats report whether the jitter buffers stay below it */
+	UPROPERTY(EditDefaultsOnly, Category = "Properties",
+		META = (DisplayName = "Maximum Playout Delay (ms)", ClampMin = 0, EditCondition = "LatencyMode == EMillicastLatencyMode::LowLatency", AllowPrivateAccess = true))
+	int32 MaximumPlayoutDelayMs = 200;
+
+	/**
+	 * Video codecs to receive, most preferred first, for instance H264, VP8, AV1. Codecs that are not listed
+	 * remain offered after them. Leave empty to keep the order of the decoder factory.
+	 */
+	UPROPERTY(EditDefaultsOnly, Category = "Properties",
+		META = (DisplayName = "Preferred Video Codecs", AllowPrivateAccess = true))
+	TArray<FString> PreferredVideoCodecs;
+
+	/** Time in seconds after which a command sent on the signaling without answer is reported as timed out */
+	UPROPERTY(EditDefaultsOnly, Category = "Properties",
+		META = (DisplayName = "Command Timeout (s)", ClampMin = 0.1, AllowPrivateAccess = true))
+	float CommandTimeoutSeconds = 10.f;
 
-	void ParseResponse(TSharedPtr<FJsonObject> JsonMsg);
-	void ParseError(TSharedPtr<FJsonObject> JsonMsg);
-	void ParseEvent(TSharedPtr<FJsonObject> JsonMsg);
+	/** Importance of this subscriber for UMillicastSubscriptionManagerSubsystem, multiplied by its on screen size. 0 keeps it paused */
+	UPROPERTY(EditDefaultsOnly, Category = "Properties",
+		META = (DisplayName = "Priority", ClampMin = 0, AllowPrivateAccess = true))
+	float Priority = 1.f;
+
+	/**
+	 * Upper bound of the received video bitrate in kbps, 0 for none. Offered as the video bandwidth of the local description,
+	 * and enforced by selecting a layer under it. Subscribers with a cap do not use the connection pool.
+	 */
+	UPROPERTY(EditDefaultsOnly, Category = "Properties",
+		META = (DisplayName = "Max Receive Bitrate (kbps)", ClampMin = 0, AllowPrivateAccess = true))
+	int32 MaxReceiveBitrateKbps = 0;
 
-	void ParseActiveEvent(TSharedPtr<FJsonObject> JsonMsg);
-	void ParseInactiveEvent(TSharedPtr<FJsonObject> JsonMsg);
-	void ParseStoppedEvent(TSharedPtr<FJsonObject> JsonMsg);
-	void ParseVadEvent(TSharedPtr<FJsonObject> JsonMsg);
-	void ParseLayersEvent(TSharedPtr<FJsonObject> JsonMsg);
-	void ParseViewerCountEvent(TSharedPtr<FJsonObject> JsonMsg);
-	void ParseMigrateEvent(TSharedPtr<FJsonObject> JsonMsg);
+private:
+	/** Send a command with the next transId. OnComplete is called on the game thread with its answer, or when it timed out */
+	void SendCommand(const FString& Name, TSharedPtr<FJsonObject> Data, TSharedPtr<IWebSocket> Socket = nullptr,
+		TFunction<void(EMillicastCommandStatus, const Millicast::Player::FSignalingResponse*)> OnComplete = nullptr);
+
+	/** Signaling messages, parsed by the signaling queue and handled on the game thread */
+	void HandleSignalingMessage(const FEmptyVariantState&) {}
+	void HandleSignalingMessage(const Millicast::Player::FSignalingResponse& Response);
+	void HandleSignalingMessage(const Millicast::Player::FSignalingError& Error);
+	void HandleSignalingMessage(const Millicast::Player::FSignalingActiveEvent& Event);
+	void HandleSignalingMessage(const Millicast::Player::FSignalingInactiveEvent& Event);
+	void HandleSignalingMessage(const Millicast::Player::FSignalingStoppedEvent& Event);
+	void HandleSignalingMessage(const Millicast::Player::FSignalingVadEvent& Event);
+	void HandleSignalingMessage(const Millicast::Player::FSignalingLayersEvent& Event);
+	void HandleSignalingMessage(const Millicast::Player::FSignalingViewerCountEvent& Event);
+	void HandleSignalingMessage(const Millicast::Player::FSignalingMigrateEvent& Event);
 
 public:
 
@@ -146,6 +267,13 @@ public:
 	 */
 	UFUNCTION(BlueprintCallable, Category = "MillicastPlayer", META = (DisplayName = "RegisterVideoConsumer"))
 	void RegisterVideoConsumer(TScriptInterface<IMillicastVideoConsumer> Consumer);
+
+	/**
+	 * Registers a IMillicastExternalAudioConsumer for this Subscriber, such as a UMillicastSoundGeneratorComponent.
+	 * Use before calling the Subscribe function
+	 */
+	UFUNCTION(BlueprintCallable, Category = "MillicastPlayer", META = (DisplayName = "RegisterAudioConsumer"))
+	void RegisterAudioConsumer(TScriptInterface<IMillicastExternalAudioConsumer> Consumer);
 	
 	/**
 	* Change the Millicast Media Source of this object
@@ -161,6 +289,22 @@ public:
 	UFUNCTION(BlueprintCallable, Category = "MillicastPlayer", META = (DisplayName = "Subscribe"))
 	bool Subscribe(UMillicastDirectorComponent* DirectorComponent, const FMillicastSignalingData& InConnectionInformation);
 
+	/**
+	* Create the peerconnection and its local offer ahead of Subscribe, so that the offer is generated while the director
+	* request and the WebSocket handshake are in flight. It is called on every request of the director component given to
+	* SetDirectorComponent or to Subscribe, otherwise call it before Authenticate. Subscribe calls it as well if it has not
+	* been called yet.
+	*/
+	UFUNCTION(BlueprintCallable, Category = "MillicastPlayer", META = (DisplayName = "PrepareConnection"))
+	void PrepareConnection();
+
+	/**
+	* Set the director component this subscriber is used with, before its first Authenticate, so that the connection is
+	* prepared during the first director request as well. Subscribe sets it too.
+	*/
+	UFUNCTION(BlueprintCallable, Category = "MillicastPlayer", META = (DisplayName = "SetDirectorComponent"))
+	void SetDirectorComponent(UMillicastDirectorComponent* DirectorComponent);
+
 	/**
 	* Attempts to stop receiving video from the Millicast feed
 	*/
@@ -175,7 +319,20 @@ public:
 	void EnableFrameTransformer(bool Enable);
 
 	/**
-	* Select a simulcast/svc layer
+	* Change the receive side buffering. The jitter buffer delay applies right away, the playout delay extension
+	* and the audio buffer size from the next connection.
+	*/
+	UFUNCTION(BlueprintCallable, Category = "MillicastPlayer", META = (DisplayName = "SetLatencyMode"))
+	void SetLatencyMode(EMillicastLatencyMode InLatencyMode, int32 InMinimumJitterBufferDelayMs = 0, int32 InMaximumPlayoutDelayMs = 200);
+
+	/**
+	* Set the video codecs to receive, most preferred first. Takes effect from the next connection
+	*/
+	UFUNCTION(BlueprintCallable, Category = "MillicastPlayer", META = (DisplayName = "SetPreferredVideoCodecs"))
+	void SetPreferredVideoCodecs(const TArray<FString>& Codecs);
+
+	/**
+	* Select a simulcast/svc layer. Only applied in the Full subscription tier, and lowered to fit the receive bitrate cap
 	*/
 	UFUNCTION(BlueprintCallable, Category = "MillicastPlayer", META = (DisplayName = "Select"))
 	void Select(const FMillicastLayerData& Layer);
@@ -192,6 +349,87 @@ public:
 	UFUNCTION(BlueprintCallable, Category = "MillicastPlayer", META = (DisplayName = "GetStats"))
 	FPlayerStatsData GetStats() const;
 
+	/**
+	* Returns the last stats reports, oldest first. Their number and interval are set with
+	* Millicast.Player.StatsHistorySize and Millicast.Player.StatsSampleInterval
+	*/
+	UFUNCTION(BlueprintCallable, Category = "MillicastPlayer", META = (DisplayName = "GetStatsHistory"))
+	TArray<FPlayerStatsData> GetStatsHistory() const;
+
+	/**
+	* Returns when each stage of the current connection was reached, from the director request to the first texture upload
+	*/
+	UFUNCTION(BlueprintCallable, Category = "MillicastPlayer", META = (DisplayName = "GetConnectionTimings"))
+	FMillicastConnectionTimings GetConnectionTimings() const;
+
+	/**
+	* Time in milliseconds between sending the last command with this name, for instance view, select or project, and its answer.
+	* -1 if no such command has been answered yet
+	*/
+	UFUNCTION(BlueprintCallable, Category = "MillicastPlayer", META = (DisplayName = "GetSignalingLatency"))
+	float GetSignalingLatency(const FString& CommandName) const;
+
+	/**
+	* Importance of this subscriber when the subscription manager shares the decoding budget. 0 keeps it paused
+	*/
+	UFUNCTION(BlueprintCallable, Category = "MillicastPlayer", META = (DisplayName = "SetPriority"))
+	void SetPriority(float InPriority) { Priority = FMath::Max(InPriority, 0.f); }
+
+	UFUNCTION(BlueprintCallable, Category = "MillicastPlayer", META = (DisplayName = "GetPriority"))
+	float GetPriority() const { return Priority; }
+
+	/**
+	* Number of screen pixels covered by the video of this subscriber, used by the subscription manager to rank the subscribers.
+	* 0 or less when unknown, the priority alone is used then
+	*/
+	UFUNCTION(BlueprintCallable, Category = "MillicastPlayer", META = (DisplayName = "SetScreenSizeHint"))
+	void SetScreenSizeHint(float Pixels) { ScreenSizeHint = Pixels; }
+
+	UFUNCTION(BlueprintCallable, Category = "MillicastPlayer", META = (DisplayName = "GetScreenSizeHint"))
+	float GetScreenSizeHint() const { return ScreenSizeHint; }
+
+	/**
+	* Change the decoding quality. Usually set by the subscription manager, which overrides it at its next update
+	*/
+	UFUNCTION(BlueprintCallable, Category = "MillicastPlayer", META = (DisplayName = "SetSubscriptionTier"))
+	void SetSubscriptionTier(EMillicastSubscriptionTier Tier);
+
+	UFUNCTION(BlueprintCallable, Category = "MillicastPlayer", META = (DisplayName = "GetSubscriptionTier"))
+	EMillicastSubscriptionTier GetSubscriptionTier() const { return SubscriptionTier; }
+
+	/**
+	* Active layers of the last layers event for this mid. Leave the mid empty for the main video track
+	*/
+	UFUNCTION(BlueprintCallable, Category = "MillicastPlayer", META = (DisplayName = "GetLayers"))
+	TArray<FMillicastLayerData> GetLayers(const FString& Mid) const;
+
+	/**
+	* Cap the received video bitrate, in kbps. 0 removes the cap. The bandwidth offered to the server only changes with the next offer
+	*/
+	UFUNCTION(BlueprintCallable, Category = "MillicastPlayer", META = (DisplayName = "SetMaxReceiveBitrate"))
+	void SetMaxReceiveBitrate(int32 Kbps);
+
+	UFUNCTION(BlueprintCallable, Category = "MillicastPlayer", META = (DisplayName = "GetMaxReceiveBitrate"))
+	int32 GetMaxReceiveBitrate() const { return MaxReceiveBitrateKbps; }
+
+	/**
+	* Share of the global receive bitrate budget in kbps, 0 for none. Usually set by the subscription manager
+	*/
+	UFUNCTION(BlueprintCallable, Category = "MillicastPlayer", META = (DisplayName = "SetAllocatedReceiveBitrate"))
+	void SetAllocatedReceiveBitrate(int32 Kbps);
+
+	UFUNCTION(BlueprintCallable, Category = "MillicastPlayer", META = (DisplayName = "GetAllocatedReceiveBitrate"))
+	int32 GetAllocatedReceiveBitrate() const { return AllocatedReceiveBitrateKbps; }
+
+	/**
+	* Lowest of the receive bitrate cap and the allocated share in kbps, 0 if there is neither
+	*/
+	UFUNCTION(BlueprintCallable, Category = "MillicastPlayer", META = (DisplayName = "GetEffectiveMaxReceiveBitrate"))
+	int32 GetEffectiveMaxReceiveBitrate() const;
+
+	/** Active layers of the main video track, nullptr until a layers event has been received for it */
+	const TArray<FMillicastLayerData>* GetMainVideoLayers() const;
+
 #if ENGINE_MAJOR_VERSION >= 5 && ENGINE_MINOR_VERSION > 0
 	/**
 	* Returns the stats collector instance for this subscriber
@@ -205,7 +443,9 @@ public:
 	bool IsConnectionActive() const;
 
 	/**
-	* Project a media track into a given transceiver mid
+	* Project a media track into a given transceiver mid.
+	* Leave the mid empty to use an idle transceiver of the same media, freed by Unproject or left over by AddRemoteTrack(s).
+	* Transceivers are only added, and the connection renegotiated, when none is idle. OnProjected gives the mids used.
 	*/
 	UFUNCTION(BlueprintCallable, Category = "MillicastPlayer", META = (DisplayName = "Project"))
 	void Project(const FString& SourceId, const TArray<FMillicastProjectionData>& ProjectionData);
@@ -223,6 +463,31 @@ public:
 	UFUNCTION(BlueprintCallable, Category = "MillicastPlayer", META = (DisplayName = "AddRemoteTrack"))
 	void AddRemoteTrack(const FString& Kind);
 
+	/**
+	* Number of idle transceivers of this media, "audio" or "video", that Project can use without renegotiating
+	*/
+	UFUNCTION(BlueprintCallable, Category = "MillicastPlayer", META = (DisplayName = "GetNumIdleRemoteTracks"))
+	int32 GetNumIdleRemoteTracks(const FString& Kind) const;
+
+	/**
+	* Add several remote tracks, "audio" or "video", negotiated together with a single offer.
+	* Prefer it over several AddRemoteTrack calls when receiving many sources.
+	*/
+	UFUNCTION(BlueprintCallable, Category = "MillicastPlayer", META = (DisplayName = "AddRemoteTracks"))
+	void AddRemoteTracks(const TArray<FString>& Kinds);
+
+	/**
+	* Time in milliseconds the video froze when switching to a new server after a migrate event, -1 if no migration happened
+	*/
+	UFUNCTION(BlueprintCallable, Category = "MillicastPlayer", META = (DisplayName = "GetLastMigrationGapMs"))
+	float GetLastMigrationGapMs() const;
+
+	/**
+	* Time in milliseconds from the last migrate event to the switch to the new server, -1 if no migration happened
+	*/
+	UFUNCTION(BlueprintCallable, Category = "MillicastPlayer", META = (DisplayName = "GetLastMigrationDurationMs"))
+	float GetLastMigrationDurationMs() const { return LastMigrationDurationMs; }
+
 public:
 	/** Called when the response from the director api is successfull */
 	UPROPERTY(BlueprintAssignable, Category = "Components|Activation")
@@ -268,6 +533,18 @@ public:
 	UPROPERTY(BlueprintAssignable, Category = "Components|Activation")
 	FMillicastSubscriberComponentAudioTrack OnAudioTrack;
 
+	/** Called when a projection has been sent, with the mid of each track */
+	UPROPERTY(BlueprintAssignable, Category = "Components|Activation")
+	FMillicastSubscriberComponentProjected OnProjected;
+
+	/** Called when a command sent on the signaling has been answered, or timed out */
+	UPROPERTY(BlueprintAssignable, Category = "Components|Activation")
+	FMillicastSubscriberComponentCommandCompleted OnCommandCompleted;
+
+	/** Called when the decoding quality of this subscriber has changed */
+	UPROPERTY(BlueprintAssignable, Category = "Components|Activation")
+	FMillicastSubscriberComponentSubscriptionTierChanged OnSubscriptionTierChanged;
+
 	/** Called when metadata gave been extracted from the video frame */
 	UPROPERTY(BlueprintAssignable, Category = "Components|Activation")
 	FMillicastSubscriberComponentFrameMetadata OnFrameMetadata;
@@ -275,17 +552,102 @@ public:
 private:
 	void BeginPlay() override;
 	void EndPlay(EEndPlayReason::Type Reason) override;
+	void TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
 
 	/** Websocket Connection */
 	bool StartWebSocketConnection(const FString& url, const FString& jwt);
+	TSharedPtr<IWebSocket> CreateWebSocket(const FString& Url, const FString& Jwt);
+	void BindWebSocketCallbacks();
+	void UnbindWebSocketCallbacks(const TSharedPtr<IWebSocket>& Socket);
 	void OnConnected();
 	void OnConnectionError(const FString& Error);
 	void OnClosed(int32 StatusCode, const FString& Reason, bool bWasClean);
 	void OnMessage(const FString& Msg);
 	void OnDisconnectedInternal(const FString& Reason);
 
-	/** Create the peerconnection and starts subscribing*/
-	bool SubscribeToMillicast();
+	/** Called on the game thread once the local description of the peerconnection is set */
+	void OnLocalDescriptionReady();
+
+	/** Send the view command once both the WebSocket and the local description are ready */
+	void TrySendView();
+
+	/** Terminate the tracks and destroy the peerconnection */
+	void ClosePeerConnection();
+
+	/** Use a ready peerconnection from the pool if allowed. Returns false if a new one must be created */
+	bool TakePooledPeerConnection();
+
+	/** Route the remote description, tracks and metadata of the peerconnection to this component */
+	void BindPeerConnectionCallbacks();
+	void BindRemoteDescriptionCallbacks();
+
+	void OnIceConnectionStateChanged(webrtc::PeerConnectionInterface::IceConnectionState IceState);
+
+	/** Copy the latency mode into the configuration of the next peerconnections */
+	void UpdateLatencyConfig();
+
+	/** Apply the latency mode to the receivers of this peerconnection */
+	void ApplyLatencySettings(Millicast::Player::FWebRTCPeerConnection* TargetPeerConnection) const;
+
+	/** Whether the current peerconnection has been negotiated and can be recovered with an ICE restart */
+	bool CanRestartIce() const;
+
+	/**
+	 * Create an ICE restart offer on the current peerconnection, sent with the view command of the next WebSocket.
+	 * Also used to gather with new ICE servers, within the current connection attempt when bResetTimer is false.
+	 */
+	void PrepareIceRestart(bool bResetTimer = true);
+
+	/** Send the view command with the local description of the peerconnection */
+	void SendViewCommand(Millicast::Player::FWebRTCPeerConnection* TargetPeerConnection, const TSharedPtr<IWebSocket>& Socket);
+
+	/** Apply the answer to the view command to the peerconnection it was sent for, if it is still the current or migrating one */
+	void OnViewResponse(uint64 PeerConnectionId, const Millicast::Player::FSignalingResponse& Response);
+
+	/** The view command was rejected or not answered. Aborts the migration it was sent for, or fails or reconnects the subscription */
+	void OnViewFailed(uint64 PeerConnectionId, EMillicastCommandStatus Status);
+
+	void SendProjectCommand(const FString& SourceId, const TArray<FMillicastProjectionData>& ProjectionData);
+
+	/** Hand a new remote track to a projection waiting for one, or keep it idle for the next one */
+	void OnRemoteTrackCreated(const FString& Mid, const FString& Media, bool bMainTrack);
+	void ResetTransceiverPool();
+
+	/**
+	 * Select the layer and enable the video tracks for the subscription tier and the receive bitrate cap,
+	 * sending select only if the layer changed
+	 */
+	void ApplySubscriptionTier();
+
+	/** Send the select command, nullptr to let the server choose */
+	void SendSelectCommand(const FMillicastLayerData* Layer);
+
+	/** Offer the receive bitrate cap in the next local descriptions of this peerconnection */
+	void ApplyReceiveBitrateCap(Millicast::Player::FWebRTCPeerConnection* TargetPeerConnection) const;
+
+	void CreateVideoTrack(const FString& Mid, rtc::scoped_refptr<webrtc::MediaStreamTrackInterface> Track);
+	void CreateAudioTrack(const FString& Mid, rtc::scoped_refptr<webrtc::MediaStreamTrackInterface> Track,
+		rtc::scoped_refptr<Millicast::Player::FAudioDeviceModule> AudioDeviceModule);
+
+	/**
+	 * Make before break migration: a second WebSocket and peerconnection subscribe to the new server while the current ones
+	 * keep playing. The tracks switch over on the first decoded frame of the new connection, then the old one is closed.
+	 */
+	bool StartMigration(const FMillicastSignalingData& SignalingData);
+	void BindMigrationCallbacks();
+	void TrySendMigrationView();
+	void OnMigrationMessage(const FString& Msg);
+	void DetachMigrationFrameSink();
+	void CompleteMigration();
+	void AbortMigration(const FString& Reason);
+
+	/** The director could not give the signaling data of the new server */
+	UFUNCTION()
+	void OnMigrationAuthenticationFailure(int32 Code, const FString& Msg);
+	void UnbindMigrationAuthentication();
+
+	/** The director component issued a request, prepare the connection that will use its response */
+	void OnDirectorRequestStarted(UMillicastDirectorComponent* DirectorComponent);
 
 	/** WebSocket Connection */
 	TSharedPtr<IWebSocket> WS;
@@ -294,6 +656,13 @@ private:
 	FDelegateHandle OnClosedHandle;
 	FDelegateHandle OnMessageHandle;
 
+	/** Parse the WebSocket messages away from the game thread and the peerconnection lock */
+	TSharedPtr<Millicast::Player::FSignalingMessageQueue, ESPMode::ThreadSafe> SignalingQueue;
+	TSharedPtr<Millicast::Player::FSignalingMessageQueue, ESPMode::ThreadSafe> MigrationSignalingQueue;
+
+	/** Commands of both WebSockets waiting for their answer */
+	TSharedPtr<Millicast::Player::FSignalingTransactions> SignalingTransactions;
+
 	Millicast::Player::FWebRTCPeerConnection* PeerConnection = nullptr;
 	webrtc::PeerConnectionInterface::RTCConfiguration PeerConnectionConfig;
 
@@ -302,6 +671,62 @@ private:
 	// Bool used internally for tracking whether the current websocket should reconnect on error or disconnect
 	bool bShouldReconnect = true;
 
+	// The view command needs both, whichever comes last sends it
+	bool bWebSocketConnected = false;
+	bool bLocalDescriptionReady = false;
+	bool bViewSent = false;
+
+	// The ice servers changed while the offer was created, restart ice once it is set
+	bool bIceRestartPending = false;
+
+	// Timestamps in seconds of the connection steps, used to log how much of the offer creation overlapped the signaling
+	double PrepareStartTime = 0.0;
+	double LocalDescriptionReadyTime = 0.0;
+	double SubscribeStartTime = 0.0;
+	double WebSocketConnectedTime = 0.0;
+
+	/**
+	 * Transceiver pool for Project. Every remote track mid is known with its media, the ones not projected are idle and reused
+	 * before adding transceivers. Projections without a mid wait here for the transceivers added for them.
+	 */
+	TMap<FString, FString> RemoteTrackMedia;
+	TSet<FString> ProjectedMids;
+	TArray<FString> IdleMids;
+	TArray<TPair<FString, FMillicastProjectionData>> PendingProjections;
+
+	/** Active layers of the last layers event, per mid */
+	TMap<FString, TArray<FMillicastLayerData>> LayersByMid;
+
+	EMillicastSubscriptionTier SubscriptionTier = EMillicastSubscriptionTier::Full;
+	float ScreenSizeHint = 0.f;
+
+	/** Layer of the main video track last sent with select, unset while the server chooses */
+	TOptional<FMillicastLayerData> SelectedLayer;
+
+	/** Layer asked with Select, unset after AutoSelect */
+	TOptional<FMillicastLayerData> RequestedLayer;
+
+	int32 AllocatedReceiveBitrateKbps = 0;
+
+	// Shared with the WebRTC callbacks, the tracks and the texture players, which mark the later stages
+	TSharedPtr<FMillicastConnectionTimer, ESPMode::ThreadSafe> ConnectionTimer;
+
+	/** Migration state, see StartMigration */
+	TSharedPtr<IWebSocket> MigrationWS;
+	Millicast::Player::FWebRTCPeerConnection* MigrationPeerConnection = nullptr;
+	TSharedPtr<Millicast::Player::FFirstFrameSink, ESPMode::ThreadSafe> MigrationFrameSink;
+	TArray<TPair<FString, rtc::scoped_refptr<webrtc::MediaStreamTrackInterface>>> MigrationVideoTracks;
+	TArray<TPair<FString, rtc::scoped_refptr<webrtc::MediaStreamTrackInterface>>> MigrationAudioTracks;
+
+	bool bMigrating = false;
+	bool bMigrationWebSocketConnected = false;
+	bool bMigrationLocalDescriptionReady = false;
+	bool bMigrationViewSent = false;
+	bool bMigrationAnswerApplied = false;
+
+	double MigrationStartTime = 0.0;
+	float LastMigrationDurationMs = -1.f;
+
 	UPROPERTY()
 	UMillicastDirectorComponent* CachedDirectorComponent = nullptr;
 
@@ -310,6 +735,9 @@ private:
 
 	UPROPERTY()
 	TArray<UAudioComponent*> AudioComponents;
+
+	UPROPERTY()
+	TArray<TScriptInterface<IMillicastExternalAudioConsumer>> AudioConsumers;
 	
 	UPROPERTY()
 	TArray<UMillicastVideoTrack*> VideoTracks;
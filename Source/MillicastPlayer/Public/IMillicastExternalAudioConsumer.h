@@ -7,15 +7,39 @@
 
 #include "IMillicastExternalAudioConsumer.generated.h"
 
+enum class EMillicastAudioSampleFormat : uint8
+{
+    Int16,   // Interleaved signed 16 bits PCM, as decoded by WebRTC
+    Float32  // Interleaved float PCM in [-1, 1], as consumed by the audio mixer
+};
+
+// How often audio is pulled from WebRTC, and the duration of the blocks handed to the consumers
+UENUM(BlueprintType)
+enum class EMillicastAudioPullPeriod : uint8
+{
+    Period10Ms = 10 UMETA(DisplayName = "10 ms"),
+    Period20Ms = 20 UMETA(DisplayName = "20 ms"),
+    Period40Ms = 40 UMETA(DisplayName = "40 ms"),
+    Period60Ms = 60 UMETA(DisplayName = "60 ms")
+};
+
 struct FMillicastAudioParameters
 {
+    EMillicastAudioSampleFormat SampleFormat = EMillicastAudioSampleFormat::Int16;
     int32 SampleSize = sizeof(int16_t);
     int32 SamplesPerSecond = 48000;
     int32 NumberOfChannels = 2;
+    // Duration of the blocks passed to QueueAudioData, follows the pull period of the subscription
     int32 TimePerFrameMs = 10;
 
     int32 GetNumberSamples() const { return TimePerFrameMs * SamplesPerSecond / 1000; };
     int32 GetNumberBytesPerSample() const { return SampleSize * NumberOfChannels; };
+
+    void SetSampleFormat(EMillicastAudioSampleFormat Format)
+    {
+        SampleFormat = Format;
+        SampleSize = (Format == EMillicastAudioSampleFormat::Float32) ? sizeof(float) : sizeof(int16_t);
+    }
 };
 
 UINTERFACE()
@@ -38,6 +62,7 @@ public:
     virtual void Shutdown() = 0;
 
     // Called from a WebRTC thread when new audio samples are available.
-    // The consumer is encouraged to move the data out of this array
+    // The samples are in the SampleFormat and NumberOfChannels returned by GetAudioParameters,
+    // NumSamples is the number of frames. The consumer is encouraged to move the data out of this array
     virtual void QueueAudioData(const uint8* AudioData, int32 NumSamples) = 0;
 };
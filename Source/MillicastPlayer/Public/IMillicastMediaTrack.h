@@ -9,6 +9,25 @@
 
 #include "IMillicastMediaTrack.generated.h"
 
+/** Audio levels measured locally on the decoded samples of a track */
+USTRUCT(BlueprintType, Category = "MillicastPlayer")
+struct MILLICASTPLAYER_API FMillicastAudioLevels
+{
+	GENERATED_BODY()
+
+	/** RMS level of the last 10 ms of audio, linear in [0, 1] */
+	UPROPERTY(BlueprintReadOnly, Category = "MillicastPlayer")
+	float Rms = 0.f;
+
+	/** Absolute peak of the last 10 ms of audio, linear in [0, 1] */
+	UPROPERTY(BlueprintReadOnly, Category = "MillicastPlayer")
+	float Peak = 0.f;
+
+	/** True while the RMS level is above the voice activity threshold, with a short hangover */
+	UPROPERTY(BlueprintReadOnly, Category = "MillicastPlayer")
+	bool bVoiceActive = false;
+};
+
 UCLASS(Abstract, BlueprintType, Blueprintable)
 class MILLICASTPLAYER_API UMillicastMediaTrack : public UObject
 {
@@ -87,4 +106,17 @@ public:
 	*/
 	UFUNCTION(BlueprintCallable, Category = "MillicastPlayer", META = (DisplayName = "RemoveConsumer"))
 	virtual void RemoveConsumer(TScriptInterface<IMillicastExternalAudioConsumer> AudioConsumer) PURE_VIRTUAL(UMillicastAudioTrack::RemoveConsumer);
+
+	/**
+	* Get the current audio levels of this track. Cheap enough to be called every frame.
+	* Levels are computed on the audio path of the track, whether it has consumers or not, once its audio is playing.
+	*/
+	UFUNCTION(BlueprintCallable, Category = "MillicastPlayer", META = (DisplayName = "GetAudioLevels"))
+	virtual FMillicastAudioLevels GetAudioLevels() const PURE_VIRTUAL(UMillicastAudioTrack::GetAudioLevels, return FMillicastAudioLevels(););
+
+	/**
+	* Set the RMS level, in dBFS, above which the track is considered to be speaking.
+	*/
+	UFUNCTION(BlueprintCallable, Category = "MillicastPlayer", META = (DisplayName = "SetVoiceActivityThreshold"))
+	virtual void SetVoiceActivityThreshold(float ThresholdDb) PURE_VIRTUAL(UMillicastAudioTrack::SetVoiceActivityThreshold);
 };
\ No newline at end of file
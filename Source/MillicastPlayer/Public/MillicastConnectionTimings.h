@@ -0,0 +1,102 @@
+// Copyright Millicast 2023. All Rights Reserved.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "MillicastConnectionTimings.generated.h"
+
+/**
+ * Time of each connection stage, in milliseconds since the first recorded one, usually the director request.
+ * Stages that were not reached are -1.
+ */
+USTRUCT(BlueprintType)
+struct MILLICASTPLAYER_API FMillicastConnectionTimings
+{
+	GENERATED_BODY()
+
+	UPROPERTY(BlueprintReadOnly, Category="MillicastPlayer")
+	float DirectorRequestStart = -1.f;
+
+	UPROPERTY(BlueprintReadOnly, Category="MillicastPlayer")
+	float DirectorRequestEnd = -1.f;
+
+	UPROPERTY(BlueprintReadOnly, Category="MillicastPlayer")
+	float Subscribe = -1.f;
+
+	UPROPERTY(BlueprintReadOnly, Category="MillicastPlayer")
+	float WebSocketConnected = -1.f;
+
+	UPROPERTY(BlueprintReadOnly, Category="MillicastPlayer")
+	float OfferCreated = -1.f;
+
+	UPROPERTY(BlueprintReadOnly, Category="MillicastPlayer")
+	float LocalDescriptionSet = -1.f;
+
+	UPROPERTY(BlueprintReadOnly, Category="MillicastPlayer")
+	float ViewSent = -1.f;
+
+	UPROPERTY(BlueprintReadOnly, Category="MillicastPlayer")
+	float AnswerReceived = -1.f;
+
+	UPROPERTY(BlueprintReadOnly, Category="MillicastPlayer")
+	float IceConnected = -1.f;
+
+	UPROPERTY(BlueprintReadOnly, Category="MillicastPlayer")
+	float FirstRtpPacket = -1.f;
+
+	UPROPERTY(BlueprintReadOnly, Category="MillicastPlayer")
+	float FirstDecodedFrame = -1.f;
+
+	UPROPERTY(BlueprintReadOnly, Category="MillicastPlayer")
+	float FirstConsumerFrame = -1.f;
+
+	UPROPERTY(BlueprintReadOnly, Category="MillicastPlayer")
+	float FirstTextureUpload = -1.f;
+};
+
+enum class EMillicastConnectionStage : uint8
+{
+	DirectorRequestStart,
+	DirectorRequestEnd,
+	Subscribe,
+	WebSocketConnected,
+	OfferCreated,
+	LocalDescriptionSet,
+	ViewSent,
+	AnswerReceived,
+	IceConnected,
+	FirstRtpPacket,
+	FirstDecodedFrame,
+	FirstConsumerFrame,
+	FirstTextureUpload,
+	Count
+};
+
+/**
+ * Records when each stage of a connection is first reached. Thread safe, stages are marked from the game thread,
+ * the WebRTC threads and the render thread. Each mark is also emitted as a trace bookmark and a CSV stat.
+ */
+class MILLICASTPLAYER_API FMillicastConnectionTimer
+{
+public:
+	FMillicastConnectionTimer();
+
+	/** Forget every stage, for a new connection attempt */
+	void Reset();
+
+	/** Record the current time for this stage, unless it was already reached */
+	void Mark(EMillicastConnectionStage Stage);
+
+	/** Record a time measured elsewhere, in FPlatformTime::Cycles64 */
+	void MarkAt(EMillicastConnectionStage Stage, uint64 Cycles);
+
+	bool HasReached(EMillicastConnectionStage Stage) const;
+
+	FMillicastConnectionTimings GetTimings() const;
+
+private:
+	float GetStageMs(EMillicastConnectionStage Stage, uint64 OriginCycles) const;
+	uint64 GetOriginCycles() const;
+
+	TAtomic<uint64> StageCycles[static_cast<int32>(EMillicastConnectionStage::Count)];
+};
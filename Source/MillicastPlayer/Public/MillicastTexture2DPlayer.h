@@ -3,6 +3,7 @@
 #pragma once
 
 #include "IMillicastVideoConsumer.h"
+#include "MillicastConnectionTimings.h"
 #include "MillicastMediaTexture2D.h"
 #include "RendererInterface.h"
 #include "Engine/DataAsset.h"
@@ -37,6 +38,9 @@ public:
 
 	UFUNCTION(BlueprintCallable, Category = "MillicastPlayer", META = (DisplayName = "GetCurrentResolution"))
 	FIntPoint GetCurrentResolution();
+
+	/** Timer of the connection feeding this player, marked on the first texture upload */
+	void SetConnectionTimer(TSharedPtr<FMillicastConnectionTimer, ESPMode::ThreadSafe> InConnectionTimer);
 	
 private:
 	FCriticalSection RenderSyncContext;
@@ -45,4 +49,6 @@ private:
 	TRefCountPtr<IPooledRenderTarget> RenderTarget;
 
 	FIntPoint CachedResolution;
+
+	TSharedPtr<FMillicastConnectionTimer, ESPMode::ThreadSafe> ConnectionTimer;
 };
\ No newline at end of file
@@ -0,0 +1,67 @@
+// Copyright Millicast 2023. All Rights Reserved.
+
+#pragma once
+
+#include "Subsystems/GameInstanceSubsystem.h"
+#include "MillicastSignalingData.h"
+#include "MillicastConnectionPoolSubsystem.generated.h"
+
+namespace Millicast::Player
+{
+	class FWebRTCPeerConnection;
+}
+
+/*
+ * Keeps peer connections ready to subscribe: factory and threads acquired, recv only audio and video transceivers added,
+ * offer created and set as local description. A subscriber taking one only has to send the view command.
+ */
+
+UCLASS()
+class MILLICASTPLAYER_API UMillicastConnectionPoolSubsystem : public UGameInstanceSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	void Deinitialize() override;
+
+	/**
+	 * Keep Count peer connections ready. Connections taken by subscribers are replaced right away.
+	 */
+	UFUNCTION(BlueprintCallable, Category = "MillicastPlayer")
+	void Prewarm(int32 Count);
+
+	UFUNCTION(BlueprintCallable, Category = "MillicastPlayer")
+	int32 GetPoolSize() const { return PoolSize; }
+
+	/**
+	 * Number of connections whose local description is set and that can be taken right now.
+	 */
+	UFUNCTION(BlueprintCallable, Category = "MillicastPlayer")
+	int32 GetNumReadyConnections() const;
+
+	/**
+	 * Take a ready connection out of the pool, nullptr if none is ready. The caller owns the returned connection.
+	 */
+	Millicast::Player::FWebRTCPeerConnection* Acquire();
+
+	/**
+	 * Ice servers of the connections created from now on, the ones the director gave for the last subscription.
+	 * A connection taken with other servers restarts ice, which costs the time the pool saves.
+	 */
+	void SetIceServers(const TArray<webrtc::PeerConnectionInterface::IceServer>& InIceServers);
+
+private:
+	struct FPooledConnection
+	{
+		Millicast::Player::FWebRTCPeerConnection* PeerConnection = nullptr;
+		bool bReady = false;
+	};
+
+	void Refill();
+	void CreatePooledConnection();
+	void OnPooledConnectionPrepared(uint64 PeerConnectionId, bool bSuccess);
+
+	TArray<FPooledConnection> Connections;
+	TArray<webrtc::PeerConnectionInterface::IceServer> IceServers;
+	int32 PoolSize = 0;
+};
@@ -0,0 +1,104 @@
+// Copyright Millicast 2023. All Rights Reserved.
+
+#pragma once
+
+#include "Subsystems/GameInstanceSubsystem.h"
+#include "Tickable.h"
+#include "Components/MillicastSubscriberComponent.h"
+#include "MillicastSubscriptionManagerSubsystem.generated.h"
+
+/*
+ * Knows every subscriber of the game instance and shares a decoding budget between them. Subscribers are ranked by their
+ * priority times their on screen size, the most important ones decode their full quality, the next ones their lowest layer
+ * and the ones left once the budget is spent are paused. Paused subscribers still decode their lowest layer, at its lowest
+ * frame rate, which is charged to the budget and takes a decoder. Without budget every subscriber plays at full quality.
+ * A receive bitrate budget is shared the same way between the subscribers that are not paused, see SetReceiveBitrateBudget.
+ */
+
+UCLASS()
+class MILLICASTPLAYER_API UMillicastSubscriptionManagerSubsystem : public UGameInstanceSubsystem, public FTickableGameObject
+{
+	GENERATED_BODY()
+
+public:
+	void Deinitialize() override;
+
+	/**
+	 * Limit the decoding of all the subscribers. 0 means no limit.
+	 * The megapixels per second are the sum of width * height * frame rate of the video being decoded,
+	 * 1080p at 30 fps is about 62 megapixels per second.
+	 */
+	UFUNCTION(BlueprintCallable, Category = "MillicastPlayer")
+	void SetDecoderBudget(float InMaxDecodedMegapixelsPerSecond, int32 InMaxActiveDecoders);
+
+	UFUNCTION(BlueprintCallable, Category = "MillicastPlayer")
+	float GetMaxDecodedMegapixelsPerSecond() const { return MaxDecodedMegapixelsPerSecond; }
+
+	UFUNCTION(BlueprintCallable, Category = "MillicastPlayer")
+	int32 GetMaxActiveDecoders() const { return MaxActiveDecoders; }
+
+	/**
+	 * Limit the video bitrate received by all the subscribers, in kbps. 0 means no limit.
+	 * Each subscriber receiving video is allocated a share in proportion to its priority times its on screen size,
+	 * and selects the best layer under it. What a subscriber cannot use, over its own cap or its best layer, goes to the others.
+	 */
+	UFUNCTION(BlueprintCallable, Category = "MillicastPlayer")
+	void SetReceiveBitrateBudget(int32 InMaxReceiveBitrateKbps);
+
+	UFUNCTION(BlueprintCallable, Category = "MillicastPlayer")
+	int32 GetReceiveBitrateBudget() const { return MaxReceiveBitrateKbps; }
+
+	/**
+	 * Estimated decoded megapixels per second of the subscribers receiving video, paused ones included, as of the last update.
+	 */
+	UFUNCTION(BlueprintCallable, Category = "MillicastPlayer")
+	float GetUsedDecodedMegapixelsPerSecond() const { return UsedDecodedMegapixelsPerSecond; }
+
+	/**
+	 * How often the tiers are assigned, in seconds
+	 */
+	UFUNCTION(BlueprintCallable, Category = "MillicastPlayer")
+	void SetUpdateInterval(float Seconds) { UpdateIntervalSeconds = FMath::Max(Seconds, 0.f); }
+
+	/**
+	 * Assign the tiers right away instead of at the next update, for instance after changing priorities
+	 */
+	UFUNCTION(BlueprintCallable, Category = "MillicastPlayer")
+	void UpdateTiers();
+
+	/** Called by the subscribers when they begin and end play */
+	void Register(UMillicastSubscriberComponent* Subscriber);
+	void Unregister(UMillicastSubscriberComponent* Subscriber);
+
+	/** FTickableGameObject */
+	void Tick(float DeltaTime) override;
+	bool IsTickable() const override;
+	TStatId GetStatId() const override { RETURN_QUICK_DECLARE_CYCLE_STAT(MillicastSubscriptionManager, STATGROUP_Tickables); }
+
+private:
+	/** Decoded megapixels per second of the subscriber in this tier, estimated from its layers and stats */
+	static float EstimateDecodedMegapixelsPerSecond(const UMillicastSubscriberComponent* Subscriber, EMillicastSubscriptionTier Tier);
+
+	/** Highest video bitrate the subscriber can receive in this tier, in kbps. MAX_int32 when its layers do not report their bitrate */
+	static int32 GetMaxUsableReceiveBitrateKbps(const UMillicastSubscriberComponent* Subscriber, EMillicastSubscriptionTier Tier);
+
+	struct FReceiveBitrateShare
+	{
+		UMillicastSubscriberComponent* Subscriber;
+		float Weight;
+		int32 MaxUsableKbps;
+	};
+
+	/** Water filling of the receive bitrate budget between the subscribers in proportion to their weight */
+	void AllocateReceiveBitrate(const TArray<FReceiveBitrateShare>& Shares) const;
+
+	TArray<TWeakObjectPtr<UMillicastSubscriberComponent>> Subscribers;
+
+	float MaxDecodedMegapixelsPerSecond = 0.f;
+	int32 MaxActiveDecoders = 0;
+	float UsedDecodedMegapixelsPerSecond = 0.f;
+	int32 MaxReceiveBitrateKbps = 0;
+
+	float UpdateIntervalSeconds = 0.5f;
+	float TimeUntilUpdate = 0.f;
+};
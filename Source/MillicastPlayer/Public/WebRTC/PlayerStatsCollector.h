@@ -22,24 +22,60 @@ namespace Millicast::Player
 		FPlayerStatsCollector(class FWebRTCPeerConnection* InPeerConnection);
 		~FPlayerStatsCollector();
 
+		/** Request a report, delivered on the signaling thread. Called by the stats sampler, readers use the snapshots */
 		void Poll();
 
+		/**
+		 * Unregister from the sampler and wait for a poll in progress. Called by the peerconnection before it is released,
+		 * the sampler may still hold a reference but does not poll anymore
+		 */
+		void Detach();
+
+		// Reference counted, by the peerconnection, the sampler and the pending stats requests
+		void AddRef() const override;
+		rtc::RefCountReleaseStatus Release() const override;
+
 		const FString& GetClusterId() const;
 		const FString& GetServerId() const;
 
-		const FPlayerStatsData& GetData() const { return Data; }
+		/** Snapshot of the last report, can be called from any thread */
+		FPlayerStatsData GetData() const;
 
-	protected:
-		void AddRef() const override;
-		rtc::RefCountReleaseStatus Release() const override;
+		/** Snapshots of the last reports, oldest first. Millicast.Player.StatsHistorySize of them at most */
+		TArray<FPlayerStatsData> GetHistory() const;
 
+	protected:
 		// Begin RTCStatsCollectorCallback interface
 		void OnStatsDelivered(const rtc::scoped_refptr<const webrtc::RTCStatsReport>& report) override;
 
 	private:
+		/** Average jitter buffer delay of the samples emitted since the last report, from the cumulative counters */
+		static float GetIntervalDelayMs(double TotalDelay, uint64 EmittedCount, double& LastTotalDelay, uint64& LastEmittedCount, float PreviousValue);
+		void UpdateLatencyTarget(FPlayerStatsData& Sample) const;
+		void PushHistory(const FPlayerStatsData& Sample);
+		void LogNegotiatedVideoCodec(const FString& MimeType) const;
+		bool IsDetached() const;
+
 		FWebRTCPeerConnection* PeerConnection;
-		mutable int32 RefCount;
+		mutable int32 RefCount = 0;
+
+		// Held while polling, so that Detach returns once no poll uses the peerconnection anymore
+		FCriticalSection PollSection;
+
+		// Guards bDetached, held while a report reads the peerconnection. Never taken with PollSection held by Detach,
+		// a poll holds PollSection while it waits on the signaling thread delivering the reports
+		mutable FCriticalSection DetachSection;
+		bool bDetached = false;
+
+		/** Only written on the signaling thread, under DataSection for the readers of the other threads */
 		FPlayerStatsData Data;
+
+		// Ring buffer of the last reports, HistoryNext is where the next one goes once it is full
+		TArray<FPlayerStatsData> History;
+		int32 HistoryCapacity = 0;
+		int32 HistoryNext = 0;
+
+		mutable FCriticalSection DataSection;
 	};
 }
 #endif
@@ -27,6 +27,10 @@ struct MILLICASTPLAYER_API FPlayerStatsData
 
 	UPROPERTY(BlueprintReadOnly, Category="MillicastPlayer")
 	float AudioBitrate = 0.0f; // bps
+
+	// Receive side bandwidth estimate of the selected candidate pair, 0 when WebRTC has none, as with transport-cc where the sender estimates it
+	UPROPERTY(BlueprintReadOnly, Category="MillicastPlayer")
+	float AvailableIncomingBitrate = 0.0f; // bps
 	
 	UPROPERTY(BlueprintReadOnly, Category="MillicastPlayer")
 	int32 VideoTotalReceived = 0; // bytes
@@ -52,6 +56,22 @@ struct MILLICASTPLAYER_API FPlayerStatsData
 	UPROPERTY(BlueprintReadOnly, Category="MillicastPlayer")
 	float AudioJitterAverageDelay = 0.0f; // ms
 
+	// Over the last stats interval only, unlike the averages which cover the whole session
+	UPROPERTY(BlueprintReadOnly, Category="MillicastPlayer")
+	float VideoJitterBufferCurrentDelay = 0.0f; // ms
+
+	UPROPERTY(BlueprintReadOnly, Category="MillicastPlayer")
+	float AudioJitterBufferCurrentDelay = 0.0f; // ms
+
+	UPROPERTY(BlueprintReadOnly, Category="MillicastPlayer")
+	float JitterBufferMinimumDelay = -1.0f; // ms, requested, -1 if adapted by WebRTC
+
+	UPROPERTY(BlueprintReadOnly, Category="MillicastPlayer")
+	float MaximumDelay = -1.0f; // ms, latency target, -1 if none
+
+	UPROPERTY(BlueprintReadOnly, Category="MillicastPlayer")
+	bool bLatencyTargetMet = true;
+
 	UPROPERTY(BlueprintReadOnly, Category="MillicastPlayer")
 	FString VideoCodec; // mimetype
 
@@ -106,4 +126,9 @@ struct MILLICASTPLAYER_API FPlayerStatsData
 	// TODO [RW] Why was this not made accessible by David?
 	double LastVideoStatTimestamp = 0.0f;
 	double LastAudioStatTimestamp = 0.0f;
+
+	double LastVideoJitterBufferDelay = 0.0; // s
+	uint64 LastVideoJitterBufferEmittedCount = 0;
+	double LastAudioJitterBufferDelay = 0.0; // s
+	uint64 LastAudioJitterBufferEmittedCount = 0;
 };